@@ -22,8 +22,17 @@
 // Own
 #include "Emulation.h"
 
+// System
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 // Qt
+#include <QGuiApplication>
 #include <QKeyEvent>
+#include <QScreen>
+#include <QtAlgorithms>
+#include <QtMath>
 
 // Konsole
 #include "KeyboardTranslator.h"
@@ -41,17 +50,33 @@ Emulation::Emulation() :
     _keyTranslator(nullptr),
     _usesMouseTracking(false),
     _bracketedPasteMode(false),
-    _bulkTimer1(new QTimer(this)),
-    _bulkTimer2(new QTimer(this)),
-    _imageSizeInitialized(false)
+    _updateTimer(),
+    _idleTimer(),
+    _imageSizeInitialized(false),
+    _updateClock(),
+    _lastUpdateTime(0),
+    _lastUpdateDuration(0),
+    _minimumUpdateInterval(0),
+    _receivedBytes(0),
+    _updateCount(0),
+    _receiveBuffer(),
+    _decoderPending(false)
 {
     // create screens with a default size
     _screen[0] = new Screen(40, 80);
     _screen[1] = new Screen(40, 80);
     _currentScreen = _screen[0];
 
-    QObject::connect(&_bulkTimer1, &QTimer::timeout, this, &Konsole::Emulation::showBulk);
-    QObject::connect(&_bulkTimer2, &QTimer::timeout, this, &Konsole::Emulation::showBulk);
+    // programs using the alternate screen redraw it when the terminal is
+    // resized, only the lines of the primary screen are rewrapped
+    _screen[0]->setReflowLines(true);
+
+    _updateTimer.setSingleShot(true);
+    _idleTimer.setSingleShot(true);
+    _updateClock.start();
+
+    QObject::connect(&_updateTimer, &QTimer::timeout, this, &Konsole::Emulation::showBulk);
+    QObject::connect(&_idleTimer, &QTimer::timeout, this, &Konsole::Emulation::flushHistory);
 
     // listen for mouse status changes
     connect(this, &Konsole::Emulation::programRequestsMouseTracking, this,
@@ -84,6 +109,7 @@ ScreenWindow *Emulation::createWindow()
 {
     auto window = new ScreenWindow(_currentScreen);
     _windows << window;
+    window->setWindows(&_windows);
 
     connect(window, &Konsole::ScreenWindow::selectionChanged, this,
             &Konsole::Emulation::bufferedUpdate);
@@ -157,6 +183,7 @@ void Emulation::setCodec(const QTextCodec *codec)
 
         delete _decoder;
         _decoder = _codec->makeDecoder();
+        _decoderPending = false;
 
         emit useUtf8Request(utf8());
     } else {
@@ -213,6 +240,13 @@ void Emulation::receiveChar(uint c)
     }
 }
 
+void Emulation::receiveChars(const uint *chars, int count)
+{
+    for (int i = 0; i < count; i++) {
+        receiveChar(chars[i]);
+    }
+}
+
 void Emulation::sendKeyEvent(QKeyEvent *ev)
 {
     emit stateSet(NOTIFYNORMAL);
@@ -234,31 +268,112 @@ void Emulation::sendMouseEvent(int /*buttons*/, int /*column*/, int /*row*/, int
    We are doing code conversion from locale to unicode first.
 */
 
+// Returns the position of the first byte of @p text which is not ASCII or
+// which is the CAN character starting ZMODEM headers, or @p length if there
+// is none.  Everything else is passed on as it is by the UTF-8 codec.
+static int findSpecialByte(const char *text, int length)
+{
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128i can = _mm_set1_epi8('\030');
+    for (; i + 16 <= length; i += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i));
+        // the high bit is set for non-ASCII bytes and for the CAN bytes
+        const __m128i special = _mm_or_si128(bytes, _mm_cmpeq_epi8(bytes, can));
+        const int mask = _mm_movemask_epi8(special);
+        if (mask != 0) {
+            return i + qCountTrailingZeroBits(static_cast<quint32>(mask));
+        }
+    }
+#endif
+
+    for (; i < length; i++) {
+        const uchar c = static_cast<uchar>(text[i]);
+        if (c >= 0x80 || c == '\030') {
+            return i;
+        }
+    }
+    return length;
+}
+
 void Emulation::receiveData(const char *text, int length)
 {
     emit stateSet(NOTIFYACTIVITY);
 
+    _receivedBytes += length;
     bufferedUpdate();
 
-    QVector<uint> unicodeText = _decoder->toUnicode(text, length).toUcs4();
+    if (utf8()) {
+        decodeUtf8(text, length);
+    } else {
+        _receiveBuffer = _decoder->toUnicode(text, length).toUcs4();
 
-    //send characters to terminal emulator
-    for (auto &&i : unicodeText) {
-        receiveChar(i);
+        //look for z-modem indicator
+        for (int i = findSpecialByte(text, length); i < length;
+             i += 1 + findSpecialByte(text + i + 1, length - i - 1)) {
+            if (text[i] == '\030') {
+                checkZModem(text, length, i);
+            }
+        }
     }
 
-    //look for z-modem indicator
-    //-- someone who understands more about z-modems that I do may be able to move
-    //this check into the above for loop?
-    for (int i = 0; i < length; i++) {
-        if (text[i] == '\030') {
-            if (length - i - 1 > 3) {
-                if (qstrncmp(text + i + 1, "B00", 3) == 0) {
-                    emit zmodemDownloadDetected();
-                } else if (qstrncmp(text + i + 1, "B01", 3) == 0) {
-                    emit zmodemUploadDetected();
-                }
+    //send characters to terminal emulator
+    receiveChars(_receiveBuffer.constData(), _receiveBuffer.size());
+}
+
+void Emulation::decodeUtf8(const char *text, int length)
+{
+    _receiveBuffer.resize(0);
+    _receiveBuffer.reserve(length);
+
+    int i = 0;
+    while (i < length) {
+        // ASCII is the same in UTF-8, so runs of it are copied as they are,
+        // unless the decoder waits for the rest of a sequence
+        int end = _decoderPending ? i : i + findSpecialByte(text + i, length - i);
+        if (end > i) {
+            const int count = _receiveBuffer.size();
+            _receiveBuffer.resize(count + end - i);
+            uint *chars = _receiveBuffer.data() + count;
+            for (int j = i; j < end; j++) {
+                *chars++ = static_cast<uchar>(text[j]);
             }
+            i = end;
+            continue;
+        }
+
+        if (text[i] == '\030' && !_decoderPending) {
+            checkZModem(text, length, i);
+            _receiveBuffer.append('\030');
+            i++;
+            continue;
+        }
+
+        // decode the non-ASCII bytes together with the following ASCII byte,
+        // which ends any sequence left incomplete
+        while (end < length && static_cast<uchar>(text[end]) >= 0x80) {
+            end++;
+        }
+        _decoderPending = (end == length);
+        if (end < length) {
+            if (text[end] == '\030') {
+                checkZModem(text, length, end);
+            }
+            end++;
+        }
+        _receiveBuffer += _decoder->toUnicode(text + i, end - i).toUcs4();
+        i = end;
+    }
+}
+
+void Emulation::checkZModem(const char *text, int length, int position)
+{
+    if (length - position - 1 > 3) {
+        if (qstrncmp(text + position + 1, "B00", 3) == 0) {
+            emit zmodemDownloadDetected();
+        } else if (qstrncmp(text + position + 1, "B01", 3) == 0) {
+            emit zmodemUploadDetected();
         }
     }
 }
@@ -268,34 +383,86 @@ void Emulation::writeToStream(TerminalCharacterDecoder *decoder, int startLine,
     _currentScreen->writeLinesToStream(decoder, startLine, endLine);
 }
 
+const Screen *Emulation::currentScreen() const
+{
+    return _currentScreen;
+}
+
 int Emulation::lineCount() const
 {
     // sum number of lines currently on _screen plus number of lines in history
     return _currentScreen->getLines() + _currentScreen->getHistLines();
 }
 
+qint64 Emulation::receivedBytes() const
+{
+    return _receivedBytes;
+}
+
+int Emulation::updateCount() const
+{
+    return _updateCount;
+}
+
 void Emulation::showBulk()
 {
-    _bulkTimer1.stop();
-    _bulkTimer2.stop();
+    _updateTimer.stop();
 
+    // the views update their image while the signal is emitted
+    _lastUpdateTime = _updateClock.elapsed();
     emit outputChanged();
+    _lastUpdateDuration = _updateClock.elapsed() - _lastUpdateTime;
 
     _currentScreen->resetScrolledLines();
     _currentScreen->resetDroppedLines();
+
+    _updateCount++;
+}
+
+void Emulation::flushHistory()
+{
+    _screen[0]->flushHistory();
 }
 
 void Emulation::bufferedUpdate()
 {
-    static const int BULK_TIMEOUT1 = 10;
-    static const int BULK_TIMEOUT2 = 40;
+    static const int IDLE_TIMEOUT = 10;
+    // lets the output which is already waiting to be read be parsed first
+    static const int MIN_UPDATE_DELAY = 2;
+
+    _idleTimer.start(IDLE_TIMEOUT);
+
+    if (_updateTimer.isActive()) {
+        return;
+    }
+
+    const qint64 sinceLastUpdate = _updateClock.elapsed() - _lastUpdateTime;
+    _updateTimer.start(int(qMax<qint64>(MIN_UPDATE_DELAY, updateInterval() - sinceLastUpdate)));
+}
 
-    _bulkTimer1.setSingleShot(true);
-    _bulkTimer1.start(BULK_TIMEOUT1);
-    if (!_bulkTimer2.isActive()) {
-        _bulkTimer2.setSingleShot(true);
-        _bulkTimer2.start(BULK_TIMEOUT2);
+int Emulation::updateInterval() const
+{
+    // updating the views takes at most a quarter of the time under a flood
+    // of output, the rest is left to parsing it
+    static const int UPDATE_TIME_RATIO = 4;
+    static const qreal DEFAULT_REFRESH_RATE = 60;
+
+    int interval = _minimumUpdateInterval;
+    if (interval <= 0) {
+        const QScreen *screen = QGuiApplication::primaryScreen();
+        qreal refreshRate = screen != nullptr ? screen->refreshRate() : DEFAULT_REFRESH_RATE;
+        if (refreshRate < 1) {
+            refreshRate = DEFAULT_REFRESH_RATE;
+        }
+        interval = qCeil(1000 / refreshRate);
     }
+
+    return qMax(interval, int(_lastUpdateDuration) * UPDATE_TIME_RATIO);
+}
+
+void Emulation::setMinimumUpdateInterval(int milliseconds)
+{
+    _minimumUpdateInterval = milliseconds;
 }
 
 char Emulation::eraseChar() const
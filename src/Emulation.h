@@ -24,9 +24,11 @@
 #define EMULATION_H
 
 // Qt
+#include <QElapsedTimer>
 #include <QSize>
 #include <QTextCodec>
 #include <QTimer>
+#include <QVector>
 
 // Konsole
 #include "Enumeration.h"
@@ -138,6 +140,26 @@ public:
      */
     int lineCount() const;
 
+    /**
+     * Returns the number of bytes received with receiveData() since the
+     * emulation was created.  Compared with updateCount(), this tells how
+     * much output is parsed for each update of the views.
+     */
+    qint64 receivedBytes() const;
+
+    /**
+     * Returns the number of times outputChanged() was emitted since the
+     * emulation was created.
+     */
+    int updateCount() const;
+
+    /**
+     * Sets the shortest time between two updates of the views, in
+     * milliseconds.  By default, or if @p milliseconds is 0, the views are
+     * updated at most once per frame of the primary screen.
+     */
+    void setMinimumUpdateInterval(int milliseconds);
+
     /**
      * Sets the history store used by this emulation.  When new lines
      * are added to the output, older lines at the top of the screen are transferred to a history
@@ -165,6 +187,14 @@ public:
      */
     virtual void writeToStream(TerminalCharacterDecoder *decoder, int startLine, int endLine);
 
+    /**
+     * Returns the screen which is currently used, the normal or the alternate
+     * one.  The screen stays valid as long as the emulation does, so the
+     * output of the screen can be copied in parts with Screen::copyLines(),
+     * even when the program switches to the other screen in between.
+     */
+    const Screen *currentScreen() const;
+
     /** Returns the codec used to decode incoming characters.  See setCodec() */
     const QTextCodec *codec() const
     {
@@ -253,12 +283,13 @@ public Q_SLOTS:
 
     /**
      * Processes an incoming stream of characters.  receiveData() decodes the incoming
-     * character buffer using the current codec(), and then calls receiveChar() for
-     * each unicode character in the resulting buffer.
+     * character buffer using the current codec(), and then passes the resulting
+     * unicode characters to receiveChars().  With UTF-8, runs of plain ASCII
+     * are passed on without going through the codec.
      *
-     * receiveData() also starts a timer which causes the outputChanged() signal
-     * to be emitted when it expires.  The timer allows multiple updates in quick
-     * succession to be buffered into a single outputChanged() signal emission.
+     * receiveData() also schedules the outputChanged() signal, see bufferedUpdate().
+     * Output received in quick succession is shown with a single outputChanged()
+     * signal emission.
      *
      * @param text A string of characters received from the terminal program.
      * @param length The length of @p text
@@ -337,8 +368,8 @@ Q_SIGNALS:
     /**
      * Emitted when the contents of the screen image change.
      * The emulation buffers the updates from successive image changes,
-     * and only emits outputChanged() at sensible intervals when
-     * there is a lot of terminal activity.
+     * and emits outputChanged() at most once per frame of the display
+     * when there is a lot of terminal activity.
      *
      * Normally there is no need for objects other than the screen windows
      * created with createWindow() to listen for this signal.
@@ -456,6 +487,13 @@ protected:
      */
     virtual void receiveChar(uint c);
 
+    /**
+     * Processes @p count incoming characters.  The default implementation
+     * calls receiveChar() for each of them; emulations can handle runs of
+     * plain text at once instead.
+     */
+    virtual void receiveChars(const uint *chars, int count);
+
     /**
      * Sets the active screen.  The terminal has two screens, primary and alternate.
      * The primary screen is used by default.  When certain interactive programs such
@@ -493,6 +531,10 @@ protected Q_SLOTS:
      * Schedules an update of attached views.
      * Repeated calls to bufferedUpdate() in close succession will result in only a single update,
      * much like the Qt buffered update of widgets.
+     *
+     * Updates are shown at most once per frame of the display.  When updating the views takes
+     * long, they are shown less often so that most of the time is left to parsing the output;
+     * the states of the screen in between are never shown.
      */
     void bufferedUpdate();
 
@@ -507,6 +549,10 @@ private Q_SLOTS:
     // view
     void showBulk();
 
+    // triggered once no output has been received for a while, writes
+    // out history lines which are still buffered in memory
+    void flushHistory();
+
     void setUsesMouseTracking(bool usesMouseTracking);
 
     void bracketedPasteModeChanged(bool bracketedPasteMode);
@@ -514,11 +560,37 @@ private Q_SLOTS:
 private:
     Q_DISABLE_COPY(Emulation)
 
+    // decodes UTF-8 @p text into _receiveBuffer, only the non-ASCII parts go
+    // through _decoder
+    void decodeUtf8(const char *text, int length);
+    // emits zmodemDownloadDetected() or zmodemUploadDetected() if the CAN
+    // character at @p position starts a ZMODEM header
+    void checkZModem(const char *text, int length, int position);
+
+    // the time between two updates of the views, see bufferedUpdate()
+    int updateInterval() const;
+
     bool _usesMouseTracking;
     bool _bracketedPasteMode;
-    QTimer _bulkTimer1;
-    QTimer _bulkTimer2;
+    QTimer _updateTimer; // shows the next update, see bufferedUpdate()
+    QTimer _idleTimer;   // expires once no output has been received for a while
     bool _imageSizeInitialized;
+
+    // when the last update was shown and how long it took, measured with
+    // _updateClock
+    QElapsedTimer _updateClock;
+    qint64 _lastUpdateTime;
+    qint64 _lastUpdateDuration;
+    int _minimumUpdateInterval; // see setMinimumUpdateInterval()
+
+    // see receivedBytes() and updateCount()
+    qint64 _receivedBytes;
+    int _updateCount;
+
+    // the characters decoded by receiveData(), kept to reuse its memory
+    QVector<uint> _receiveBuffer;
+    // whether _decoder may hold the start of an incomplete UTF-8 sequence
+    bool _decoderPending;
 };
 }
 
@@ -47,7 +47,12 @@ public:
          * Typically this means that lines are recorded to
          * a file as they are scrolled off-screen.
          */
-        UnlimitedHistory = 2
+        UnlimitedHistory = 2,
+        /** All output is remembered for the duration of the session.
+         * Lines are compressed in blocks before they are recorded to
+         * a file, which uses much less disk space than UnlimitedHistory.
+         */
+        CompressedUnlimitedHistory = 3
     };
 
     /**
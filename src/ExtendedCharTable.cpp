@@ -33,7 +33,8 @@
 using namespace Konsole;
 
 ExtendedCharTable::ExtendedCharTable() :
-    _extendedCharTable(QHash<uint, uint *>())
+    _extendedCharTable(QHash<uint, uint *>()),
+    _lock()
 {
 }
 
@@ -52,6 +53,8 @@ ExtendedCharTable ExtendedCharTable::instance;
 
 uint ExtendedCharTable::createExtendedChar(const uint *unicodePoints, ushort length)
 {
+    QWriteLocker locker(&_lock);
+
     // look for this sequence of points in the table
     uint hash = extendedCharHash(unicodePoints, length);
     const uint initialHash = hash;
@@ -116,6 +119,7 @@ uint *ExtendedCharTable::lookupExtendedChar(uint hash, ushort &length) const
     // look up index in table and if found, set the length
     // argument and return a pointer to the character sequence
 
+    QReadLocker locker(&_lock);
     uint *buffer = _extendedCharTable[hash];
     if (buffer != nullptr) {
         length = ushort(buffer[0]);
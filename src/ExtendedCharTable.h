@@ -24,6 +24,7 @@
 
 // Qt
 #include <QHash>
+#include <QReadWriteLock>
 
 namespace Konsole {
 /**
@@ -31,6 +32,9 @@ namespace Konsole {
  * by hash keys.  The hash key itself is the same size as a unicode
  * character ( uint ) so that it can occupy the same space in
  * a structure.
+ *
+ * The table may be read from other threads (e.g. when searching
+ * through the output in the background) while new sequences are added.
  */
 class ExtendedCharTable
 {
@@ -75,6 +79,9 @@ private:
     // in each value is the length of the buffer, followed by the uints in the buffer
     // themselves.
     QHash<uint, uint *> _extendedCharTable;
+    // guards _extendedCharTable.  Buffers are never freed while the
+    // table exists, so the pointers handed out stay valid after unlocking.
+    mutable QReadWriteLock _lock;
 };
 }
 #endif  // end of EXTENDEDCHARTABLE_H
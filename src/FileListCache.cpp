@@ -0,0 +1,222 @@
+/*
+    Copyright 2018 by The Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "FileListCache.h"
+
+// Qt
+#include <QCoreApplication>
+#include <QDir>
+#include <QPointer>
+#include <QStringList>
+
+using namespace Konsole;
+
+// the number of directories whose files are kept
+static const int MAX_DIRECTORIES = 16;
+// how long changes of a directory are collected before it is listed again
+static const int CHANGE_DELAY = 1000; // ms
+
+void FileLister::list(const QString &path)
+{
+    const QDir dir(path);
+    emit listed(path, dir.canonicalPath(), dir.entryList(QDir::Files).toSet());
+}
+
+FileListCache::FileListCache(QObject *parent) :
+    QObject(parent),
+    _listings(QHash<QString, Listing>()),
+    _useCount(0),
+    _thread(),
+    _lister(new FileLister()),
+    _watcher(),
+    _changedDirectories(),
+    _changeTimer()
+{
+    // the files are sent to the GUI thread with queued connections
+    qRegisterMetaType<QSet<QString> >("QSet<QString>");
+
+    _lister->moveToThread(&_thread);
+    connect(&_thread, &QThread::finished, _lister, &QObject::deleteLater);
+    connect(this, &Konsole::FileListCache::listRequested, _lister, &Konsole::FileLister::list);
+    connect(_lister, &Konsole::FileLister::listed, this, &Konsole::FileListCache::setFiles);
+    connect(&_watcher, &QFileSystemWatcher::directoryChanged, this, &Konsole::FileListCache::directoryChanged);
+
+    _changeTimer.setSingleShot(true);
+    _changeTimer.setInterval(CHANGE_DELAY);
+    connect(&_changeTimer, &QTimer::timeout, this, &Konsole::FileListCache::listChangedDirectories);
+
+    _thread.start();
+}
+
+FileListCache::~FileListCache()
+{
+    stopListing();
+}
+
+FileListCache *FileListCache::instance()
+{
+    static QPointer<FileListCache> cache;
+    if (cache.isNull()) {
+        QCoreApplication *app = QCoreApplication::instance();
+        cache = new FileListCache(app);
+        if (app != nullptr) {
+            // the thread must not outlive the event loop it was started from
+            connect(app, &QCoreApplication::aboutToQuit, cache.data(), &Konsole::FileListCache::stopListing);
+        }
+    }
+    return cache;
+}
+
+void FileListCache::stopListing()
+{
+    _thread.quit();
+    _thread.wait();
+}
+
+QSet<QString> FileListCache::files(const QString &path, QString &canonicalPath)
+{
+    QHash<QString, Listing>::iterator iter = _listings.find(path);
+    if (iter == _listings.end()) {
+        if (_listings.count() >= MAX_DIRECTORIES) {
+            removeLeastRecentlyUsed();
+        }
+
+        Listing listing;
+        listing.revision = 0;
+        listing.listing = false;
+        listing.changed = false;
+        iter = _listings.insert(path, listing);
+        requestListing(path);
+    }
+
+    iter->lastUse = ++_useCount;
+    canonicalPath = iter->canonicalPath;
+    return iter->files;
+}
+
+int FileListCache::revision(const QString &path) const
+{
+    QHash<QString, Listing>::const_iterator iter = _listings.constFind(path);
+    return iter != _listings.constEnd() ? iter->revision : -1;
+}
+
+void FileListCache::requestListing(const QString &path)
+{
+    Listing &listing = _listings[path];
+    if (listing.listing) {
+        listing.changed = true;
+        return;
+    }
+
+    listing.listing = true;
+    listing.changed = false;
+    emit listRequested(path);
+}
+
+void FileListCache::setFiles(const QString &path, const QString &canonicalPath, const QSet<QString> &files)
+{
+    QHash<QString, Listing>::iterator iter = _listings.find(path);
+    if (iter == _listings.end()) {
+        return;
+    }
+
+    iter->listing = false;
+
+    // the filters only need to be updated when the files changed
+    const bool filesChanged = iter->canonicalPath != canonicalPath || iter->files != files;
+    if (filesChanged) {
+        iter->revision++;
+        iter->files = files;
+    }
+
+    if (iter->canonicalPath != canonicalPath) {
+        const QString oldPath = iter->canonicalPath;
+        iter->canonicalPath = canonicalPath;
+        if (!canonicalPath.isEmpty() && !_watcher.directories().contains(canonicalPath)) {
+            _watcher.addPath(canonicalPath);
+        }
+        unwatch(oldPath);
+    }
+
+    if (iter->changed) {
+        requestListing(path);
+    }
+
+    if (filesChanged) {
+        emit directoryListed(path);
+    }
+}
+
+void FileListCache::directoryChanged(const QString &canonicalPath)
+{
+    _changedDirectories.insert(canonicalPath);
+    if (!_changeTimer.isActive()) {
+        _changeTimer.start();
+    }
+}
+
+void FileListCache::listChangedDirectories()
+{
+    const QSet<QString> changedDirectories = _changedDirectories;
+    _changedDirectories.clear();
+
+    QStringList paths;
+    for (QHash<QString, Listing>::const_iterator iter = _listings.constBegin();
+         iter != _listings.constEnd(); ++iter) {
+        if (changedDirectories.contains(iter->canonicalPath)) {
+            paths << iter.key();
+        }
+    }
+
+    foreach (const QString &path, paths) {
+        requestListing(path);
+    }
+}
+
+void FileListCache::unwatch(const QString &canonicalPath)
+{
+    if (canonicalPath.isEmpty()) {
+        return;
+    }
+
+    // other paths may lead to the same directory
+    for (QHash<QString, Listing>::const_iterator iter = _listings.constBegin();
+         iter != _listings.constEnd(); ++iter) {
+        if (iter->canonicalPath == canonicalPath) {
+            return;
+        }
+    }
+
+    _watcher.removePath(canonicalPath);
+}
+
+void FileListCache::removeLeastRecentlyUsed()
+{
+    QHash<QString, Listing>::iterator oldest = _listings.begin();
+    for (QHash<QString, Listing>::iterator iter = _listings.begin(); iter != _listings.end(); ++iter) {
+        if (iter->lastUse < oldest->lastUse) {
+            oldest = iter;
+        }
+    }
+
+    const QString canonicalPath = oldest->canonicalPath;
+    _listings.erase(oldest);
+    unwatch(canonicalPath);
+}
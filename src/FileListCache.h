@@ -0,0 +1,137 @@
+/*
+    Copyright 2018 by The Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef FILELISTCACHE_H
+#define FILELISTCACHE_H
+
+// Qt
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QThread>
+#include <QTimer>
+
+// Konsole
+#include "konsoleprivate_export.h"
+
+namespace Konsole {
+/**
+ * Lists directories for FileListCache, on the thread it is moved to.
+ */
+class FileLister : public QObject
+{
+    Q_OBJECT
+
+public Q_SLOTS:
+    void list(const QString &path);
+
+Q_SIGNALS:
+    void listed(const QString &path, const QString &canonicalPath, const QSet<QString> &files);
+};
+
+/**
+ * Keeps the names of the files in the working directories of the sessions,
+ * for the FileFilters of all of them.
+ *
+ * Directories are listed on a thread of their own when they are first
+ * asked for, and listed again when they change, at most about once per
+ * second while they keep changing, e.g. during a build.  Until a listing is
+ * done, the previous one is returned, so that asking for the files never
+ * waits for the file system.  Only the most recently used directories are
+ * kept.
+ */
+class KONSOLEPRIVATE_EXPORT FileListCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FileListCache(QObject *parent = nullptr);
+    ~FileListCache() Q_DECL_OVERRIDE;
+
+    /**
+     * Returns the file list cache instance, which is owned by the application
+     * and stops listing directories when the application is about to quit.
+     */
+    static FileListCache *instance();
+
+    /**
+     * Returns the names of the files in the directory @p path and sets
+     * @p canonicalPath to the canonical path of the directory.  Both are
+     * empty until the directory was listed.
+     */
+    QSet<QString> files(const QString &path, QString &canonicalPath);
+
+    /**
+     * Returns a number which increases whenever the files of @p path or its
+     * canonical path change, or -1 if it is not in the cache.  It is 0 until
+     * the directory was listed.
+     */
+    int revision(const QString &path) const;
+
+Q_SIGNALS:
+    /** Emitted when the directory @p path was listed and its files changed, see revision() */
+    void directoryListed(const QString &path);
+
+    // requests the lister to list @p path
+    void listRequested(const QString &path);
+
+private Q_SLOTS:
+    void setFiles(const QString &path, const QString &canonicalPath, const QSet<QString> &files);
+    void directoryChanged(const QString &canonicalPath);
+    // lists the directories which changed since the timer was started again
+    void listChangedDirectories();
+    // stops the lister thread
+    void stopListing();
+
+private:
+    Q_DISABLE_COPY(FileListCache)
+
+    void requestListing(const QString &path);
+    void removeLeastRecentlyUsed();
+    // stops watching @p canonicalPath if no listing is of it
+    void unwatch(const QString &canonicalPath);
+
+    struct Listing
+    {
+        QString canonicalPath;
+        QSet<QString> files;
+        int revision;
+        // a listing was requested and not received yet
+        bool listing;
+        // the directory changed since the pending listing was requested
+        bool changed;
+        quint64 lastUse;
+    };
+
+    QHash<QString, Listing> _listings;
+    quint64 _useCount;
+
+    QThread _thread;
+    FileLister *_lister;
+    QFileSystemWatcher _watcher;
+    // the canonical paths of the directories which changed, listed again
+    // once the timer fires, so that a burst of changes is listed only once
+    QSet<QString> _changedDirectories;
+    QTimer _changeTimer;
+};
+}
+
+#endif // FILELISTCACHE_H
@@ -26,7 +26,6 @@
 #include <QAction>
 #include <QApplication>
 #include <QClipboard>
-#include <QDir>
 #include <QFile>
 #include <QMimeDatabase>
 #include <QString>
@@ -38,12 +37,62 @@
 #include <KRun>
 
 // Konsole
+#include "FileListCache.h"
 #include "Session.h"
 #include "TerminalCharacterDecoder.h"
 #include "konsole_wcwidth.h"
 
+// Standard
+#include <algorithm>
+#include <limits>
+
 using namespace Konsole;
 
+// returns the last line of the block of wrapped lines starting at @p line
+static int blockEnd(const QVector<LineProperty> &lineProperties, int lines, int line)
+{
+    while (line < lines - 1 && (lineProperties.value(line, LINE_DEFAULT) & LINE_WRAPPED) != 0) {
+        line++;
+    }
+    return line;
+}
+
+// characters are the same for the filters if they decode to the same text
+static inline bool sameText(const Character &a, const Character &b)
+{
+    return a.character == b.character
+           && a.isRealCharacter == b.isRealCharacter
+           && (a.rendition & RE_EXTENDED_CHAR) == (b.rendition & RE_EXTENDED_CHAR);
+}
+
+static uint textHash(const Character *characters, int count)
+{
+    uint hash = 0;
+    for (int i = 0; i < count; i++) {
+        hash = hash * 31 + (characters[i].character << 1) + (characters[i].isRealCharacter ? 1 : 0);
+    }
+    return hash;
+}
+
+static bool hotSpotLessThan(const Filter::HotSpot *a, const Filter::HotSpot *b)
+{
+    if (a->startLine() != b->startLine()) {
+        return a->startLine() < b->startLine();
+    }
+    return a->startColumn() < b->startColumn();
+}
+
+// the first and last columns of @p line covered by @p spot
+static inline int startColumnAt(const Filter::HotSpot *spot, int line)
+{
+    return spot->startLine() == line ? spot->startColumn() : 0;
+}
+
+static inline int endColumnAt(const Filter::HotSpot *spot, int line)
+{
+    return spot->endLine() == line ? spot->endColumn() : std::numeric_limits<int>::max();
+}
+
 FilterChain::~FilterChain()
 {
     QMutableListIterator<Filter *> iter(*this);
@@ -73,6 +122,17 @@ void FilterChain::reset()
     }
 }
 
+bool FilterChain::isOutdated() const
+{
+    QListIterator<Filter *> iter(*this);
+    while (iter.hasNext()) {
+        if (iter.next()->isOutdated()) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void FilterChain::setBuffer(const QString *buffer, const QList<int> *linePositions)
 {
     QListIterator<Filter *> iter(*this);
@@ -121,7 +181,13 @@ QList<Filter::HotSpot *> FilterChain::hotSpots() const
 
 TerminalImageFilterChain::TerminalImageFilterChain() :
     _buffer(nullptr),
-    _linePositions(nullptr)
+    _linePositions(nullptr),
+    _image(QVector<Character>()),
+    _lineProperties(QVector<LineProperty>()),
+    _lines(0),
+    _columns(0),
+    _blocks(QMultiHash<uint, int>()),
+    _filters(QList<Filter *>())
 {
 }
 
@@ -135,11 +201,84 @@ void TerminalImageFilterChain::setImage(const Character * const image, int lines
                                         const QVector<LineProperty> &lineProperties)
 {
     if (empty()) {
+        _filters.clear();
         return;
     }
 
-    // reset all filters and hotspots
-    reset();
+    // the lines of the previous image which are found again, unchanged, in
+    // this one can keep their hotspots.  This is only known if the filters
+    // and the width of the lines are the same as before
+    const bool processAll = columns != _columns || _filters != static_cast<const QList<Filter *> &>(*this)
+                            || isOutdated();
+
+    QVector<int> lineMap(_lines, -1);
+    QVector<bool> reused(_lines, false);
+    QVector<bool> changed(lines, true);
+    QMultiHash<uint, int> blocks;
+
+    int delta = 0;
+    for (int start = 0; start < lines;) {
+        const int end = blockEnd(lineProperties, lines, start);
+        const int count = (end - start + 1) * columns;
+        const Character *block = image + start * columns;
+        const uint hash = textHash(block, count);
+        blocks.insert(hash, start);
+
+        // checks that the block of the previous image starting at 'oldStart'
+        // has the same text as this one and did not move elsewhere already
+        auto sameBlock = [&](int oldStart) {
+            return oldStart >= 0 && oldStart < _lines && !reused.at(oldStart)
+                   && (oldStart == 0 || (_lineProperties.value(oldStart - 1, LINE_DEFAULT) & LINE_WRAPPED) == 0)
+                   && blockEnd(_lineProperties, _lines, oldStart) - oldStart == end - start
+                   && std::equal(block, block + count, _image.constData() + oldStart * columns, sameText);
+        };
+
+        // look for the same block of lines in the previous image, first
+        // where it is if it scrolled as far as the previous block did
+        int oldStart = -1;
+        if (!processAll) {
+            if (sameBlock(start + delta)) {
+                oldStart = start + delta;
+            } else {
+                QMultiHash<uint, int>::const_iterator iter = _blocks.constFind(hash);
+                for (; iter != _blocks.constEnd() && iter.key() == hash; ++iter) {
+                    if (sameBlock(iter.value())) {
+                        oldStart = iter.value();
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (oldStart != -1) {
+            delta = oldStart - start;
+            reused[oldStart] = true;
+            for (int line = start; line <= end; line++) {
+                lineMap[line + delta] = line;
+                changed[line] = false;
+            }
+        }
+
+        start = end + 1;
+    }
+
+    QListIterator<Filter *> iter(*this);
+    while (iter.hasNext()) {
+        Filter *filter = iter.next();
+        if (processAll) {
+            filter->reset();
+        } else {
+            filter->moveHotSpots(lineMap);
+        }
+    }
+
+    _image.resize(lines * columns);
+    std::copy(image, image + lines * columns, _image.begin());
+    _lineProperties = lineProperties;
+    _lines = lines;
+    _columns = columns;
+    _blocks = blocks;
+    _filters = *this;
 
     PlainTextDecoder decoder;
     decoder.setLeadingWhitespace(true);
@@ -160,8 +299,15 @@ void TerminalImageFilterChain::setImage(const Character * const image, int lines
     QTextStream lineStream(_buffer);
     decoder.begin(&lineStream);
 
+    // the buffer only holds the text of the lines which changed.  The other
+    // lines are empty in it, so the filters find nothing new on them but
+    // still get the right line numbers
     for (int i = 0; i < lines; i++) {
         _linePositions->append(_buffer->length());
+        if (!changed.at(i)) {
+            continue;
+        }
+
         decoder.decodeLine(image + i * columns, columns, LINE_DEFAULT);
 
         // pretend that each line ends with a newline character.
@@ -174,7 +320,7 @@ void TerminalImageFilterChain::setImage(const Character * const image, int lines
         // TODO - Use the "line wrapped" attribute associated with lines in a
         // terminal image to avoid adding this imaginary character for wrapped
         // lines
-        if ((lineProperties.value(i, LINE_DEFAULT) & LINE_WRAPPED) == 0) {
+        if ((lineProperties.value(i, LINE_DEFAULT) & LINE_WRAPPED) == 0 || i == lines - 1) {
             lineStream << QLatin1Char('\n');
         }
     }
@@ -182,10 +328,12 @@ void TerminalImageFilterChain::setImage(const Character * const image, int lines
 }
 
 Filter::Filter() :
-    _hotspots(QMultiHash<int, HotSpot *>()),
+    _lineHotSpots(QVector<QVector<HotSpot *> >()),
     _hotspotList(QList<HotSpot *>()),
     _linePositions(nullptr),
-    _buffer(nullptr)
+    _buffer(nullptr),
+    _columnsLine(-1),
+    _columns(QVector<int>())
 {
 }
 
@@ -199,14 +347,47 @@ Filter::~Filter()
 
 void Filter::reset()
 {
-    _hotspots.clear();
+    qDeleteAll(_hotspotList);
+    _lineHotSpots.clear();
     _hotspotList.clear();
 }
 
+void Filter::moveHotSpots(const QVector<int> &lineMap)
+{
+    _lineHotSpots.clear();
+
+    QMutableListIterator<HotSpot *> iter(_hotspotList);
+    while (iter.hasNext()) {
+        HotSpot *spot = iter.next();
+
+        // the lines of a hotspot are in one block of wrapped lines, which
+        // either moved as a whole or changed
+        const int line = lineMap.value(spot->startLine(), -1);
+        if (line == -1) {
+            iter.remove();
+            delete spot;
+            continue;
+        }
+
+        const int delta = line - spot->startLine();
+        spot->_startLine += delta;
+        spot->_endLine += delta;
+        addLineHotSpot(spot);
+    }
+
+    std::stable_sort(_hotspotList.begin(), _hotspotList.end(), hotSpotLessThan);
+}
+
+bool Filter::isOutdated() const
+{
+    return false;
+}
+
 void Filter::setBuffer(const QString *buffer, const QList<int> *linePositions)
 {
     _buffer = buffer;
     _linePositions = linePositions;
+    _columnsLine = -1;
 }
 
 void Filter::getLineColumn(int position, int &startLine, int &startColumn)
@@ -214,22 +395,39 @@ void Filter::getLineColumn(int position, int &startLine, int &startColumn)
     Q_ASSERT(_linePositions);
     Q_ASSERT(_buffer);
 
-    for (int i = 0; i < _linePositions->count(); i++) {
-        int nextLine = 0;
-
-        if (i == _linePositions->count() - 1) {
-            nextLine = _buffer->length() + 1;
-        } else {
-            nextLine = _linePositions->value(i + 1);
-        }
+    // the last line starting at or before the position.  Lines with no
+    // text in the buffer start where the next one does
+    const QList<int>::const_iterator next = std::upper_bound(_linePositions->constBegin(),
+                                                             _linePositions->constEnd(), position);
+    if (next == _linePositions->constBegin()) {
+        return;
+    }
 
-        if (_linePositions->value(i) <= position && position < nextLine) {
-            startLine = i;
-            startColumn = string_width(buffer()->mid(_linePositions->value(i),
-                                                     position - _linePositions->value(i)));
-            return;
+    const int line = next - _linePositions->constBegin() - 1;
+    const int lineStart = _linePositions->at(line);
+    if (line != _columnsLine) {
+        // the column of each position of the line, computed once for all
+        // the matches on it
+        const int lineEnd = next != _linePositions->constEnd() ? *next : _buffer->length();
+        _columnsLine = line;
+        _columns.resize(lineEnd - lineStart + 1);
+        _columns[0] = 0;
+
+        const QChar *text = _buffer->constData();
+        for (int i = lineStart; i < lineEnd; i++) {
+            const int column = _columns.at(i - lineStart);
+            if (text[i].isHighSurrogate() && i + 1 < lineEnd && text[i + 1].isLowSurrogate()) {
+                _columns[i - lineStart + 1] = column;
+                _columns[i - lineStart + 2] = column + konsole_wcwidth(QChar::surrogateToUcs4(text[i], text[i + 1]));
+                i++;
+            } else {
+                _columns[i - lineStart + 1] = column + konsole_wcwidth(text[i].unicode());
+            }
         }
     }
+
+    startLine = line;
+    startColumn = _columns.at(qMin(position - lineStart, _columns.count() - 1));
 }
 
 const QString *Filter::buffer()
@@ -241,10 +439,24 @@ Filter::HotSpot::~HotSpot() = default;
 
 void Filter::addHotSpot(HotSpot *spot)
 {
-    _hotspotList << spot;
+    _hotspotList.insert(std::upper_bound(_hotspotList.begin(), _hotspotList.end(), spot, hotSpotLessThan), spot);
+    addLineHotSpot(spot);
+}
+
+void Filter::addLineHotSpot(HotSpot *spot)
+{
+    if (_lineHotSpots.count() <= spot->endLine()) {
+        _lineHotSpots.resize(spot->endLine() + 1);
+    }
 
     for (int line = spot->startLine(); line <= spot->endLine(); line++) {
-        _hotspots.insert(line, spot);
+        QVector<HotSpot *> &spots = _lineHotSpots[line];
+        const int column = startColumnAt(spot, line);
+        QVector<HotSpot *>::iterator iter = std::upper_bound(spots.begin(), spots.end(), column,
+                                                             [line](int column, const HotSpot *other) {
+            return column < startColumnAt(other, line);
+        });
+        spots.insert(iter, spot);
     }
 }
 
@@ -255,25 +467,31 @@ QList<Filter::HotSpot *> Filter::hotSpots() const
 
 QList<Filter::HotSpot *> Filter::hotSpotsAtLine(int line) const
 {
-    return _hotspots.values(line);
+    return _lineHotSpots.value(line).toList();
 }
 
 Filter::HotSpot *Filter::hotSpotAt(int line, int column) const
 {
-    QList<HotSpot *> hotspots = _hotspots.values(line);
-
-    foreach (HotSpot *spot, hotspots) {
-        if (spot->startLine() == line && spot->startColumn() > column) {
-            continue;
-        }
-        if (spot->endLine() == line && spot->endColumn() < column) {
-            continue;
-        }
+    if (line < 0 || line >= _lineHotSpots.count()) {
+        return nullptr;
+    }
 
-        return spot;
+    // the matches of a filter do not overlap, so the hotspots of a line
+    // are ordered by their last column as well.  Where one hotspot ends at
+    // the column the next one starts, the next one is the one at it
+    const QVector<HotSpot *> &spots = _lineHotSpots.at(line);
+    QVector<HotSpot *>::const_iterator iter = std::lower_bound(spots.constBegin(), spots.constEnd(), column,
+                                                               [line](const HotSpot *spot, int column) {
+        return endColumnAt(spot, line) < column;
+    });
+    if (iter == spots.constEnd() || startColumnAt(*iter, line) > column) {
+        return nullptr;
+    }
+    if (iter + 1 != spots.constEnd() && startColumnAt(*(iter + 1), line) <= column) {
+        ++iter;
     }
 
-    return nullptr;
+    return *iter;
 }
 
 Filter::HotSpot::HotSpot(int startLine, int startColumn, int endLine, int endColumn) :
@@ -321,7 +539,8 @@ void Filter::HotSpot::setType(Type type)
 }
 
 RegExpFilter::RegExpFilter() :
-    _searchText(QRegularExpression())
+    _searchText(QRegularExpression()),
+    _literals(QStringList())
 {
 }
 
@@ -353,6 +572,11 @@ QRegularExpression RegExpFilter::regExp() const
     return _searchText;
 }
 
+void RegExpFilter::setLiterals(const QStringList &literals)
+{
+    _literals = literals;
+}
+
 void RegExpFilter::process()
 {
     const QString *text = buffer();
@@ -363,7 +587,35 @@ void RegExpFilter::process()
         return;
     }
 
-    QRegularExpressionMatchIterator iterator(_searchText.globalMatch(*text));
+    if (_literals.isEmpty()) {
+        processText(*text, 0);
+        return;
+    }
+
+    // looking for the literals is much cheaper than matching the regular
+    // expression, which most lines do not contain any match of
+    int start = 0;
+    while (start < text->length()) {
+        int end = text->indexOf(QLatin1Char('\n'), start);
+        if (end == -1) {
+            end = text->length();
+        }
+
+        const QString line = QString::fromRawData(text->constData() + start, end - start);
+        foreach (const QString &literal, _literals) {
+            if (line.contains(literal)) {
+                processText(line, start);
+                break;
+            }
+        }
+
+        start = end + 1;
+    }
+}
+
+void RegExpFilter::processText(const QString &text, int position)
+{
+    QRegularExpressionMatchIterator iterator(_searchText.globalMatch(text));
     while (iterator.hasNext()) {
         QRegularExpressionMatch match(iterator.next());
 
@@ -372,8 +624,8 @@ void RegExpFilter::process()
         int startColumn = 0;
         int endColumn = 0;
 
-        getLineColumn(match.capturedStart(), startLine, startColumn);
-        getLineColumn(match.capturedEnd(), endLine, endColumn);
+        getLineColumn(position + match.capturedStart(), startLine, startColumn);
+        getLineColumn(position + match.capturedEnd(), endLine, endColumn);
 
         RegExpFilter::HotSpot *spot = newHotSpot(startLine, startColumn,
                                                  endLine, endColumn, match.capturedTexts());
@@ -471,6 +723,7 @@ const QRegularExpression UrlFilter::CompleteUrlRegExp(QLatin1Char('(') + FullUrl
 UrlFilter::UrlFilter()
 {
     setRegExp(CompleteUrlRegExp);
+    setLiterals(QStringList() << QStringLiteral("://") << QStringLiteral("www.") << QStringLiteral("@"));
 }
 
 UrlFilter::HotSpot::~HotSpot()
@@ -485,8 +738,8 @@ void FilterObject::activated()
 
 QList<QAction *> UrlFilter::HotSpot::actions()
 {
-    auto openAction = new QAction(_urlObject);
-    auto copyAction = new QAction(_urlObject);
+    auto openAction = new QAction(nullptr);
+    auto copyAction = new QAction(nullptr);
 
     const UrlType kind = urlType();
     Q_ASSERT(kind == StandardUrl || kind == Email);
@@ -547,13 +800,31 @@ RegExpFilter::HotSpot *FileFilter::newHotSpot(int startLine, int startColumn, in
 
 void FileFilter::process()
 {
-    const QDir dir(_session->currentWorkingDirectory());
-    _dirPath = dir.canonicalPath() + QLatin1Char('/');
-    _currentFiles = dir.entryList(QDir::Files).toSet();
+    if (_session.isNull() || buffer()->isEmpty()) {
+        return;
+    }
+
+    // the directory is listed away from the GUI thread, the hotspots
+    // are looked for again once it was
+    FileListCache *cache = FileListCache::instance();
+    _path = _session->currentWorkingDirectory();
+    _currentFiles = cache->files(_path, _dirPath);
+    _dirPath += QLatin1Char('/');
+    _revision = cache->revision(_path);
+
+    // only the names of these files are hotspots
+    if (_currentFiles.isEmpty()) {
+        return;
+    }
 
     RegExpFilter::process();
 }
 
+bool FileFilter::isOutdated() const
+{
+    return !_path.isEmpty() && FileListCache::instance()->revision(_path) != _revision;
+}
+
 FileFilter::HotSpot::HotSpot(int startLine, int startColumn, int endLine, int endColumn,
                              const QStringList &capturedTexts, const QString &filePath) :
     RegExpFilter::HotSpot(startLine, startColumn, endLine, endColumn, capturedTexts),
@@ -601,10 +872,32 @@ static QString createFileRegex(const QStringList &patterns, const QString &fileP
     );
 }
 
+// every file name matched by the regular expression of createFileRegex()
+// contains one of these: the first character of a known suffix, a known
+// prefix or a known full name
+static QStringList createFileLiterals(const QStringList &patterns, const QString &filePattern)
+{
+    const QStringList suffixes = patterns.filter(QRegularExpression(QStringLiteral("^\\*") + filePattern + QStringLiteral("$")));
+    QStringList prefixes = patterns.filter(QRegularExpression(QStringLiteral("^") + filePattern + QStringLiteral("+\\*$")));
+    const QStringList fullNames = patterns.filter(QRegularExpression(QStringLiteral("^") + filePattern + QStringLiteral("$")));
+
+    QStringList literals;
+    foreach (const QString &suffix, suffixes) {
+        literals << suffix.mid(1, 1);
+    }
+    prefixes.replaceInStrings(QStringLiteral("*"), QString());
+    literals << prefixes << fullNames;
+    literals.removeDuplicates();
+
+    return literals;
+}
+
 FileFilter::FileFilter(Session *session) :
     _session(session)
+    , _path(QString())
     , _dirPath(QString())
     , _currentFiles(QSet<QString>())
+    , _revision(0)
 {
     QStringList patterns;
     QMimeDatabase mimeDatabase;
@@ -617,13 +910,15 @@ FileFilter::FileFilter(Session *session) :
 
     QString validFilename(QStringLiteral("[A-Za-z0-9\\._\\-]+"));
     QString pathRegex(QStringLiteral("([A-Za-z0-9\\._\\-/]+/)"));
-    QString noSpaceRegex = QLatin1String("\\b") + createFileRegex(patterns, validFilename, pathRegex) + QLatin1String("\\b");
+    const QString fileRegex = createFileRegex(patterns, validFilename, pathRegex);
+    QString noSpaceRegex = QLatin1String("\\b") + fileRegex + QLatin1String("\\b");
 
-    QString spaceRegex = QLatin1String("'") + createFileRegex(patterns, validFilename, pathRegex) + QLatin1String("'");
+    QString spaceRegex = QLatin1String("'") + fileRegex + QLatin1String("'");
 
     QString regex = QLatin1String("(") + noSpaceRegex + QLatin1String(")|(") + spaceRegex + QLatin1String(")");
 
     setRegExp(QRegularExpression(regex, QRegularExpression::DontCaptureOption));
+    setLiterals(createFileLiterals(patterns, validFilename));
 }
 
 FileFilter::HotSpot::~HotSpot()
@@ -633,7 +928,7 @@ FileFilter::HotSpot::~HotSpot()
 
 QList<QAction *> FileFilter::HotSpot::actions()
 {
-    auto openAction = new QAction(_fileObject);
+    auto openAction = new QAction(nullptr);
     openAction->setText(i18n("Open File"));
     QObject::connect(openAction, &QAction::triggered, _fileObject,
                      &Konsole::FilterObject::activated);
@@ -28,9 +28,11 @@
 #include <QStringList>
 #include <QRegularExpression>
 #include <QMultiHash>
+#include <QVector>
 
 // Konsole
 #include "Character.h"
+#include "konsoleprivate_export.h"
 
 class QAction;
 
@@ -55,7 +57,7 @@ class Session;
  * When processing the text they should create instances of Filter::HotSpot subclasses for sections of interest
  * and add them to the filter's list of hotspots using addHotSpot()
  */
-class Filter
+class KONSOLEPRIVATE_EXPORT Filter
 {
 public:
     /**
@@ -114,6 +116,10 @@ public:
         /**
          * Returns a list of actions associated with the hotspot which can be used in a
          * menu or toolbar
+         *
+         * The caller owns the actions and deletes them when they are no longer
+         * needed.  They may outlive the hotspot, which is deleted when the
+         * filter is processed again; triggering them then does nothing.
          */
         virtual QList<QAction *> actions();
 
@@ -122,6 +128,8 @@ public:
         void setType(Type type);
 
     private:
+        friend class Filter;
+
         int _startLine;
         int _startColumn;
         int _endLine;
@@ -142,10 +150,28 @@ public:
      */
     void reset();
 
+    /**
+     * Keeps the hotspots on the lines of text which did not change since
+     * they were found, moving them to where these lines are now, and deletes
+     * the others.  The text of the lines which did change can then be
+     * processed again.
+     *
+     * @param lineMap The new line of each previous line of text, or -1 if
+     * it changed
+     */
+    void moveHotSpots(const QVector<int> &lineMap);
+
+    /**
+     * Returns true if the hotspots found before may be wrong on lines
+     * whose text did not change, so that all of the text has to be
+     * processed again.  The default implementation returns false.
+     */
+    virtual bool isOutdated() const;
+
     /** Returns the hotspot which covers the given @p line and @p column, or 0 if no hotspot covers that area */
     HotSpot *hotSpotAt(int line, int column) const;
 
-    /** Returns the list of hotspots identified by the filter */
+    /** Returns the list of hotspots identified by the filter, in the order of the text */
     QList<HotSpot *> hotSpots() const;
 
     /** Returns the list of hotspots identified by the filter which occur on a given line */
@@ -157,7 +183,7 @@ public:
     void setBuffer(const QString *buffer, const QList<int> *linePositions);
 
 protected:
-    /** Adds a new hotspot to the list */
+    /** Adds a new hotspot to the list, keeping it in the order of the text */
     void addHotSpot(HotSpot *);
     /** Returns the internal buffer */
     const QString *buffer();
@@ -167,11 +193,19 @@ protected:
 private:
     Q_DISABLE_COPY(Filter)
 
-    QMultiHash<int, HotSpot *> _hotspots;
+    void addLineHotSpot(HotSpot *spot);
+
+    // the hotspots on each line, in the order of their columns
+    QVector<QVector<HotSpot *> > _lineHotSpots;
     QList<HotSpot *> _hotspotList;
 
     const QList<int> *_linePositions;
     const QString *_buffer;
+
+    // the column of each position of the line of the buffer which a
+    // position was last converted on
+    int _columnsLine;
+    QVector<int> _columns;
 };
 
 /**
@@ -181,7 +215,7 @@ private:
  * Subclasses can reimplement newHotSpot() to return custom hotspot types when matches for the regular expression
  * are found.
  */
-class RegExpFilter : public Filter
+class KONSOLEPRIVATE_EXPORT RegExpFilter : public Filter
 {
 public:
     /**
@@ -214,6 +248,15 @@ public:
     /** Returns the regular expression which the filter searches for in blocks of text */
     QRegularExpression regExp() const;
 
+    /**
+     * Sets strings one of which is part of each match of the regular
+     * expression.  The regular expression is then only matched on the lines
+     * of text which contain one of them, so matches cannot span lines.
+     *
+     * By default all of the text is searched.
+     */
+    void setLiterals(const QStringList &literals);
+
     /**
      * Reimplemented to search the filter's text buffer for text matching regExp()
      *
@@ -231,13 +274,16 @@ protected:
                                               int endColumn, const QStringList &capturedTexts);
 
 private:
+    void processText(const QString &text, int position);
+
     QRegularExpression _searchText;
+    QStringList _literals;
 };
 
 class FilterObject;
 
 /** A filter which matches URLs in blocks of text */
-class UrlFilter : public RegExpFilter
+class KONSOLEPRIVATE_EXPORT UrlFilter : public RegExpFilter
 {
 public:
     /**
@@ -314,15 +360,25 @@ public:
 
     explicit FileFilter(Session *session);
 
+    /**
+     * Reimplemented to look for the names of the files in the working
+     * directory of the session, as they are in the FileListCache
+     */
     void process() Q_DECL_OVERRIDE;
 
+    /** Reimplemented to return true when the files were listed again */
+    bool isOutdated() const Q_DECL_OVERRIDE;
+
 protected:
     RegExpFilter::HotSpot *newHotSpot(int, int, int, int, const QStringList &) Q_DECL_OVERRIDE;
 
 private:
     QPointer<Session> _session;
+    QString _path;
     QString _dirPath;
     QSet<QString> _currentFiles;
+    // the revision of the files in the cache when they were looked for
+    int _revision;
 };
 
 class FilterObject : public QObject
@@ -358,7 +414,7 @@ private:
  * The hotSpots() and hotSpotsAtLine() method return all of the hotspots in the text and on
  * a given line respectively.
  */
-class FilterChain : protected QList<Filter *>
+class KONSOLEPRIVATE_EXPORT FilterChain : protected QList<Filter *>
 {
 public:
     virtual ~FilterChain();
@@ -372,6 +428,9 @@ public:
 
     /** Resets each filter in the chain */
     void reset();
+
+    /** Returns true if some filter of the chain is outdated */
+    bool isOutdated() const;
     /**
      * Processes each filter in the chain
      */
@@ -388,8 +447,14 @@ public:
     QList<Filter::HotSpot> hotSpotsAtLine(int line) const;
 };
 
-/** A filter chain which processes character images from terminal displays */
-class TerminalImageFilterChain : public FilterChain
+/**
+ * A filter chain which processes character images from terminal displays.
+ *
+ * Only the text of the lines which changed since the previous image is
+ * given to the filters; the hotspots found on the other lines are kept and
+ * moved along with their lines when the image scrolls.
+ */
+class KONSOLEPRIVATE_EXPORT TerminalImageFilterChain : public FilterChain
 {
 public:
     TerminalImageFilterChain();
@@ -411,6 +476,16 @@ private:
 
     QString *_buffer;
     QList<int> *_linePositions;
+
+    // the text of the previous image, the first line of each of its blocks
+    // of wrapped lines by the hash of their text, and the filters which
+    // processed it
+    QVector<Character> _image;
+    QVector<LineProperty> _lineProperties;
+    int _lines;
+    int _columns;
+    QMultiHash<uint, int> _blocks;
+    QList<Filter *> _filters;
 };
 }
 #endif //FILTER_H
@@ -0,0 +1,174 @@
+/*
+    Copyright 2018 by The Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "GlyphCache.h"
+
+// Konsole
+#include "konsole_wcwidth.h"
+
+using namespace Konsole;
+
+// marks the characters of the Latin-1 table which were not looked up yet
+static const quint32 UNKNOWN_GLYPH = 0xffffffff;
+
+GlyphCache::Variant::Variant() :
+    loaded(false),
+    font(),
+    latin1Glyphs(),
+    glyphs()
+{
+}
+
+GlyphCache::GlyphCache() :
+    _font(),
+    _glyphIndexes(),
+    _positions(),
+    _cellWidth(0)
+{
+}
+
+void GlyphCache::setFont(const QFont &font)
+{
+    if (font == _font) {
+        return;
+    }
+
+    _font = font;
+    for (int i = 0; i < 4; i++) {
+        _variants[i] = Variant();
+    }
+}
+
+bool GlyphCache::glyphRun(const QString &text, bool bold, bool italic, int cellWidth, QGlyphRun &run)
+{
+    Variant &variant = _variants[(bold ? 1 : 0) | (italic ? 2 : 0)];
+    if (!variant.loaded) {
+        loadVariant(variant, bold, italic);
+    }
+    if (!variant.font.isValid()) {
+        return false;
+    }
+
+    const int length = text.length();
+    if (_glyphIndexes.size() < length) {
+        _glyphIndexes.resize(length);
+    }
+    for (int i = 0; i < length; i++) {
+        const quint32 index = glyph(variant, text.at(i).unicode());
+        if (index == 0) {
+            return false;
+        }
+        _glyphIndexes[i] = index;
+    }
+
+    if (cellWidth != _cellWidth) {
+        _cellWidth = cellWidth;
+        _positions.clear();
+    }
+    for (int i = _positions.size(); i < length; i++) {
+        _positions.append(QPointF(i * cellWidth, 0));
+    }
+
+    run.setRawFont(variant.font);
+    run.setRawData(_glyphIndexes.constData(), _positions.constData(), length);
+    return true;
+}
+
+void GlyphCache::loadVariant(Variant &variant, bool bold, bool italic) const
+{
+    QFont font(_font);
+    font.setBold(bold);
+    font.setItalic(italic);
+
+    variant.loaded = true;
+    variant.font = QRawFont::fromFont(font);
+    variant.latin1Glyphs.fill(UNKNOWN_GLYPH, 256);
+}
+
+quint32 GlyphCache::glyph(Variant &variant, ushort character) const
+{
+    if (character < 256 && variant.latin1Glyphs.at(character) != UNKNOWN_GLYPH) {
+        return variant.latin1Glyphs.at(character);
+    }
+
+    if (character >= 256) {
+        QHash<ushort, quint32>::const_iterator iter = variant.glyphs.constFind(character);
+        if (iter != variant.glyphs.constEnd()) {
+            return iter.value();
+        }
+    }
+
+    quint32 index = 0;
+    if (isSimpleCharacter(character)) {
+        const QChar qchar(character);
+        int count = 1;
+        if (!variant.font.glyphIndexesForChars(&qchar, 1, &index, &count) || count != 1) {
+            index = 0;
+        }
+    }
+
+    if (character < 256) {
+        variant.latin1Glyphs[character] = index;
+    } else {
+        variant.glyphs.insert(character, index);
+    }
+    return index;
+}
+
+bool GlyphCache::isSimpleCharacter(ushort character)
+{
+    // characters which are drawn the same on their own as in a run of
+    // text, from left to right, in one column
+    if (QChar::isSurrogate(character) || konsole_wcwidth(character) != 1) {
+        return false;
+    }
+
+    switch (QChar::category(character)) {
+    case QChar::Mark_NonSpacing:
+    case QChar::Mark_SpacingCombining:
+    case QChar::Mark_Enclosing:
+    case QChar::Other_Control:
+    case QChar::Other_Format:
+        return false;
+    default:
+        break;
+    }
+
+    switch (QChar::script(character)) {
+    case QChar::Script_Common:
+    case QChar::Script_Latin:
+    case QChar::Script_Greek:
+    case QChar::Script_Cyrillic:
+        break;
+    default:
+        return false;
+    }
+
+    switch (QChar::direction(character)) {
+    case QChar::DirR:
+    case QChar::DirAL:
+    case QChar::DirRLE:
+    case QChar::DirRLO:
+    case QChar::DirRLI:
+        return false;
+    default:
+        return true;
+    }
+}
@@ -0,0 +1,92 @@
+/*
+    Copyright 2018 by The Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef GLYPHCACHE_H
+#define GLYPHCACHE_H
+
+// Qt
+#include <QFont>
+#include <QGlyphRun>
+#include <QHash>
+#include <QPointF>
+#include <QRawFont>
+#include <QVector>
+
+// Konsole
+#include "konsoleprivate_export.h"
+
+namespace Konsole {
+/**
+ * Caches the glyphs of the terminal font so that text made of simple
+ * characters can be drawn without shaping it each time it is painted.
+ *
+ * Each character is looked up once per font variant (bold, italic) and the
+ * glyph found for it is kept.  Characters which need shaping (combining
+ * marks, complex or right-to-left scripts), which are not one column wide or
+ * which are missing from the font are remembered as such; text containing
+ * them has to be drawn with QPainter::drawText() so that Qt shapes it and
+ * falls back to other fonts.
+ */
+class KONSOLEPRIVATE_EXPORT GlyphCache
+{
+public:
+    GlyphCache();
+
+    /** Sets the font to draw text with, clearing the cache if it changed */
+    void setFont(const QFont &font);
+
+    /**
+     * Sets @p run to the glyphs of @p text, one per cell of @p cellWidth
+     * pixels, with the baseline of the first cell at the origin.  The
+     * underline, strike out and overline flags of @p run are not changed.
+     *
+     * Returns false if some of the characters of @p text cannot be drawn
+     * from the cache.  The glyphs of @p run are only valid until the next
+     * call.
+     */
+    bool glyphRun(const QString &text, bool bold, bool italic, int cellWidth, QGlyphRun &run);
+
+private:
+    // the glyphs of one style of the font.  A glyph of 0 means the
+    // character has to be drawn with QPainter::drawText()
+    struct Variant
+    {
+        Variant();
+
+        bool loaded;
+        QRawFont font;
+        QVector<quint32> latin1Glyphs;
+        QHash<ushort, quint32> glyphs;
+    };
+
+    void loadVariant(Variant &variant, bool bold, bool italic) const;
+    quint32 glyph(Variant &variant, ushort character) const;
+    static bool isSimpleCharacter(ushort character);
+
+    QFont _font;
+    Variant _variants[4];
+
+    // the buffers handed out with the glyph runs
+    QVector<quint32> _glyphIndexes;
+    QVector<QPointF> _positions;
+    int _cellWidth;
+};
+}
+
+#endif // GLYPHCACHE_H
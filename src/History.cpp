@@ -25,6 +25,7 @@
 #include "KonsoleSettings.h"
 
 // System
+#include <algorithm>
 #include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -62,9 +63,14 @@ Q_GLOBAL_STATIC(QString, historyFileLocation)
 // History File ///////////////////////////////////////////
 HistoryFile::HistoryFile() :
     _length(0),
-    _fileMap(nullptr),
-    _readWriteBalance(0)
+    _flushedLength(0),
+    _writeBuffer(),
+    _segments(),
+    _mapFailed(false)
 {
+    // keep the capacity when the buffer is emptied by flush()
+    _writeBuffer.reserve(WRITE_BUFFER_SIZE);
+
     // Determine the temp directory once
     // This class is called 3 times for each "unlimited" scrollback.
     // This has the down-side that users must restart to
@@ -121,69 +127,92 @@ HistoryFile::HistoryFile() :
 
 HistoryFile::~HistoryFile()
 {
-    if (_fileMap != nullptr) {
-        unmap();
+    unmap();
+}
+
+void HistoryFile::flush()
+{
+    if (_writeBuffer.isEmpty()) {
+        return;
     }
+
+    qint64 rc = 0;
+
+    if (!_tmpFile.seek(_flushedLength)) {
+        perror("HistoryFile::flush.seek");
+        return;
+    }
+    rc = _tmpFile.write(_writeBuffer.constData(), _writeBuffer.size());
+    if (rc < 0 || !_tmpFile.flush()) {
+        // keep the data buffered, it can still be read and the write
+        // is retried by the next flush
+        perror("HistoryFile::flush.write");
+        return;
+    }
+    _flushedLength += rc;
+    _writeBuffer.remove(0, rc);
 }
 
-//TODO:  Mapping the entire file in will cause problems if the history file becomes exceedingly large,
-//(ie. larger than available memory).  HistoryFile::map() should only map in sections of the file at a time,
-//to avoid this.
-void HistoryFile::map()
+const uchar *HistoryFile::segment(qint64 index)
 {
-    Q_ASSERT(_fileMap == nullptr);
+    for (int i = 0; i < _segments.size(); i++) {
+        if (_segments.at(i).index == index) {
+            if (i != 0) {
+                _segments.move(i, 0);
+            }
+            return _segments.first().data;
+        }
+    }
 
-    if (_tmpFile.flush()) {
-        Q_ASSERT(_tmpFile.size() >= _length);
-        _fileMap = _tmpFile.map(0, _length);
+    if (_mapFailed) {
+        return nullptr;
     }
 
+    if (_segments.size() >= MAX_MAPPED_SEGMENTS) {
+        munmap(_segments.last().data, SEGMENT_SIZE);
+        _segments.removeLast();
+    }
+
+    // Map the whole window even if the file does not extend that far yet.
+    // The pages past the end of the file are never touched, and once more
+    // history is written they become readable through the same mapping.
+    void *data = mmap(nullptr, SEGMENT_SIZE, PROT_READ, MAP_SHARED, _tmpFile.handle(), index * SEGMENT_SIZE);
+
     //if mmap'ing fails, fall back to the read-lseek combination
-    if (_fileMap == nullptr) {
-        _readWriteBalance = 0;
+    if (data == MAP_FAILED) {
+        _mapFailed = true;
         qCDebug(KonsoleDebug) << "mmap'ing history failed.  errno = " << errno;
+        return nullptr;
     }
+
+    MappedSegment mapped;
+    mapped.index = index;
+    mapped.data = static_cast<uchar *>(data);
+    _segments.prepend(mapped);
+    return mapped.data;
 }
 
 void HistoryFile::unmap()
 {
-    Q_ASSERT(_fileMap != nullptr);
-
-    if (_tmpFile.unmap(_fileMap)) {
-        _fileMap = nullptr;
+    foreach (const MappedSegment &mapped, _segments) {
+        munmap(mapped.data, SEGMENT_SIZE);
     }
-
-    Q_ASSERT(_fileMap == nullptr);
-
+    _segments.clear();
 }
 
 bool HistoryFile::isMapped() const
 {
-    return _fileMap != nullptr;
+    return !_segments.isEmpty();
 }
 
 void HistoryFile::add(const char *buffer, qint64 count)
 {
-    if (_fileMap != nullptr) {
-        unmap();
-    }
+    _writeBuffer.append(buffer, count);
+    _length += count;
 
-    if (_readWriteBalance < INT_MAX) {
-        _readWriteBalance++;
+    if (_writeBuffer.size() >= WRITE_BUFFER_SIZE) {
+        flush();
     }
-
-    qint64 rc = 0;
-
-    if (!_tmpFile.seek(_length)) {
-        perror("HistoryFile::add.seek");
-        return;
-    }
-    rc = _tmpFile.write(buffer, count);
-    if (rc < 0) {
-        perror("HistoryFile::add.write");
-        return;
-    }
-    _length += rc;
 }
 
 void HistoryFile::get(char *buffer, qint64 size, qint64 loc)
@@ -194,31 +223,45 @@ void HistoryFile::get(char *buffer, qint64 size, qint64 loc)
         return;
     }
 
-    //count number of get() calls vs. number of add() calls.
-    //If there are many more get() calls compared with add()
-    //calls (decided by using MAP_THRESHOLD) then mmap the log
-    //file to improve performance.
-    if (_readWriteBalance > INT_MIN) {
-        _readWriteBalance--;
-    }
-    if ((_fileMap == nullptr) && _readWriteBalance < MAP_THRESHOLD) {
-        map();
+    //serve the part which has not been written to the file yet from the buffer
+    if (loc + size > _flushedLength) {
+        const qint64 bufferStart = qMax(loc, _flushedLength);
+        memcpy(buffer + (bufferStart - loc),
+               _writeBuffer.constData() + (bufferStart - _flushedLength),
+               loc + size - bufferStart);
+        size = bufferStart - loc;
     }
 
-    if (_fileMap != nullptr) {
-        memcpy(buffer, _fileMap + loc, size);
-    } else {
-        qint64 rc = 0;
+    while (size > 0) {
+        const qint64 index = loc / SEGMENT_SIZE;
+        const qint64 offset = loc % SEGMENT_SIZE;
+        const qint64 count = qMin(size, SEGMENT_SIZE - offset);
 
-        if (!_tmpFile.seek(loc)) {
-            perror("HistoryFile::get.seek");
-            return;
-        }
-        rc = _tmpFile.read(buffer, size);
-        if (rc < 0) {
-            perror("HistoryFile::get.read");
+        const uchar *data = segment(index);
+        if (data == nullptr) {
+            read(buffer, size, loc);
             return;
         }
+        memcpy(buffer, data + offset, count);
+
+        buffer += count;
+        loc += count;
+        size -= count;
+    }
+}
+
+void HistoryFile::read(char *buffer, qint64 size, qint64 loc)
+{
+    qint64 rc = 0;
+
+    if (!_tmpFile.seek(loc)) {
+        perror("HistoryFile::get.seek");
+        return;
+    }
+    rc = _tmpFile.read(buffer, size);
+    if (rc < 0) {
+        perror("HistoryFile::get.read");
+        return;
     }
 }
 
@@ -316,6 +359,13 @@ void HistoryScrollFile::addLine(bool previousWrapped)
     _lineflags.add(reinterpret_cast<char *>(&flags), sizeof(char));
 }
 
+void HistoryScrollFile::flush()
+{
+    _cells.flush();
+    _index.flush();
+    _lineflags.flush();
+}
+
 // History Scroll None //////////////////////////////////////
 
 HistoryScrollNone::HistoryScrollNone() :
@@ -384,7 +434,12 @@ void *CompactHistoryBlockList::allocate(size_t size)
 {
     CompactHistoryBlock *block;
     if (list.isEmpty() || list.last()->remaining() < size) {
-        block = new CompactHistoryBlock();
+        if (_spareBlock != nullptr) {
+            block = _spareBlock;
+            _spareBlock = nullptr;
+        } else {
+            block = new CompactHistoryBlock();
+        }
         list.append(block);
         ////qDebug() << "new block created, remaining " << block->remaining() << "number of blocks=" << list.size();
     } else {
@@ -398,21 +453,29 @@ void CompactHistoryBlockList::deallocate(void *ptr)
 {
     Q_ASSERT(!list.isEmpty());
 
+    // Lines are evicted in the order in which they were added, so the
+    // pointer is almost always found in the first block.
     int i = 0;
-    CompactHistoryBlock *block = list.at(i);
-    while (i < list.size() && !block->contains(ptr)) {
+    while (i < list.size() && !list.at(i)->contains(ptr)) {
         i++;
-        block = list.at(i);
     }
 
     Q_ASSERT(i < list.size());
+    if (i == list.size()) {
+        return;
+    }
 
+    CompactHistoryBlock *block = list.at(i);
     block->deallocate();
 
     if (!block->isInUse()) {
         list.removeAt(i);
-        delete block;
-        ////qDebug() << "block deleted, new size = " << list.size();
+        // keep the block around for reuse, this avoids a munmap()/mmap()
+        // pair every time a block worth of lines scrolls out of the history
+        block->reset();
+        delete _spareBlock;
+        _spareBlock = block;
+        ////qDebug() << "block recycled, new size = " << list.size();
     }
 }
 
@@ -420,6 +483,7 @@ CompactHistoryBlockList::~CompactHistoryBlockList()
 {
     qDeleteAll(list.begin(), list.end());
     list.clear();
+    delete _spareBlock;
 }
 
 void *CompactHistoryLine::operator new(size_t size, CompactHistoryBlockList &blockList)
@@ -523,7 +587,9 @@ void CompactHistoryLine::getCharacters(Character *array, int size, int startColu
 CompactHistoryScroll::CompactHistoryScroll(unsigned int maxLineCount) :
     HistoryScroll(new CompactHistoryType(maxLineCount)),
     _lines(),
-    _blockList()
+    _firstLine(0),
+    _blockList(),
+    _maxLineCount(0)
 {
     ////qDebug() << "scroll of length " << maxLineCount << " created";
     setMaxNbLines(maxLineCount);
@@ -537,25 +603,38 @@ CompactHistoryScroll::~CompactHistoryScroll()
 
 void CompactHistoryScroll::addCellsVector(const TextLine &cells)
 {
+    if (_maxLineCount == 0) {
+        return;
+    }
+
     CompactHistoryLine *line;
     line = new(_blockList) CompactHistoryLine(cells, _blockList);
 
-    if (_lines.size() > static_cast<int>(_maxLineCount)) {
-        delete _lines.takeAt(0);
+    if (_lines.size() < static_cast<int>(_maxLineCount)) {
+        // still growing; _firstLine stays at 0 until the index is full
+        _lines.append(line);
+    } else {
+        // full: the oldest line is replaced by the new one, which makes
+        // the slot after it the new oldest line
+        delete _lines[_firstLine];
+        _lines[_firstLine] = line;
+        _firstLine = (_firstLine + 1) % _lines.size();
     }
-    _lines.append(line);
 }
 
 void CompactHistoryScroll::addCells(const Character a[], int count)
 {
     TextLine newLine(count);
-    qCopy(a, a + count, newLine.begin());
+    std::copy(a, a + count, newLine.begin());
     addCellsVector(newLine);
 }
 
 void CompactHistoryScroll::addLine(bool previousWrapped)
 {
-    CompactHistoryLine *line = _lines.last();
+    if (_lines.isEmpty()) {
+        return;
+    }
+    CompactHistoryLine *line = lineAt(_lines.size() - 1);
     ////qDebug() << "last line at address " << line;
     line->setWrapped(previousWrapped);
 }
@@ -572,7 +651,7 @@ int CompactHistoryScroll::getLineLen(int lineNumber)
         //Q_ASSERT(lineNumber >= 0 && lineNumber < _lines.size());
         return 0;
     }
-    CompactHistoryLine *line = _lines[lineNumber];
+    CompactHistoryLine *line = lineAt(lineNumber);
     ////qDebug() << "request for line at address " << line;
     return line->getLength();
 }
@@ -583,7 +662,7 @@ void CompactHistoryScroll::getCells(int lineNumber, int startColumn, int count,
         return;
     }
     Q_ASSERT(lineNumber < _lines.size());
-    CompactHistoryLine *line = _lines[lineNumber];
+    CompactHistoryLine *line = lineAt(lineNumber);
     Q_ASSERT(startColumn >= 0);
     Q_ASSERT(static_cast<unsigned int>(startColumn) <= line->getLength() - count);
     line->getCharacters(buffer, count, startColumn);
@@ -591,24 +670,341 @@ void CompactHistoryScroll::getCells(int lineNumber, int startColumn, int count,
 
 void CompactHistoryScroll::setMaxNbLines(unsigned int lineCount)
 {
-    _maxLineCount = lineCount;
+    if (lineCount == _maxLineCount) {
+        return;
+    }
+
+    // drop the oldest lines which no longer fit, then rebuild the index
+    // in order so that the oldest remaining line is at position 0
+    const int lineTotal = _lines.size();
+    const int dropCount = qMax(0, lineTotal - static_cast<int>(lineCount));
+    for (int i = 0; i < dropCount; i++) {
+        delete lineAt(i);
+    }
 
-    while (_lines.size() > static_cast<int>(lineCount)) {
-        delete _lines.takeAt(0);
+    HistoryArray lines;
+    lines.reserve(qMin(lineTotal - dropCount, static_cast<int>(lineCount)));
+    for (int i = dropCount; i < lineTotal; i++) {
+        lines.append(lineAt(i));
     }
+
+    _lines.swap(lines);
+    _firstLine = 0;
+    _maxLineCount = lineCount;
     ////qDebug() << "set max lines to: " << _maxLineCount;
 }
 
 bool CompactHistoryScroll::isWrappedLine(int lineNumber)
 {
     Q_ASSERT(lineNumber < _lines.size());
-    return _lines[lineNumber]->isWrapped();
+    return lineAt(lineNumber)->isWrapped();
+}
+
+////////////////////////////////////////////////////////////////
+// Compressed History Scroll ///////////////////////////////////
+////////////////////////////////////////////////////////////////
+
+/*
+   Each line is stored as a record of
+
+     quint32 cell count
+     quint32 format run count
+     quint8  wrapped flag
+     runs    start column (quint32), rendition, foreground and
+             background color, isRealCharacter
+     text    the character values encoded as varints
+
+   An uncompressed block starts with the number of lines it holds,
+   followed by the offset of every line record (relative to the first
+   record), followed by the records themselves.
+*/
+
+namespace {
+const int LINE_HEADER_SIZE = 2 * sizeof(quint32) + sizeof(quint8);
+const int FORMAT_RUN_SIZE = sizeof(quint32) + sizeof(RenditionFlags)
+                            + 2 * sizeof(CharacterColor) + sizeof(quint8);
+
+template<typename T>
+void appendValue(QByteArray &out, const T &value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template<typename T>
+T readValue(const char *&in)
+{
+    T value;
+    memcpy(&value, in, sizeof(T));
+    in += sizeof(T);
+    return value;
+}
+
+// Character values are unicode code points or, for RE_EXTENDED_CHAR,
+// ExtendedCharTable hashes which use all 32 bits.  They are stored seven
+// bits per byte, least significant first, with the high bit of each byte
+// set when more bytes follow, so ASCII still takes a single byte.
+void appendVarint(QByteArray &out, quint32 c)
+{
+    while (c >= 0x80) {
+        out.append(static_cast<char>(0x80 | (c & 0x7F)));
+        c >>= 7;
+    }
+    out.append(static_cast<char>(c));
+}
+
+quint32 readVarint(const char *&in)
+{
+    quint32 c = 0;
+    int shift = 0;
+    uchar byte;
+    do {
+        byte = static_cast<uchar>(*in++);
+        c |= static_cast<quint32>(byte & 0x7F) << shift;
+        shift += 7;
+    } while ((byte & 0x80) != 0);
+    return c;
+}
+
+void appendLineRecord(QByteArray &out, const TextLine &line, bool wrapped)
+{
+    const int length = line.size();
+
+    int runCount = 0;
+    for (int i = 0; i < length; i++) {
+        if (i == 0 || !line[i].equalsFormat(line[i - 1])
+                || line[i].isRealCharacter != line[i - 1].isRealCharacter) {
+            runCount++;
+        }
+    }
+
+    appendValue<quint32>(out, length);
+    appendValue<quint32>(out, runCount);
+    appendValue<quint8>(out, wrapped ? 1 : 0);
+
+    for (int i = 0; i < length; i++) {
+        const Character &c = line[i];
+        if (i == 0 || !c.equalsFormat(line[i - 1])
+                || c.isRealCharacter != line[i - 1].isRealCharacter) {
+            appendValue<quint32>(out, i);
+            appendValue<RenditionFlags>(out, c.rendition);
+            appendValue<CharacterColor>(out, c.foregroundColor);
+            appendValue<CharacterColor>(out, c.backgroundColor);
+            appendValue<quint8>(out, c.isRealCharacter ? 1 : 0);
+        }
+    }
+
+    for (int i = 0; i < length; i++) {
+        appendVarint(out, line[i].character);
+    }
+}
+}
+
+CompressedHistoryScroll::CompressedHistoryScroll() :
+    HistoryScroll(new CompressedHistoryType()),
+    _blockFile(),
+    _blocks(),
+    _blockCache(),
+    _openRecords(),
+    _openOffsets(),
+    _openFirstLine(0),
+    _pendingLine()
+{
+}
+
+CompressedHistoryScroll::~CompressedHistoryScroll() = default;
+
+int CompressedHistoryScroll::getLines()
+{
+    return _openFirstLine + _openOffsets.size();
+}
+
+int CompressedHistoryScroll::getLineLen(int lineno)
+{
+    const char *record = lineRecord(lineno);
+    if (record == nullptr) {
+        return 0;
+    }
+    return readValue<quint32>(record);
+}
+
+bool CompressedHistoryScroll::isWrappedLine(int lineno)
+{
+    const char *record = lineRecord(lineno);
+    if (record == nullptr) {
+        return false;
+    }
+    return record[2 * sizeof(quint32)] != 0;
+}
+
+void CompressedHistoryScroll::getCells(int lineno, int colno, int count, Character res[])
+{
+    const char *record = lineRecord(lineno);
+    if (record == nullptr || count <= 0) {
+        return;
+    }
+
+    const int length = readValue<quint32>(record);
+    const int runCount = readValue<quint32>(record);
+    record += sizeof(quint8);
+    Q_ASSERT(colno >= 0 && colno + count <= length);
+    Q_UNUSED(length);
+
+    const char *runs = record;
+    const char *text = runs + runCount * FORMAT_RUN_SIZE;
+
+    // the format runs and the text are walked in step; the text has to
+    // be decoded from the start of the line since varints are variable length
+    Character format;
+    int nextRun = 0;
+    int nextRunStart = 0;
+    for (int i = 0; i < colno + count; i++) {
+        if (nextRun < runCount && i == nextRunStart) {
+            const char *run = runs + nextRun * FORMAT_RUN_SIZE;
+            readValue<quint32>(run);
+            format.rendition = readValue<RenditionFlags>(run);
+            format.foregroundColor = readValue<CharacterColor>(run);
+            format.backgroundColor = readValue<CharacterColor>(run);
+            format.isRealCharacter = readValue<quint8>(run) != 0;
+
+            nextRun++;
+            if (nextRun < runCount) {
+                const char *nextRunPos = runs + nextRun * FORMAT_RUN_SIZE;
+                nextRunStart = readValue<quint32>(nextRunPos);
+            }
+        }
+
+        format.character = readVarint(text);
+        if (i >= colno) {
+            res[i - colno] = format;
+        }
+    }
+}
+
+void CompressedHistoryScroll::addCells(const Character text[], int count)
+{
+    const int oldSize = _pendingLine.size();
+    _pendingLine.resize(oldSize + count);
+    std::copy(text, text + count, _pendingLine.begin() + oldSize);
+}
+
+void CompressedHistoryScroll::addLine(bool previousWrapped)
+{
+    _openOffsets.append(_openRecords.size());
+    appendLineRecord(_openRecords, _pendingLine, previousWrapped);
+    _pendingLine.resize(0);
+
+    if (_openRecords.size() >= BLOCK_SIZE) {
+        closeBlock();
+    }
+}
+
+void CompressedHistoryScroll::flush()
+{
+    _blockFile.flush();
+}
+
+void CompressedHistoryScroll::closeBlock()
+{
+    QByteArray data;
+    data.reserve(sizeof(quint32) * (_openOffsets.size() + 1) + _openRecords.size());
+    appendValue<quint32>(data, _openOffsets.size());
+    data.append(reinterpret_cast<const char *>(_openOffsets.constData()),
+                sizeof(quint32) * _openOffsets.size());
+    data.append(_openRecords);
+
+    // favour speed over ratio, this runs while output is being received
+    const QByteArray compressed = qCompress(data, 1);
+
+    Block block;
+    block.offset = _blockFile.len();
+    block.size = compressed.size();
+    block.firstLine = _openFirstLine;
+    _blockFile.add(compressed.constData(), compressed.size());
+    _blocks.append(block);
+
+    _openFirstLine += _openOffsets.size();
+    _openOffsets.resize(0);
+    _openRecords.resize(0);
+}
+
+const QByteArray &CompressedHistoryScroll::blockData(int index)
+{
+    for (int i = 0; i < _blockCache.size(); i++) {
+        if (_blockCache.at(i).first == index) {
+            if (i != 0) {
+                _blockCache.move(i, 0);
+            }
+            return _blockCache.first().second;
+        }
+    }
+
+    const Block &block = _blocks.at(index);
+    QByteArray compressed(block.size, Qt::Uninitialized);
+    _blockFile.get(compressed.data(), block.size, block.offset);
+
+    if (_blockCache.size() >= BLOCK_CACHE_SIZE) {
+        _blockCache.removeLast();
+    }
+    _blockCache.prepend(qMakePair(index, qUncompress(compressed)));
+    return _blockCache.first().second;
+}
+
+const char *CompressedHistoryScroll::lineRecord(int lineno)
+{
+    if (lineno < 0 || lineno >= getLines()) {
+        return nullptr;
+    }
+
+    if (lineno >= _openFirstLine) {
+        return _openRecords.constData() + _openOffsets.at(lineno - _openFirstLine);
+    }
+
+    // find the last block which starts at or before lineno
+    auto it = std::upper_bound(_blocks.constBegin(), _blocks.constEnd(), lineno,
+                               [](int line, const Block &block) {
+                                   return line < block.firstLine;
+                               });
+    Q_ASSERT(it != _blocks.constBegin());
+    const int index = (it - _blocks.constBegin()) - 1;
+
+    const QByteArray &data = blockData(index);
+    if (data.isEmpty()) {
+        qCDebug(KonsoleDebug) << "Unable to uncompress history block" << index;
+        return nullptr;
+    }
+
+    const char *offsets = data.constData();
+    const quint32 lineCount = readValue<quint32>(offsets);
+    const char *offsetPos = offsets + sizeof(quint32) * (lineno - _blocks.at(index).firstLine);
+    const quint32 offset = readValue<quint32>(offsetPos);
+    return offsets + sizeof(quint32) * lineCount + offset;
 }
 
 //////////////////////////////////////////////////////////////////////
 // History Types
 //////////////////////////////////////////////////////////////////////
 
+// copies all lines of 'from' (which may be null) to the end of 'to'
+static void copyHistory(HistoryScroll *from, HistoryScroll *to)
+{
+    Character line[LINE_SIZE];
+    int lines = (from != nullptr) ? from->getLines() : 0;
+    for (int i = 0; i < lines; i++) {
+        int size = from->getLineLen(i);
+        if (size > LINE_SIZE) {
+            auto tmp_line = new Character[size];
+            from->getCells(i, 0, size, tmp_line);
+            to->addCells(tmp_line, size);
+            to->addLine(from->isWrappedLine(i));
+            delete [] tmp_line;
+        } else {
+            from->getCells(i, 0, size, line);
+            to->addCells(line, size);
+            to->addLine(from->isWrappedLine(i));
+        }
+    }
+}
+
 HistoryType::HistoryType() = default;
 HistoryType::~HistoryType() = default;
 
@@ -653,22 +1049,7 @@ HistoryScroll *HistoryTypeFile::scroll(HistoryScroll *old) const
     }
     HistoryScroll *newScroll = new HistoryScrollFile(_fileName);
 
-    Character line[LINE_SIZE];
-    int lines = (old != nullptr) ? old->getLines() : 0;
-    for (int i = 0; i < lines; i++) {
-        int size = old->getLineLen(i);
-        if (size > LINE_SIZE) {
-            auto tmp_line = new Character[size];
-            old->getCells(i, 0, size, tmp_line);
-            newScroll->addCells(tmp_line, size);
-            newScroll->addLine(old->isWrappedLine(i));
-            delete [] tmp_line;
-        } else {
-            old->getCells(i, 0, size, line);
-            newScroll->addCells(line, size);
-            newScroll->addLine(old->isWrappedLine(i));
-        }
-    }
+    copyHistory(old, newScroll);
 
     delete old;
     return newScroll;
@@ -681,6 +1062,35 @@ int HistoryTypeFile::maximumLineCount() const
 
 //////////////////////////////
 
+CompressedHistoryType::CompressedHistoryType()
+{
+}
+
+bool CompressedHistoryType::isEnabled() const
+{
+    return true;
+}
+
+HistoryScroll *CompressedHistoryType::scroll(HistoryScroll *old) const
+{
+    if (dynamic_cast<CompressedHistoryScroll *>(old) != nullptr) {
+        return old; // Unchanged.
+    }
+    HistoryScroll *newScroll = new CompressedHistoryScroll();
+
+    copyHistory(old, newScroll);
+
+    delete old;
+    return newScroll;
+}
+
+int CompressedHistoryType::maximumLineCount() const
+{
+    return -1;
+}
+
+//////////////////////////////
+
 CompactHistoryType::CompactHistoryType(unsigned int nbLines) :
     _maxLines(nbLines)
 {
@@ -26,6 +26,7 @@
 
 // Qt
 #include <QList>
+#include <QPair>
 #include <QVector>
 #include <QTemporaryFile>
 
@@ -49,28 +50,52 @@ public:
     virtual void get(char *buffer, qint64 size, qint64 loc);
     virtual qint64 len() const;
 
-    //mmaps the file in read-only mode
-    void map();
-    //un-mmaps the file
+    //writes the data buffered by add() to the file
+    void flush();
+
+    //un-mmaps all mapped segments of the file
     void unmap();
-    //returns true if the file is mmap'ed
+    //returns true if at least one segment of the file is mmap'ed
     bool isMapped() const;
 
 private:
+    // a read-only window onto the file, covering
+    // [index * SEGMENT_SIZE, (index + 1) * SEGMENT_SIZE)
+    struct MappedSegment {
+        qint64 index;
+        uchar *data;
+    };
+
+    //returns the start of the mmap'ed segment, mapping it (and evicting
+    //the least recently used segment) if needed, or nullptr on failure
+    const uchar *segment(qint64 index);
+    //falls back to lseek-read when the file cannot be mmap'ed
+    void read(char *buffer, qint64 size, qint64 loc);
+
     qint64 _length;
+    //number of bytes which have been written to the file, everything after
+    //that is still in _writeBuffer
+    qint64 _flushedLength;
     QTemporaryFile _tmpFile;
 
-    //pointer to start of mmap'ed file data, or 0 if the file is not mmap'ed
-    uchar *_fileMap;
-
-    //incremented whenever 'add' is called and decremented whenever
-    //'get' is called.
-    //this is used to detect when a large number of lines are being read and processed from the history
-    //and automatically mmap the file for better performance (saves the overhead of many lseek-read calls).
-    int _readWriteBalance;
-
-    //when _readWriteBalance goes below this threshold, the file will be mmap'ed automatically
-    static const int MAP_THRESHOLD = -1000;
+    //data which has been added but not written to the file yet.  Lines which scroll off
+    //one at a time are collected here and written in large chunks; reads of this data are
+    //served from the buffer directly.
+    QByteArray _writeBuffer;
+
+    //mmap'ed segments, most recently used first.
+    //Segments are always mapped with their full size, even beyond the current end of the file,
+    //so appending to the file never invalidates them; only data below _flushedLength is ever read.
+    QList<MappedSegment> _segments;
+    //set when mmap'ing fails, history is then read with lseek-read calls
+    bool _mapFailed;
+
+    //size of a mapped window, this must be a multiple of the page size
+    static const qint64 SEGMENT_SIZE = 1 << 20;
+    //maximum number of windows which are mapped at the same time
+    static const int MAX_MAPPED_SEGMENTS = 16;
+    //size at which _writeBuffer is written to the file
+    static const int WRITE_BUFFER_SIZE = 64 * 1024;
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -105,6 +130,12 @@ public:
 
     virtual void addLine(bool previousWrapped = false) = 0;
 
+    // writes lines which are buffered in memory to the backing storage,
+    // called when the terminal is idle
+    virtual void flush()
+    {
+    }
+
     //
     // FIXME:  Passing around constant references to HistoryType instances
     // is very unsafe, because those references will no longer
@@ -137,6 +168,8 @@ public:
     void addCells(const Character text[], int count) Q_DECL_OVERRIDE;
     void addLine(bool previousWrapped = false) Q_DECL_OVERRIDE;
 
+    void flush() Q_DECL_OVERRIDE;
+
 private:
     qint64 startOfLine(int lineno);
 
@@ -243,6 +276,13 @@ public:
         return _allocCount != 0;
     }
 
+    // rewinds an unused block so that its memory can be handed out again
+    void reset()
+    {
+        Q_ASSERT(_allocCount == 0);
+        _tail = _blockStart;
+    }
+
 private:
     size_t _blockLength;
     quint8 *_head;
@@ -255,7 +295,8 @@ class CompactHistoryBlockList
 {
 public:
     CompactHistoryBlockList() :
-        list(QList<CompactHistoryBlock *>())
+        list(QList<CompactHistoryBlock *>()),
+        _spareBlock(nullptr)
     {
     }
 
@@ -270,6 +311,10 @@ public:
 
 private:
     QList<CompactHistoryBlock *> list;
+
+    // the last block which became unused; it is recycled by the next
+    // allocation instead of unmapping it and mapping a new one
+    CompactHistoryBlock *_spareBlock;
 };
 
 class CompactHistoryLine
@@ -313,7 +358,7 @@ protected:
 
 class KONSOLEPRIVATE_EXPORT CompactHistoryScroll : public HistoryScroll
 {
-    typedef QList<CompactHistoryLine *> HistoryArray;
+    typedef QVector<CompactHistoryLine *> HistoryArray;
 
 public:
     explicit CompactHistoryScroll(unsigned int maxNbLines = 1000);
@@ -332,12 +377,80 @@ public:
 
 private:
     bool hasDifferentColors(const TextLine &line) const;
+    CompactHistoryLine *lineAt(int lineNumber) const
+    {
+        return _lines[(_firstLine + lineNumber) % _lines.size()];
+    }
+
+    // circular index of the stored lines.  It grows until it holds
+    // _maxLineCount lines, after that the oldest line is overwritten
+    // in place, so appending and evicting a line are both O(1).
     HistoryArray _lines;
+    // position of the oldest line in _lines
+    int _firstLine;
     CompactHistoryBlockList _blockList;
 
     unsigned int _maxLineCount;
 };
 
+//////////////////////////////////////////////////////////////////////
+// File-based history using compressed storage
+// Lines are encoded the way CompactHistoryLine keeps them (runs of
+// formats plus the text) and collected into blocks.  Full blocks are
+// compressed and appended to a temporary file.
+//////////////////////////////////////////////////////////////////////
+
+class KONSOLEPRIVATE_EXPORT CompressedHistoryScroll : public HistoryScroll
+{
+public:
+    CompressedHistoryScroll();
+    ~CompressedHistoryScroll() Q_DECL_OVERRIDE;
+
+    int  getLines() Q_DECL_OVERRIDE;
+    int  getLineLen(int lineno) Q_DECL_OVERRIDE;
+    void getCells(int lineno, int colno, int count, Character res[]) Q_DECL_OVERRIDE;
+    bool isWrappedLine(int lineno) Q_DECL_OVERRIDE;
+
+    void addCells(const Character text[], int count) Q_DECL_OVERRIDE;
+    void addLine(bool previousWrapped = false) Q_DECL_OVERRIDE;
+
+    void flush() Q_DECL_OVERRIDE;
+
+private:
+    // a compressed block of lines in _blockFile
+    struct Block {
+        qint64 offset;
+        int size;
+        int firstLine;
+    };
+
+    // returns the encoded line, or nullptr if lineno is out of range
+    const char *lineRecord(int lineno);
+    // returns the uncompressed contents of block 'index'
+    const QByteArray &blockData(int index);
+    // compresses the open block and appends it to _blockFile
+    void closeBlock();
+
+    HistoryFile _blockFile;
+    QVector<Block> _blocks;
+
+    // recently uncompressed blocks (block index, data), most recently used first
+    QList<QPair<int, QByteArray> > _blockCache;
+
+    // lines which have not been compressed yet, and the position
+    // of each of them in _openRecords
+    QByteArray _openRecords;
+    QVector<quint32> _openOffsets;
+    int _openFirstLine;
+
+    // cells added since the last call to addLine()
+    TextLine _pendingLine;
+
+    // uncompressed size at which a block is closed
+    static const int BLOCK_SIZE = 64 * 1024;
+    static const int BLOCK_CACHE_SIZE = 4;
+};
+
 //////////////////////////////////////////////////////////////////////
 // History type
 //////////////////////////////////////////////////////////////////////
@@ -397,6 +510,17 @@ protected:
     QString _fileName;
 };
 
+class KONSOLEPRIVATE_EXPORT CompressedHistoryType : public HistoryType
+{
+public:
+    CompressedHistoryType();
+
+    bool isEnabled() const Q_DECL_OVERRIDE;
+    int maximumLineCount() const Q_DECL_OVERRIDE;
+
+    HistoryScroll *scroll(HistoryScroll *) const Q_DECL_OVERRIDE;
+};
+
 class KONSOLEPRIVATE_EXPORT CompactHistoryType : public HistoryType
 {
 public:
@@ -0,0 +1,466 @@
+/*
+    Copyright 2018 by The Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "HistoryReflow.h"
+
+// System
+#include <algorithm>
+
+// Konsole
+#include "History.h"
+#include "konsole_wcwidth.h"
+
+using namespace Konsole;
+
+// positions hold the history line in the high bits and the column in the
+// low bits
+static const int COLUMN_BITS = 16;
+static const int COLUMN_MASK = (1 << COLUMN_BITS) - 1;
+
+static inline qint64 makePosition(qint64 line, int column)
+{
+    return (line << COLUMN_BITS) | qMin(column, COLUMN_MASK);
+}
+
+HistoryReflow::HistoryReflow() :
+    _history(nullptr),
+    _columns(0),
+    _firstLine(0),
+    _tailStart(0),
+    _ranges(),
+    _useCount(0)
+{
+}
+
+void HistoryReflow::setHistory(HistoryScroll *history)
+{
+    _history = history;
+
+    _firstLine = 0;
+    _tailStart = 0;
+    _ranges.clear();
+}
+
+void HistoryReflow::removeFirstLine()
+{
+    _firstLine++;
+    _tailStart = qMax(_tailStart, _firstLine);
+
+    if (_ranges.isEmpty() || _ranges.first().start >= _firstLine) {
+        return;
+    }
+
+    // drop the rewrapped lines which start on the removed line
+    Range &range = _ranges.first();
+    range.start = _firstLine;
+    while (range.firstSegment < range.segments.size() && range.segments.at(range.firstSegment).line < _firstLine) {
+        range.firstSegment++;
+    }
+
+    if (range.lineCount() == 0 || range.end <= _firstLine) {
+        _ranges.removeFirst();
+    } else if (range.firstSegment >= REFLOW_LINES && range.firstSegment * 2 >= range.segments.size()) {
+        range.segments.remove(0, range.firstSegment);
+        range.firstSegment = 0;
+    }
+}
+
+void HistoryReflow::setColumns(int columns)
+{
+    _columns = columns;
+
+    _ranges.clear();
+    _tailStart = historyEnd();
+}
+
+qint64 HistoryReflow::historyEnd() const
+{
+    return _history != nullptr ? _firstLine + _history->getLines() : _firstLine;
+}
+
+int HistoryReflow::getLines() const
+{
+    int lines = int(historyEnd() - _firstLine);
+    foreach (const Range &range, _ranges) {
+        lines += range.lineCount() - int(range.end - range.start);
+    }
+    return lines;
+}
+
+bool HistoryReflow::locate(int line, qint64 &historyLine, int &range, int &segment) const
+{
+    historyLine = _firstLine;
+    for (range = 0; range < _ranges.size(); range++) {
+        const Range &current = _ranges.at(range);
+
+        // the lines before the range are shown as they are
+        const qint64 before = current.start - historyLine;
+        if (line < before) {
+            historyLine += line;
+            return false;
+        }
+        line -= int(before);
+
+        if (line < current.lineCount()) {
+            segment = current.firstSegment + line;
+            historyLine = current.segments.at(segment).line;
+            return true;
+        }
+        line -= current.lineCount();
+        historyLine = current.end;
+    }
+
+    historyLine += line;
+    return false;
+}
+
+int HistoryReflow::getLineLen(int line) const
+{
+    qint64 historyLine;
+    int range;
+    int segment;
+    if (locate(line, historyLine, range, segment)) {
+        return _ranges.at(range).segments.at(segment).length;
+    }
+    return _history->getLineLen(int(historyLine - _firstLine));
+}
+
+bool HistoryReflow::isWrappedLine(int line) const
+{
+    qint64 historyLine;
+    int range;
+    int segment;
+    if (locate(line, historyLine, range, segment)) {
+        return _ranges.at(range).segments.at(segment).wrapped;
+    }
+    return _history->isWrappedLine(int(historyLine - _firstLine));
+}
+
+void HistoryReflow::getCells(int line, int column, int count, Character res[]) const
+{
+    qint64 historyLine;
+    int range;
+    int segment;
+    if (!locate(line, historyLine, range, segment)) {
+        _history->getCells(int(historyLine - _firstLine), column, count, res);
+        return;
+    }
+
+    // the cells may come from several lines of the history buffer
+    column += _ranges.at(range).segments.at(segment).column;
+    const qint64 end = historyEnd();
+    for (; count > 0 && historyLine < end; historyLine++) {
+        const int length = _history->getLineLen(int(historyLine - _firstLine));
+        if (column >= length) {
+            column -= length;
+            continue;
+        }
+
+        const int cells = qMin(count, length - column);
+        _history->getCells(int(historyLine - _firstLine), column, cells, res);
+        res += cells;
+        count -= cells;
+        column = 0;
+    }
+}
+
+int HistoryReflow::sourceLine(int line) const
+{
+    qint64 historyLine;
+    int range;
+    int segment;
+    locate(line, historyLine, range, segment);
+    return int(historyLine - _firstLine);
+}
+
+qint64 HistoryReflow::position(int line) const
+{
+    qint64 historyLine;
+    int range;
+    int segment;
+    if (locate(line, historyLine, range, segment)) {
+        return makePosition(historyLine, _ranges.at(range).segments.at(segment).column);
+    }
+    return makePosition(historyLine, 0);
+}
+
+int HistoryReflow::line(qint64 position) const
+{
+    const qint64 historyLine = qMax(position >> COLUMN_BITS, _firstLine);
+
+    int result = 0;
+    qint64 lineStart = _firstLine;
+    foreach (const Range &range, _ranges) {
+        if (historyLine < range.start) {
+            break;
+        }
+        result += int(range.start - lineStart);
+
+        if (historyLine < range.end) {
+            // the last rewrapped line which starts at or before the position
+            const auto first = range.segments.constBegin() + range.firstSegment;
+            const auto next = std::upper_bound(first, range.segments.constEnd(), position,
+                                               [](qint64 value, const Segment &segment) {
+                                                   return value < makePosition(segment.line, segment.column);
+                                               });
+            return result + qMax(0, int(next - first) - 1);
+        }
+
+        result += range.lineCount();
+        lineStart = range.end;
+    }
+
+    result += int(historyLine - lineStart);
+    return qMax(0, qMin(result, getLines() - 1));
+}
+
+qint64 HistoryReflow::logicalLineStart(qint64 historyLine, qint64 limit) const
+{
+    qint64 start = historyLine;
+    for (int i = 0; i < REFLOW_LINES && start > limit; i++) {
+        if (!_history->isWrappedLine(int(start - 1 - _firstLine))) {
+            break;
+        }
+        start--;
+    }
+    return start;
+}
+
+qint64 HistoryReflow::logicalLineEnd(qint64 historyLine, qint64 limit) const
+{
+    qint64 end = historyLine;
+    for (int i = 0; i < REFLOW_LINES && end + 1 < limit; i++) {
+        if (!_history->isWrappedLine(int(end - _firstLine))) {
+            break;
+        }
+        end++;
+    }
+    return end + 1;
+}
+
+qint64 HistoryReflow::firstUnwrappedLine(qint64 start, qint64 end) const
+{
+    end = qMin(end, _tailStart - 1);
+    foreach (const Range &range, _ranges) {
+        if (start > end || start < range.start) {
+            break;
+        }
+        start = qMax(start, range.end);
+    }
+    return start <= end ? start : -1;
+}
+
+bool HistoryReflow::reflow(int startLine, int endLine, QVector<LineChange> *changes)
+{
+    if (_history == nullptr || _columns <= 0) {
+        return false;
+    }
+
+    startLine = qMax(0, startLine);
+    endLine = qMin(endLine, getLines() - 1);
+    if (startLine > endLine) {
+        return false;
+    }
+
+    qint64 first;
+    qint64 last;
+    int range;
+    int segment;
+    locate(startLine, first, range, segment);
+    locate(endLine, last, range, segment);
+
+    const qint64 target = firstUnwrappedLine(first, last);
+    if (target == -1) {
+        // mark the ranges in view as used
+        for (int i = 0; i < _ranges.size(); i++) {
+            if (_ranges.at(i).start <= last && _ranges.at(i).end > first) {
+                _ranges[i].lastUse = ++_useCount;
+            }
+        }
+        return false;
+    }
+
+    // the ranges before and after the line to rewrap
+    int next = 0;
+    while (next < _ranges.size() && _ranges.at(next).start <= target) {
+        next++;
+    }
+    const int previous = next - 1;
+    const qint64 lowerLimit = previous >= 0 ? _ranges.at(previous).end : _firstLine;
+    const qint64 upperLimit = next < _ranges.size() ? _ranges.at(next).start : _tailStart;
+
+    // the history lines which are rewrapped, and the lines they become
+    qint64 start;
+    qint64 end;
+    QVector<Segment> segments;
+
+    if (previous >= 0 && target <= _ranges.at(previous).end + REFLOW_LINES) {
+        // extend the range before the line
+        start = _ranges.at(previous).end;
+        end = logicalLineEnd(qMin(qMin(last, start + REFLOW_LINES), upperLimit - 1), upperLimit);
+        segments = layout(start, end);
+        range = previous;
+    } else if (next < _ranges.size() && last + REFLOW_LINES >= _ranges.at(next).start) {
+        // extend the range after the line
+        end = _ranges.at(next).start;
+        start = logicalLineStart(qMax(target, end - REFLOW_LINES), lowerLimit);
+        segments = layout(start, end);
+        range = next;
+    } else {
+        start = logicalLineStart(target, lowerLimit);
+        end = logicalLineEnd(qMin(qMin(last, start + REFLOW_LINES), upperLimit - 1), upperLimit);
+        segments = layout(start, end);
+        range = -1;
+    }
+
+    if (changes != nullptr) {
+        LineChange change;
+        change.firstLine = line(makePosition(start, 0));
+        change.oldLineCount = int(end - start);
+        change.newLineCount = segments.size();
+        changes->append(change);
+    }
+
+    if (range == -1) {
+        Range newRange;
+        newRange.start = start;
+        newRange.end = start;
+        newRange.firstSegment = 0;
+        _ranges.insert(next, newRange);
+        range = next;
+    }
+
+    Range &current = _ranges[range];
+    if (start == current.end) {
+        current.segments += segments;
+        current.end = end;
+    } else {
+        current.segments = segments + current.segments.mid(current.firstSegment);
+        current.firstSegment = 0;
+        current.start = start;
+    }
+    current.lastUse = ++_useCount;
+
+    // join the range with the next one when they meet
+    if (range + 1 < _ranges.size() && _ranges.at(range).end == _ranges.at(range + 1).start) {
+        Range &current = _ranges[range];
+        const Range &following = _ranges.at(range + 1);
+        current.segments += following.segments.mid(following.firstSegment);
+        current.end = following.end;
+        current.lastUse = qMax(current.lastUse, following.lastUse);
+        _ranges.remove(range + 1);
+    }
+    if (range > 0 && _ranges.at(range - 1).end == _ranges.at(range).start) {
+        Range &current = _ranges[range - 1];
+        const Range &following = _ranges.at(range);
+        current.segments += following.segments.mid(following.firstSegment);
+        current.end = following.end;
+        current.lastUse = qMax(current.lastUse, following.lastUse);
+        _ranges.remove(range);
+    }
+
+    // forget the range used least recently
+    if (_ranges.size() > MAX_RANGES) {
+        int oldest = 0;
+        for (int i = 1; i < _ranges.size(); i++) {
+            if (_ranges.at(i).lastUse < _ranges.at(oldest).lastUse) {
+                oldest = i;
+            }
+        }
+
+        if (changes != nullptr) {
+            const Range &forgotten = _ranges.at(oldest);
+            LineChange change;
+            change.firstLine = line(makePosition(forgotten.start, 0));
+            change.oldLineCount = forgotten.lineCount();
+            change.newLineCount = int(forgotten.end - forgotten.start);
+            changes->append(change);
+        }
+        _ranges.remove(oldest);
+    }
+
+    return true;
+}
+
+QVector<HistoryReflow::Segment> HistoryReflow::layout(qint64 start, qint64 end) const
+{
+    QVector<Segment> segments;
+
+    qint64 line = start;
+    while (line < end) {
+        const qint64 lineEnd = logicalLineEnd(line, end);
+        layoutLogicalLine(line, lineEnd, segments);
+        line = lineEnd;
+    }
+
+    return segments;
+}
+
+void HistoryReflow::layoutLogicalLine(qint64 start, qint64 end, QVector<Segment> &segments) const
+{
+    QVector<int> lengths;
+    int total = 0;
+    for (qint64 line = start; line < end; line++) {
+        const int length = _history->getLineLen(int(line - _firstLine));
+        lengths.append(length);
+        total += length;
+    }
+    const bool wrapped = _history->isWrappedLine(int(end - 1 - _firstLine));
+
+    // the history line which contains the cell at position, and the
+    // position of its first cell
+    int index = 0;
+    int lineStart = 0;
+    int position = 0;
+
+    do {
+        while (index + 1 < lengths.size() && position >= lineStart + lengths.at(index)) {
+            lineStart += lengths.at(index);
+            index++;
+        }
+
+        int length = qMin(_columns, total - position);
+
+        // double width characters are not split between two lines
+        if (length == _columns && length > 1 && position + length < total) {
+            const int cellPosition = position + length - 1;
+            int cellIndex = index;
+            int cellLineStart = lineStart;
+            while (cellPosition >= cellLineStart + lengths.at(cellIndex)) {
+                cellLineStart += lengths.at(cellIndex);
+                cellIndex++;
+            }
+
+            Character cell;
+            _history->getCells(int(start + cellIndex - _firstLine), cellPosition - cellLineStart, 1, &cell);
+            if ((cell.rendition & RE_EXTENDED_CHAR) == 0 && konsole_wcwidth(cell.character) == 2) {
+                length--;
+            }
+        }
+
+        Segment segment;
+        segment.line = start + index;
+        segment.column = position - lineStart;
+        segment.length = length;
+        position += length;
+        segment.wrapped = position < total || wrapped;
+        segments.append(segment);
+    } while (position < total);
+}
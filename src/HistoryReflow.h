@@ -0,0 +1,187 @@
+/*
+    Copyright 2018 by The Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef HISTORYREFLOW_H
+#define HISTORYREFLOW_H
+
+// Qt
+#include <QVector>
+
+// Konsole
+#include "Character.h"
+#include "konsoleprivate_export.h"
+
+namespace Konsole {
+class HistoryScroll;
+
+/**
+ * Lays out the lines of a history buffer for the current number of columns.
+ *
+ * The history buffer keeps the lines as they were when they left the screen.
+ * When the number of columns changes, the wrapped lines are joined again and
+ * rewrapped to the new width.  This is done lazily: after setColumns(), all
+ * the lines are shown as they are, and reflow() rewraps the lines which come
+ * into view, a few at a time.  A few separate ranges of rewrapped lines are
+ * kept, so that windows looking at different parts of the history do not
+ * rewrap each other's lines again, while the memory used stays bounded
+ * however much history there is.
+ *
+ * Lines added to the history after setColumns() have the right width already
+ * and are shown as they are.
+ *
+ * Lines are numbered from 0, the first line of the history, like the lines of
+ * the history buffer.  The methods to read lines match those of
+ * HistoryScroll.
+ */
+class KONSOLEPRIVATE_EXPORT HistoryReflow
+{
+public:
+    HistoryReflow();
+
+    /** Sets the history buffer to lay out and shows its lines as they are */
+    void setHistory(HistoryScroll *history);
+
+    /** Forgets the first line, after it was dropped from the history buffer */
+    void removeFirstLine();
+
+    /**
+     * Sets the number of columns to rewrap the lines to.  The lines of the
+     * history buffer are shown as they are until they are rewrapped by
+     * reflow().
+     */
+    void setColumns(int columns);
+
+    /**
+     * Describes how reflow() renumbered the lines: the @p oldLineCount lines
+     * from @p firstLine on became @p newLineCount lines, and the lines after
+     * them moved along.
+     */
+    struct LineChange
+    {
+        qint64 firstLine;
+        int oldLineCount;
+        int newLineCount;
+    };
+
+    /**
+     * Rewraps the lines from @p startLine to @p endLine (inclusive) which were
+     * not rewrapped since setColumns().  The lines around them may be rewrapped
+     * too.  When there are already MAX_RANGES ranges of rewrapped lines, the
+     * one used least recently is shown as it is again.  Returns true if the
+     * lines changed, in which case the changes are appended to @p changes,
+     * in the order they were made, if it is not null.
+     *
+     * At most REFLOW_LINES lines of the history buffer are rewrapped per call,
+     * so lines may still need rewrapping afterwards.
+     */
+    bool reflow(int startLine, int endLine, QVector<LineChange> *changes = nullptr);
+
+    // access to the lines, like HistoryScroll
+    int getLines() const;
+    int getLineLen(int line) const;
+    void getCells(int line, int column, int count, Character res[]) const;
+    bool isWrappedLine(int line) const;
+
+    /** Returns the line of the history buffer which contains the start of @p line */
+    int sourceLine(int line) const;
+
+    /**
+     * Returns the position of the start of @p line in the history buffer.
+     * Unlike line numbers, positions stay valid when the lines are rewrapped,
+     * as long as the line was not dropped from the history buffer.
+     */
+    qint64 position(int line) const;
+
+    /** Returns the line which contains @p position */
+    int line(qint64 position) const;
+
+    // the maximum number of lines of the history buffer rewrapped by reflow()
+    static const int REFLOW_LINES = 1000;
+    // the maximum number of separate ranges of rewrapped lines
+    static const int MAX_RANGES = 8;
+
+private:
+    // a line made of cells of a logical line, starting at @p column of the
+    // history line @p line
+    struct Segment
+    {
+        qint64 line;
+        int column;
+        int length;
+        bool wrapped;
+    };
+
+    // the history lines from start to end (exclusive), rewrapped to segments.
+    // The segments before firstSegment were dropped from the history buffer.
+    struct Range
+    {
+        qint64 start;
+        qint64 end;
+        QVector<Segment> segments;
+        int firstSegment;
+        quint64 lastUse; // see _useCount
+
+        int lineCount() const
+        {
+            return segments.size() - firstSegment;
+        }
+    };
+
+    // finds @p line, which is either shown as it is, in which case false is
+    // returned, or the segment @p segment of the range @p range
+    bool locate(int line, qint64 &historyLine, int &range, int &segment) const;
+
+    qint64 historyEnd() const;
+
+    // returns the first or the line after the last history line of the logical
+    // line which contains @p historyLine, looking at no more than REFLOW_LINES
+    // lines and not beyond @p limit
+    qint64 logicalLineStart(qint64 historyLine, qint64 limit) const;
+    qint64 logicalLineEnd(qint64 historyLine, qint64 limit) const;
+
+    // returns the first history line from @p start to @p end (inclusive)
+    // which needs to be rewrapped, or -1
+    qint64 firstUnwrappedLine(qint64 start, qint64 end) const;
+
+    // rewraps the history lines from @p start to @p end (exclusive)
+    QVector<Segment> layout(qint64 start, qint64 end) const;
+    void layoutLogicalLine(qint64 start, qint64 end, QVector<Segment> &segments) const;
+
+    HistoryScroll *_history;
+    int _columns;
+
+    // History lines are numbered from the first line added to the history
+    // buffer since setHistory(), so that the numbers do not change when lines
+    // are dropped.  _firstLine is the number of the first line of the
+    // history buffer.
+    //
+    // The lines in _ranges have been rewrapped, the other lines before
+    // _tailStart need to be rewrapped and the lines after were added with
+    // the current number of columns.
+    qint64 _firstLine;
+    qint64 _tailStart;
+
+    // sorted and disjoint
+    QVector<Range> _ranges;
+    // increased whenever a range is used, to find the one used least recently
+    quint64 _useCount;
+};
+}
+
+#endif // HISTORYREFLOW_H
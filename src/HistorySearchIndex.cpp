@@ -0,0 +1,234 @@
+/*
+    Copyright 2018 by The Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "HistorySearchIndex.h"
+
+// Qt
+#include <QVector>
+
+// Konsole
+#include "ExtendedCharTable.h"
+#include "konsole_wcwidth.h"
+
+using namespace Konsole;
+
+// the two bits of a filter which are set for a trigram
+static inline void trigramBits(uint a, uint b, uint c, int &bit1, int &bit2, int filterBits)
+{
+    // code points use at most 21 bits
+    const quint64 key = (quint64(a) << 42) | (quint64(b) << 21) | quint64(c);
+    const quint64 hash = key * Q_UINT64_C(0x9E3779B97F4A7C15);
+    bit1 = int(hash >> 40) & (filterBits - 1);
+    bit2 = int(hash >> 20) & (filterBits - 1);
+}
+
+HistorySearchIndex::HistorySearchIndex() :
+    _filters(),
+    _firstBlock(0),
+    _firstLine(0),
+    _firstIndexedLine(0),
+    _nextLine(0),
+    _tail(),
+    _tailLength(0),
+    _logicalLineStart(0)
+{
+}
+
+void HistorySearchIndex::reset(int unindexedLines)
+{
+    _filters.clear();
+    _firstLine = 0;
+    _firstIndexedLine = unindexedLines;
+    _nextLine = unindexedLines;
+    _firstBlock = _nextLine / BLOCK_LINES;
+    _tailLength = 0;
+    _logicalLineStart = _nextLine;
+}
+
+void HistorySearchIndex::addLine(const Character *cells, int count, bool wrapped)
+{
+    const qint64 line = _nextLine++;
+    const int block = int(line / BLOCK_LINES - _firstBlock);
+    if (block == _filters.size()) {
+        _filters.append(QBitArray(FILTER_BITS));
+    }
+    QBitArray &filter = _filters[block];
+
+    // a wrapped line which goes on in this block is searched for in the
+    // block where it starts, unless that one was dropped already
+    QBitArray *continuedFilter = nullptr;
+    const int startBlock = int(_logicalLineStart / BLOCK_LINES - _firstBlock);
+    if (startBlock >= 0 && startBlock < block) {
+        continuedFilter = &_filters[startBlock];
+    }
+
+    // the text of the line is extracted the same way as PlainTextDecoder
+    // does it, so that the trigrams are those of the text which is searched.
+
+    // find out the last technically real character in the line
+    int realCharacterGuard = -1;
+    for (int i = count - 1; i >= 0; i--) {
+        if (cells[i].isRealCharacter && cells[i].character != '\n') {
+            realCharacterGuard = i;
+            break;
+        }
+    }
+
+    for (int i = 0; i < count;) {
+        if ((cells[i].rendition & RE_EXTENDED_CHAR) != 0) {
+            ushort extendedCharLength = 0;
+            const uint *chars = ExtendedCharTable::instance.lookupExtendedChar(cells[i].character, extendedCharLength);
+            if (chars != nullptr) {
+                for (int j = 0; j < extendedCharLength; j++) {
+                    addCharacter(chars[j], filter, continuedFilter);
+                }
+                i += qMax(1, string_width(QString::fromUcs4(chars, extendedCharLength)));
+            } else {
+                ++i;
+            }
+        } else if (cells[i].isRealCharacter || i <= realCharacterGuard) {
+            addCharacter(cells[i].character, filter, continuedFilter);
+            i += qMax(1, konsole_wcwidth(cells[i].character));
+        } else {
+            ++i;
+        }
+    }
+
+    if (!wrapped) {
+        _tailLength = 0;
+        _logicalLineStart = _nextLine;
+    }
+}
+
+void HistorySearchIndex::addCharacter(uint character, QBitArray &filter, QBitArray *continuedFilter)
+{
+    character = QChar::toCaseFolded(character);
+
+    if (_tailLength == 2) {
+        int bit1;
+        int bit2;
+        trigramBits(_tail[0], _tail[1], character, bit1, bit2, FILTER_BITS);
+        filter.setBit(bit1);
+        filter.setBit(bit2);
+        if (continuedFilter != nullptr) {
+            continuedFilter->setBit(bit1);
+            continuedFilter->setBit(bit2);
+        }
+
+        _tail[0] = _tail[1];
+        _tail[1] = character;
+    } else {
+        _tail[_tailLength++] = character;
+    }
+}
+
+void HistorySearchIndex::removeFirstLine()
+{
+    _firstLine++;
+
+    // drop the blocks whose lines have all been removed
+    while (!_filters.isEmpty() && (_firstBlock + 1) * BLOCK_LINES <= _firstLine) {
+        _filters.removeFirst();
+        _firstBlock++;
+    }
+}
+
+bool HistorySearchIndex::mayContain(int startLine, int endLine, const QString &text) const
+{
+    const qint64 first = _firstLine + startLine;
+    const qint64 last = _firstLine + endLine;
+
+    if (first < _firstIndexedLine || last >= _nextLine) {
+        return true;
+    }
+
+    const QVector<uint> characters = text.toUcs4();
+    if (characters.size() < 3) {
+        return true;
+    }
+
+    QVector<int> bits;
+    bits.reserve(2 * (characters.size() - 2));
+    for (int i = 2; i < characters.size(); i++) {
+        int bit1;
+        int bit2;
+        trigramBits(QChar::toCaseFolded(characters[i - 2]),
+                    QChar::toCaseFolded(characters[i - 1]),
+                    QChar::toCaseFolded(characters[i]),
+                    bit1, bit2, FILTER_BITS);
+        bits << bit1 << bit2;
+    }
+
+    const int firstBlock = int(first / BLOCK_LINES - _firstBlock);
+    const int lastBlock = int(last / BLOCK_LINES - _firstBlock);
+
+    for (int block = qMax(0, firstBlock); block <= lastBlock && block < _filters.size(); block++) {
+        const QBitArray &filter = _filters.at(block);
+
+        bool found = true;
+        foreach (int bit, bits) {
+            if (!filter.testBit(bit)) {
+                found = false;
+                break;
+            }
+        }
+        if (found) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+QString HistorySearchIndex::requiredText(const QRegularExpression &regExp)
+{
+    if ((regExp.patternOptions() & QRegularExpression::ExtendedPatternSyntaxOption) != 0) {
+        return QString();
+    }
+
+    // only patterns which match a plain string are handled, such as those
+    // made with QRegularExpression::escape()
+    static const QString metaCharacters = QStringLiteral("^$.|?*+()[]{}");
+
+    const QString pattern = regExp.pattern();
+    QString text;
+    text.reserve(pattern.size());
+
+    for (int i = 0; i < pattern.size(); i++) {
+        const QChar c = pattern.at(i);
+        if (c == QLatin1Char('\\')) {
+            if (i + 1 == pattern.size()) {
+                return QString();
+            }
+            // escaped letters and digits have a special meaning, such as \d
+            const QChar next = pattern.at(++i);
+            if (next.unicode() < 128 && next.isLetterOrNumber()) {
+                return QString();
+            }
+            text.append(next);
+        } else if (metaCharacters.contains(c)) {
+            return QString();
+        } else {
+            text.append(c);
+        }
+    }
+
+    return text;
+}
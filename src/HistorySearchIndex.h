@@ -0,0 +1,118 @@
+/*
+    Copyright 2018 by The Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef HISTORYSEARCHINDEX_H
+#define HISTORYSEARCHINDEX_H
+
+// Qt
+#include <QBitArray>
+#include <QList>
+#include <QRegularExpression>
+#include <QString>
+
+// Konsole
+#include "Character.h"
+#include "konsoleprivate_export.h"
+
+namespace Konsole {
+/**
+ * An index over the lines of a history buffer which tells which blocks of
+ * lines cannot contain a piece of text, so that searches can skip them
+ * without decoding them.
+ *
+ * The lines are grouped in blocks of BLOCK_LINES lines.  For each block, the
+ * trigrams (sequences of three characters) of the text of its lines are
+ * recorded in a bloom filter.  Text can only be found in a block if all of
+ * its trigrams are in the block's filter.  Characters are case folded, so the
+ * index can be used for both case sensitive and insensitive searches.
+ *
+ * The trigrams of the lines which continue a wrapped line are also recorded
+ * in the filter of the block where that logical line starts, so that text
+ * which starts in a block and goes on in the next ones is found in the block
+ * where it starts.
+ *
+ * Lines are numbered like the lines of the history buffer, the first line
+ * being 0.  Lines which were in the history before the index was reset are
+ * not indexed and are assumed to contain any text.
+ */
+class KONSOLEPRIVATE_EXPORT HistorySearchIndex
+{
+public:
+    HistorySearchIndex();
+
+    /**
+     * Forgets all indexed lines.  The first @p unindexedLines lines of the
+     * history buffer are assumed to contain any text.
+     */
+    void reset(int unindexedLines = 0);
+
+    /** Indexes a line which was added at the end of the history buffer */
+    void addLine(const Character *cells, int count, bool wrapped);
+
+    /** Forgets the first line, after it was dropped from the history buffer */
+    void removeFirstLine();
+
+    /**
+     * Returns false if none of the lines from @p startLine to @p endLine
+     * (inclusive) can contain @p text, or true if some of them may.
+     *
+     * Lines which have not been indexed may contain anything, this includes
+     * lines past the end of the history buffer.
+     */
+    bool mayContain(int startLine, int endLine, const QString &text) const;
+
+    /**
+     * Returns a piece of text which is part of every match of @p regExp, or
+     * an empty string if there is none the index can use.  This is the whole
+     * text searched for when @p regExp matches a plain string.
+     */
+    static QString requiredText(const QRegularExpression &regExp);
+
+private:
+    // @p continuedFilter is the filter of the block where the logical line
+    // started, if it is not @p filter, or null
+    void addCharacter(uint character, QBitArray &filter, QBitArray *continuedFilter);
+
+    static const int BLOCK_LINES = 512;
+    static const int FILTER_BITS = 1 << 15;
+
+    // the filters of the indexed blocks.  block i holds the absolute lines
+    // from (_firstBlock + i) * BLOCK_LINES
+    QList<QBitArray> _filters;
+    qint64 _firstBlock;
+
+    // lines are counted from the last reset; these are the absolute numbers
+    // of the first line of the history buffer, of the first indexed line and
+    // of the line which will be added next
+    qint64 _firstLine;
+    qint64 _firstIndexedLine;
+    qint64 _nextLine;
+
+    // the last characters of the previous line, if it was wrapped, since
+    // trigrams can span wrapped lines
+    uint _tail[2];
+    int _tailLength;
+    // the absolute number of the first line of the logical line which the
+    // next line belongs to, the next line itself unless the previous one
+    // was wrapped
+    qint64 _logicalLineStart;
+};
+}
+
+#endif // HISTORYSEARCHINDEX_H
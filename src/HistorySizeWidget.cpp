@@ -69,6 +69,7 @@ HistorySizeWidget::HistorySizeWidget(QWidget *parent) :
     modeGroup->addButton(_ui->noHistoryButton);
     modeGroup->addButton(_ui->fixedSizeHistoryButton);
     modeGroup->addButton(_ui->unlimitedHistoryButton);
+    modeGroup->addButton(_ui->compressedHistoryButton);
     connect(modeGroup,
             static_cast<void (QButtonGroup::*)(QAbstractButton *)>(&QButtonGroup::buttonClicked),
             this, &Konsole::HistorySizeWidget::buttonClicked);
@@ -90,7 +91,8 @@ void HistorySizeWidget::buttonClicked(QAbstractButton *)
 {
     Enum::HistoryModeEnum selectedMode = mode();
     _ui->fixedSizeWarningWidget->setVisible(Enum::FixedSizeHistory == selectedMode);
-    _ui->unlimitedWarningWidget->setVisible(Enum::UnlimitedHistory == selectedMode);
+    _ui->unlimitedWarningWidget->setVisible(Enum::UnlimitedHistory == selectedMode
+                                            || Enum::CompressedUnlimitedHistory == selectedMode);
     emit historyModeChanged(selectedMode);
 }
 
@@ -102,9 +104,12 @@ void HistorySizeWidget::setMode(Enum::HistoryModeEnum aMode)
         _ui->fixedSizeHistoryButton->setChecked(true);
     } else if (aMode == Enum::UnlimitedHistory) {
         _ui->unlimitedHistoryButton->setChecked(true);
+    } else if (aMode == Enum::CompressedUnlimitedHistory) {
+        _ui->compressedHistoryButton->setChecked(true);
     }
     _ui->fixedSizeWarningWidget->setVisible(Enum::FixedSizeHistory == aMode);
-    _ui->unlimitedWarningWidget->setVisible(Enum::UnlimitedHistory == aMode);
+    _ui->unlimitedWarningWidget->setVisible(Enum::UnlimitedHistory == aMode
+                                            || Enum::CompressedUnlimitedHistory == aMode);
 }
 
 Enum::HistoryModeEnum HistorySizeWidget::mode() const
@@ -115,6 +120,8 @@ Enum::HistoryModeEnum HistorySizeWidget::mode() const
         return Enum::FixedSizeHistory;
     } else if (_ui->unlimitedHistoryButton->isChecked()) {
         return Enum::UnlimitedHistory;
+    } else if (_ui->compressedHistoryButton->isChecked()) {
+        return Enum::CompressedUnlimitedHistory;
     }
 
     Q_ASSERT(false);
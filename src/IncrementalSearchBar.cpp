@@ -49,6 +49,7 @@ IncrementalSearchBar::IncrementalSearchBar(QWidget *aParent) :
     _findNextButton(nullptr),
     _findPreviousButton(nullptr),
     _searchFromButton(nullptr),
+    _searchProgress(nullptr),
     _searchTimer(nullptr)
 {
 
@@ -84,6 +85,11 @@ IncrementalSearchBar::IncrementalSearchBar(QWidget *aParent) :
     connect(_searchEdit, &QLineEdit::textChanged, _searchTimer,
             static_cast<void (QTimer::*)()>(&QTimer::start));
 
+    _searchProgress = new QLabel(this);
+    _searchProgress->setObjectName(QStringLiteral("search-progress"));
+    _searchProgress->setToolTip(i18nc("@info:tooltip", "How much of the output has been searched"));
+    _searchProgress->setVisible(false);
+
     _findNextButton = new QToolButton(this);
     _findNextButton->setObjectName(QStringLiteral("find-next-button"));
     _findNextButton->setText(i18nc("@action:button Go to the next phrase", "Next"));
@@ -153,6 +159,7 @@ IncrementalSearchBar::IncrementalSearchBar(QWidget *aParent) :
 
     auto barLayout = new QHBoxLayout(this);
     barLayout->addWidget(_searchEdit);
+    barLayout->addWidget(_searchProgress);
     barLayout->addWidget(_findNextButton);
     barLayout->addWidget(_findPreviousButton);
     barLayout->addWidget(_searchFromButton);
@@ -279,6 +286,17 @@ void IncrementalSearchBar::setFoundMatch(bool match)
     _searchEdit->setStyleSheet(matchStyleSheet);
 }
 
+void IncrementalSearchBar::setSearchProgress(int percent)
+{
+    if (percent < 0) {
+        _searchProgress->setVisible(false);
+        return;
+    }
+
+    _searchProgress->setText(i18nc("@info:status Progress of a search through the output", "%1%", percent));
+    _searchProgress->setVisible(true);
+}
+
 void IncrementalSearchBar::clearLineEdit()
 {
     _searchEdit->setStyleSheet(QString());
@@ -28,6 +28,7 @@ class QAction;
 class QTimer;
 class QLineEdit;
 class QToolButton;
+class QLabel;
 
 namespace Konsole {
 /**
@@ -91,6 +92,14 @@ public:
      */
     void setFoundMatch(bool match);
 
+    /**
+     * Shows how far a search which runs in the background has got.
+     *
+     * @param percent How much of the output has been searched, or -1 to hide
+     * the indicator once the search has finished
+     */
+    void setSearchProgress(int percent);
+
     /** Returns the current search text */
     QString searchText();
 
@@ -158,6 +167,7 @@ private:
     QToolButton *_findNextButton;
     QToolButton *_findPreviousButton;
     QToolButton *_searchFromButton;
+    QLabel *_searchProgress;
     QFont _searchEditFont;
     QTimer *_searchTimer;
 };
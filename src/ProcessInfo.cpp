@@ -101,9 +101,39 @@ void ProcessInfo::setError(Error error)
 
 void ProcessInfo::update()
 {
+    if (_updateTimer.isValid() && !_updateTimer.hasExpired(UPDATE_INTERVAL)) {
+        return;
+    }
+    _updateTimer.start();
+
     readCurrentDir(_pid);
 }
 
+QHash<int, QWeakPointer<ProcessInfo> > ProcessInfo::_sharedInstances;
+
+QSharedPointer<ProcessInfo> ProcessInfo::sharedInstance(int pid, const QString &titleFormat)
+{
+    QSharedPointer<ProcessInfo> info = _sharedInstances.value(pid).toStrongRef();
+
+    if (info.isNull()) {
+        // forget the processes which nobody asks for anymore
+        QMutableHashIterator<int, QWeakPointer<ProcessInfo> > iter(_sharedInstances);
+        while (iter.hasNext()) {
+            if (iter.next().value().isNull()) {
+                iter.remove();
+            }
+        }
+
+        info = QSharedPointer<ProcessInfo>(newInstance(pid, titleFormat));
+        _sharedInstances.insert(pid, info);
+    } else if (!info->userNameRequired() && titleFormat.contains(QLatin1String("%u"))) {
+        info->setUserNameRequired(true);
+        info->readUserName();
+    }
+
+    return info;
+}
+
 QString ProcessInfo::validCurrentDir() const
 {
     bool ok = false;
@@ -251,9 +281,16 @@ void ProcessInfo::setUserName(const QString &name)
 
 void ProcessInfo::setUserHomeDir()
 {
+    // the home directories are looked up once per user
+    static QHash<QString, QString> homeDirs;
+
     const QString &usersName = userName();
     if (!usersName.isEmpty()) {
-        _userHomeDir = KUser(usersName).homeDir();
+        QHash<QString, QString>::const_iterator iter = homeDirs.constFind(usersName);
+        if (iter == homeDirs.constEnd()) {
+            iter = homeDirs.insert(usersName, KUser(usersName).homeDir());
+        }
+        _userHomeDir = iter.value();
     } else {
         _userHomeDir = QDir::homePath();
     }
@@ -387,6 +424,16 @@ void UnixProcessInfo::readUserName()
         return;
     }
 
+    // the user names are looked up once per user id, since reading the
+    // user database can be slow, e.g. over the network
+    static QHash<int, QString> userNames;
+
+    const QHash<int, QString>::const_iterator iter = userNames.constFind(uid);
+    if (iter != userNames.constEnd()) {
+        setUserName(iter.value());
+        return;
+    }
+
     struct passwd passwdStruct;
     struct passwd *getpwResult;
     char *getpwBuffer;
@@ -404,8 +451,10 @@ void UnixProcessInfo::readUserName()
     }
     getpwStatus = getpwuid_r(uid, &passwdStruct, getpwBuffer, getpwBufferSize, &getpwResult);
     if ((getpwStatus == 0) && (getpwResult != nullptr)) {
+        userNames.insert(uid, QLatin1String(passwdStruct.pw_name));
         setUserName(QLatin1String(passwdStruct.pw_name));
     } else {
+        userNames.insert(uid, QString());
         setUserName(QString());
         qWarning() << "getpwuid_r returned error : " << getpwStatus;
     }
@@ -486,7 +535,7 @@ private:
             if (ok) {
                 setUserId(uid);
             }
-            // This will cause constant opening of /etc/passwd
+            // The user name is only looked up once per user id
             if (userNameRequired()) {
                 readUserName();
             }
@@ -21,11 +21,17 @@
 #define PROCESSINFO_H
 
 // Qt
+#include <QElapsedTimer>
 #include <QFile>
+#include <QHash>
 #include <QMap>
+#include <QSharedPointer>
 #include <QString>
 #include <QVector>
 
+// Konsole
+#include "konsoleprivate_export.h"
+
 namespace Konsole {
 /**
  * Takes a snapshot of the state of a process and provides access to
@@ -69,7 +75,7 @@ namespace Konsole {
  *   }
  * @endcode
  */
-class ProcessInfo
+class KONSOLEPRIVATE_EXPORT ProcessInfo
 {
 public:
     /**
@@ -82,6 +88,19 @@ public:
      */
     static ProcessInfo *newInstance(int pid, const QString &titleFormat);
 
+    /**
+     * Returns the instance of ProcessInfo for a given process which is
+     * shared by everyone asking for that process, e.g. by the sessions
+     * whose shell or foreground process it is.  The instance is created
+     * with newInstance() when the process is not known yet, and is
+     * forgotten once the last reference to it is released.
+     *
+     * @param pid The pid of the process to examine
+     * @param titleFormat The local title format - if it contains %u, the
+     *  user name is read as well.
+     */
+    static QSharedPointer<ProcessInfo> sharedInstance(int pid, const QString &titleFormat);
+
     virtual ~ProcessInfo()
     {
     }
@@ -89,6 +108,9 @@ public:
     /**
      * Updates the information about the process.  This must
      * be called before attempting to use any of the accessor methods.
+     *
+     * The current directory is read again at most once every
+     * UPDATE_INTERVAL milliseconds, however often this is called.
      */
     void update();
 
@@ -286,8 +308,15 @@ private:
 
     QVector<QString> _arguments;
 
+    // the time since update() last read the current directory
+    QElapsedTimer _updateTimer;
+    static const int UPDATE_INTERVAL = 200;
+
     static QSet<QString> commonDirNames();
     static QSet<QString> _commonDirNames;
+
+    // see sharedInstance()
+    static QHash<int, QWeakPointer<ProcessInfo> > _sharedInstances;
 };
 Q_DECLARE_OPERATORS_FOR_FLAGS(ProcessInfo::Fields)
 
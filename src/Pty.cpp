@@ -29,6 +29,7 @@
 
 // Qt
 #include <QStringList>
+#include <QTimer>
 #include <qplatformdefs.h>
 
 // KDE
@@ -56,6 +57,12 @@ void Pty::init()
     _xonXoff = true;
     _utf8 = true;
 
+    _readBuffer.resize(READ_BUFFER_SIZE);
+    _readTimer = new QTimer(this);
+    _readTimer->setSingleShot(true);
+    _receivedBlockCount = 0;
+    _receivedByteCount = 0;
+
     setEraseChar(_eraseChar);
     setFlowControlEnabled(_xonXoff);
     setUtf8Mode(_utf8);
@@ -66,6 +73,8 @@ void Pty::init()
     setPtyChannels(KPtyProcess::AllChannels);
 
     connect(pty(), &KPtyDevice::readyRead, this, &Konsole::Pty::dataReceived);
+    connect(_readTimer, &QTimer::timeout, this, &Konsole::Pty::readPendingData);
+    connect(pty(), &KPtyDevice::bytesWritten, this, &Konsole::Pty::dataWritten);
 }
 
 Pty::~Pty() = default;
@@ -82,14 +91,67 @@ void Pty::sendData(const QByteArray &data)
     }
 }
 
+void Pty::dataWritten()
+{
+    // the pty device buffers the data which the terminal process did not
+    // read yet
+    if (pty()->bytesToWrite() == 0) {
+        emit dataSent();
+    }
+}
+
 void Pty::dataReceived()
 {
-    QByteArray data = pty()->readAll();
-    if (data.isEmpty()) {
-        return;
+    // small reads are passed on together, once the pty device has read
+    // everything which arrived in this event loop iteration
+    if (!_readTimer->isActive()) {
+        _readTimer->start(0);
+    }
+}
+
+void Pty::readPendingData()
+{
+    qint64 budget = READ_BUDGET;
+
+    while (budget > 0) {
+        // collect what the process wrote in the meantime, so that blocks are
+        // as large as the buffer
+        while (pty()->bytesAvailable() < _readBuffer.size() && pty()->waitForReadyRead(0)) {
+        }
+
+        const qint64 length = pty()->read(_readBuffer.data(), qMin<qint64>(_readBuffer.size(), budget));
+        if (length <= 0) {
+            break;
+        }
+        budget -= length;
+
+        _receivedBlockCount++;
+        _receivedByteCount += length;
+
+        emit receivedData(_readBuffer.constData(), static_cast<int>(length));
     }
 
-    emit receivedData(data.constData(), data.count());
+    // let the event loop run before reading the rest
+    if (pty()->bytesAvailable() > 0) {
+        _readTimer->start(0);
+    } else {
+        _readTimer->stop();
+    }
+}
+
+qint64 Pty::receivedBlockCount() const
+{
+    return _receivedBlockCount;
+}
+
+bool Pty::isSendingData() const
+{
+    return pty()->bytesToWrite() > 0;
+}
+
+qint64 Pty::receivedByteCount() const
+{
+    return _receivedByteCount;
 }
 
 void Pty::setWindowSize(int columns, int lines)
@@ -33,6 +33,7 @@
 #include "konsoleprivate_export.h"
 
 class QStringList;
+class QTimer;
 
 namespace Konsole {
 /**
@@ -142,6 +143,23 @@ public:
      */
     void sendEof();
 
+    /**
+     * Returns the number of blocks of data passed on with receivedData()
+     * so far.  Together with receivedByteCount(), this tells how well
+     * small reads from the teletype are coalesced.
+     */
+    qint64 receivedBlockCount() const;
+
+    /** Returns the number of bytes passed on with receivedData() so far */
+    qint64 receivedByteCount() const;
+
+    /**
+     * Returns true if some of the data passed to sendData() has not been
+     * written to the teletype yet, in which case dataSent() is emitted once
+     * it has been.
+     */
+    bool isSendingData() const;
+
 public Q_SLOTS:
     /**
      * Put the pty into UTF-8 mode on systems which support it.
@@ -166,12 +184,23 @@ Q_SIGNALS:
      */
     void receivedData(const char *buffer, int length);
 
+    /**
+     * Emitted when all of the data passed to sendData() has been written
+     * to the teletype, that is once the process read enough of its input
+     */
+    void dataSent();
+
 protected:
     void setupChildProcess() Q_DECL_OVERRIDE;
 
 private Q_SLOTS:
     // called when data is received from the terminal process
     void dataReceived();
+    // passes the data received from the terminal process on, up to a
+    // budget per event loop iteration
+    void readPendingData();
+    // called when data was written to the terminal process
+    void dataWritten();
 
 private:
     void init();
@@ -185,6 +214,17 @@ private:
     char _eraseChar;
     bool _xonXoff;
     bool _utf8;
+
+    // the largest block passed on with receivedData(), and the most data
+    // passed on per event loop iteration
+    static const int READ_BUFFER_SIZE = 64 * 1024;
+    static const int READ_BUDGET = 256 * 1024;
+
+    QByteArray _readBuffer; // reused for every block passed on with receivedData()
+    QTimer *_readTimer; // reads the received data in the next event loop iteration
+
+    qint64 _receivedBlockCount;
+    qint64 _receivedByteCount;
 };
 }
 
@@ -0,0 +1,274 @@
+/*
+    Copyright 2018 by The Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+
+// Own
+#include "SaveHistoryThread.h"
+
+// Qt
+#include <QSaveFile>
+#include <QScopedPointer>
+#include <QTextCodec>
+#include <QTextStream>
+
+// Konsole
+#include "TerminalCharacterDecoder.h"
+
+using namespace Konsole;
+
+SaveHistoryThread::SaveHistoryThread(Format format, const QString &fileName, QObject *parent) :
+    QThread(parent),
+    _format(format),
+    _fileName(fileName),
+    _mutex(),
+    _blockAdded(),
+    _blocks(),
+    _blocksInProgress(0),
+    _finished(false),
+    _bytesSaved(0),
+    _errorString(),
+    _cancelled(0)
+{
+}
+
+SaveHistoryThread::~SaveHistoryThread()
+{
+    cancel();
+    wait();
+}
+
+void SaveHistoryThread::addBlock(const LineBlock &block)
+{
+    QMutexLocker locker(&_mutex);
+    _blocks.enqueue(block);
+    _blockAdded.wakeOne();
+}
+
+int SaveHistoryThread::pendingBlocks() const
+{
+    QMutexLocker locker(&_mutex);
+    return _blocks.size() + _blocksInProgress;
+}
+
+void SaveHistoryThread::finish()
+{
+    QMutexLocker locker(&_mutex);
+    _finished = true;
+    _blockAdded.wakeOne();
+}
+
+void SaveHistoryThread::cancel()
+{
+    QMutexLocker locker(&_mutex);
+    _cancelled.store(1);
+    _blocks.clear();
+    _blockAdded.wakeOne();
+}
+
+qint64 SaveHistoryThread::bytesSaved() const
+{
+    QMutexLocker locker(&_mutex);
+    return _bytesSaved;
+}
+
+QString SaveHistoryThread::errorString() const
+{
+    QMutexLocker locker(&_mutex);
+    return _errorString;
+}
+
+void SaveHistoryThread::setErrorString(const QString &errorString)
+{
+    QMutexLocker locker(&_mutex);
+    _errorString = errorString;
+}
+
+void SaveHistoryThread::run()
+{
+    // the file only replaces an existing one when it is committed at the end
+    QSaveFile file(_fileName);
+    if (!_fileName.isEmpty() && !file.open(QIODevice::WriteOnly)) {
+        setErrorString(file.errorString());
+        return;
+    }
+
+    QScopedPointer<TerminalCharacterDecoder> decoder;
+    if (_format == Html) {
+        decoder.reset(new HTMLDecoder());
+    } else {
+        decoder.reset(new PlainTextDecoder());
+    }
+
+    // encode the output like a QTextStream writing to the file would
+    QScopedPointer<QTextEncoder> encoder(QTextCodec::codecForLocale()->makeEncoder());
+
+    QString text;
+    QTextStream stream(&text);
+    decoder->begin(&stream);
+
+    forever {
+        LineBlock block;
+        bool lastBlock = false;
+        {
+            QMutexLocker locker(&_mutex);
+            _blocksInProgress = 0;
+            while (_blocks.isEmpty() && !_finished && _cancelled.load() == 0) {
+                _blockAdded.wait(&_mutex);
+            }
+            if (_cancelled.load() != 0) {
+                return;
+            }
+            if (_blocks.isEmpty()) {
+                lastBlock = true;
+            } else {
+                block = _blocks.dequeue();
+                _blocksInProgress = 1;
+            }
+        }
+
+        if (lastBlock) {
+            decoder->end();
+        } else {
+            for (int i = 0; i < block.lineCount(); i++) {
+                const int start = block.lineStart(i);
+                decoder->decodeLine(block.cells.constData() + start,
+                                    block.lineEnds.at(i) - start,
+                                    block.lineProperties.at(i));
+            }
+        }
+
+        stream.flush();
+        const QByteArray data = encoder->fromUnicode(text);
+        text.clear();
+
+        if (!_fileName.isEmpty() && file.write(data) != data.size()) {
+            setErrorString(file.errorString());
+            return;
+        }
+        if (lastBlock && !_fileName.isEmpty() && !file.commit()) {
+            setErrorString(file.errorString());
+            return;
+        }
+
+        {
+            QMutexLocker locker(&_mutex);
+            _bytesSaved += data.size();
+        }
+
+        if (_cancelled.load() != 0) {
+            return;
+        }
+        emit blockSaved(block.lineCount(), _fileName.isEmpty() ? data : QByteArray());
+
+        if (lastBlock) {
+            return;
+        }
+    }
+}
+
+SaveHistoryLines::SaveHistoryLines(const Screen *screen) :
+    _screen(screen),
+    _historyId(screen->historyId()),
+    _historyLayoutId(screen->historyLayoutId()),
+    _droppedLines(screen->totalDroppedLines()),
+    _nextLine(0),
+    _lastLine(screen->getHistLines() + screen->getLines() - 1),
+    _nextPosition(screen->linePosition(0)),
+    _nextLineInHistory(screen->getHistLines() > 0)
+{
+}
+
+bool SaveHistoryLines::copyBlock(int lineCount, LineBlock &block)
+{
+    if (_screen->historyId() != _historyId) {
+        return false;
+    }
+    if (_screen->historyLayoutId() != _historyLayoutId && !followHistoryLayout()) {
+        return false;
+    }
+
+    // the output moves up when lines are dropped from the history
+    const int dropped = static_cast<int>(_screen->totalDroppedLines() - _droppedLines);
+    _nextLine = qMax(_nextLine, dropped);
+    if (_nextLine > _lastLine) {
+        return true;
+    }
+
+    const int first = _nextLine - dropped;
+    const int last = _lastLine - dropped;
+    int end = qMin(first + lineCount - 1, last);
+    while (end < last && (_screen->getLineProperties(end, end).at(0) & LINE_WRAPPED) != 0) {
+        end++;
+    }
+
+    _screen->copyLines(first, end, block);
+
+    _nextLine = end + dropped + 1;
+    _nextLineInHistory = end + 1 < _screen->getHistLines();
+    if (_nextLineInHistory) {
+        _nextPosition = _screen->linePosition(end + 1);
+    }
+
+    return true;
+}
+
+bool SaveHistoryLines::atEnd() const
+{
+    return _nextLine > _lastLine;
+}
+
+int SaveHistoryLines::lineCount() const
+{
+    return _lastLine + 1;
+}
+
+bool SaveHistoryLines::followHistoryLayout()
+{
+    QVector<HistoryReflow::LineChange> changes;
+    if (!_screen->historyLayoutChanges(_historyLayoutId, changes)) {
+        return false;
+    }
+    _historyLayoutId = _screen->historyLayoutId();
+
+    // only lines which were in the history when the number of columns
+    // changed are rewrapped, the lines after them move along
+    foreach (const HistoryReflow::LineChange &change, changes) {
+        const int first = static_cast<int>(change.firstLine - _droppedLines);
+        const int oldEnd = first + change.oldLineCount;
+        const int delta = change.newLineCount - change.oldLineCount;
+
+        if (_lastLine >= oldEnd) {
+            _lastLine += delta;
+        } else if (_lastLine >= first) {
+            _lastLine = first + change.newLineCount - 1;
+        }
+        if (!_nextLineInHistory && _nextLine >= oldEnd) {
+            _nextLine += delta;
+        }
+    }
+
+    // the next line starts a logical line, which keeps its position; if it
+    // was dropped since, the lines up to the first one left are lost
+    if (_nextLineInHistory) {
+        _nextLine = _screen->lineAtPosition(_nextPosition)
+                    + static_cast<int>(_screen->totalDroppedLines() - _droppedLines);
+    }
+
+    return true;
+}
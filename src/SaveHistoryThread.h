@@ -0,0 +1,171 @@
+/*
+    Copyright 2018 by The Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+
+#ifndef SAVEHISTORYTHREAD_H
+#define SAVEHISTORYTHREAD_H
+
+// Qt
+#include <QAtomicInt>
+#include <QMutex>
+#include <QQueue>
+#include <QThread>
+#include <QWaitCondition>
+
+// Konsole
+#include "Screen.h"
+#include "konsoleprivate_export.h"
+
+namespace Konsole {
+/**
+ * Decodes blocks of lines copied out of a screen into plain text or HTML
+ * and saves the output to a file, away from the GUI thread.
+ *
+ * The owner copies the output to save with Screen::copyLines() and hands
+ * the blocks over with addBlock(), a few at a time so that memory use stays
+ * bounded, and calls finish() once all of them were added.  Blocks are saved
+ * in the order in which they were added and blockSaved() is emitted for each
+ * of them.  When no file name is given, the decoded output is passed on with
+ * blockSaved() instead of being written, e.g. to be sent to a remote URL.
+ */
+class KONSOLEPRIVATE_EXPORT SaveHistoryThread : public QThread
+{
+    Q_OBJECT
+
+public:
+    enum Format {
+        PlainText,
+        Html
+    };
+
+    SaveHistoryThread(Format format, const QString &fileName, QObject *parent = nullptr);
+    ~SaveHistoryThread() Q_DECL_OVERRIDE;
+
+    /** Queues @p block to be saved */
+    void addBlock(const LineBlock &block);
+
+    /** Returns the number of blocks which have been added but not saved yet */
+    int pendingBlocks() const;
+
+    /**
+     * Ends the output once the blocks which were added are saved.  The file
+     * only replaces an existing one when the thread finishes successfully.
+     */
+    void finish();
+
+    /**
+     * Stops saving as soon as possible.  Blocks which have not been saved
+     * yet are dropped and an existing file is left as it was.
+     */
+    void cancel();
+
+    /** Returns the number of bytes of output saved so far */
+    qint64 bytesSaved() const;
+
+    /** Returns the reason why saving failed, or an empty string */
+    QString errorString() const;
+
+Q_SIGNALS:
+    /**
+     * Emitted when a block has been saved.
+     *
+     * @param lineCount The number of lines in the block, 0 for the end of
+     * the output
+     * @param data The encoded output of the block if no file name was given,
+     * otherwise empty
+     */
+    void blockSaved(int lineCount, const QByteArray &data);
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    void setErrorString(const QString &errorString);
+
+    const Format _format;
+    const QString _fileName;
+
+    mutable QMutex _mutex;
+    QWaitCondition _blockAdded;
+    QQueue<LineBlock> _blocks;
+    // number of blocks taken from _blocks which are still being saved
+    int _blocksInProgress;
+    bool _finished;
+    qint64 _bytesSaved;
+    QString _errorString;
+    QAtomicInt _cancelled;
+};
+
+/**
+ * Copies the lines of a screen to save, in blocks for SaveHistoryThread.
+ *
+ * The lines to save are those which are in the output when the copy starts;
+ * lines which are added later are not saved.  The lines are followed when
+ * the history drops its oldest lines, in which case lines which were dropped
+ * before they were copied are lost, and when the lines of the history are
+ * rewrapped by Screen::reflowHistory().  Every block ends with the end of a
+ * logical line, so that the next one starts at the start of a line, which
+ * keeps its Screen::linePosition() when it is rewrapped.
+ */
+class KONSOLEPRIVATE_EXPORT SaveHistoryLines
+{
+public:
+    explicit SaveHistoryLines(const Screen *screen);
+
+    /**
+     * Copies the next @p lineCount lines to @p block, and the lines up to
+     * the end of the logical line of the last one.  The block is left empty
+     * if the lines were dropped from the history.
+     *
+     * Returns false, without copying anything, if the lines cannot be
+     * followed anymore: when the history was replaced or the number of
+     * columns changed, see Screen::historyId(), or when the changes made
+     * by rewrapping the history are not known anymore.
+     */
+    bool copyBlock(int lineCount, LineBlock &block);
+
+    /** Returns true once all of the lines to save were copied */
+    bool atEnd() const;
+
+    /**
+     * Returns the number of lines to save, including those copied already.
+     * The number changes when the history is rewrapped.
+     */
+    int lineCount() const;
+
+private:
+    bool followHistoryLayout();
+
+    const Screen *_screen;
+    // the Screen::historyId() when the copy started, and the
+    // Screen::historyLayoutId() which the line numbers below are for
+    int _historyId;
+    int _historyLayoutId;
+    // the lines are numbered as when the copy started, including the lines
+    // dropped from the history since
+    qint64 _droppedLines;
+    int _nextLine;
+    int _lastLine;
+    // the Screen::linePosition() of _nextLine when it is in the history
+    qint64 _nextPosition;
+    bool _nextLineInHistory;
+};
+}
+
+#endif // SAVEHISTORYTHREAD_H
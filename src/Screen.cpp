@@ -62,8 +62,18 @@ Screen::Screen(int lines, int columns):
     _scrolledLines(0),
     _lastScrolledRegion(QRect()),
     _droppedLines(0),
+    _totalDroppedLines(0),
+    _historyId(0),
+    _historyLayoutId(0),
+    _historyLayoutChanges(),
+    _lineChanges(_lines + 1, 0),
+    _changeCount(0),
+    _allLinesChanged(0),
     _lineProperties(QVarLengthArray<LineProperty, 64>()),
     _history(new HistoryScrollNone()),
+    _historyReflow(),
+    _reflowLines(false),
+    _searchIndex(),
     _cuX(0),
     _cuY(0),
     _currentForeground(CharacterColor()),
@@ -87,6 +97,8 @@ Screen::Screen(int lines, int columns):
         _lineProperties[i] = LINE_DEFAULT;
     }
 
+    _historyReflow.setHistory(_history);
+
     initTabStops();
     clearSelection();
     reset();
@@ -227,6 +239,7 @@ void Screen::deleteChars(int n)
     Q_ASSERT(_cuX + n <= _screenLines[_cuY].count());
 
     _screenLines[_cuY].remove(_cuX, n);
+    setLineChanged(_cuY);
 
     // Append space(s) with current attributes
     Character spaceWithCurrentAttrs(' ', _effectiveForeground,
@@ -249,6 +262,7 @@ void Screen::insertChars(int n)
     }
 
     _screenLines[_cuY].insert(_cuX, n, Character(' '));
+    setLineChanged(_cuY);
 
     if (_screenLines[_cuY].count() > _columns) {
         _screenLines[_cuY].resize(_columns);
@@ -297,6 +311,9 @@ void Screen::setMode(int m)
         _cuX = 0;
         _cuY = _topMargin;
         break; //FIXME: home
+    case MODE_Screen :
+        setAllLinesChanged();
+        break;
     }
 }
 
@@ -308,6 +325,9 @@ void Screen::resetMode(int m)
         _cuX = 0;
         _cuY = 0;
         break; //FIXME: home
+    case MODE_Screen :
+        setAllLinesChanged();
+        break;
     }
 }
 
@@ -319,6 +339,9 @@ void Screen::saveMode(int m)
 void Screen::restoreMode(int m)
 {
     _currentModes[m] = _savedModes[m];
+    if (m == MODE_Screen) {
+        setAllLinesChanged();
+    }
 }
 
 bool Screen::getMode(int m) const
@@ -351,6 +374,10 @@ void Screen::resizeImage(int new_lines, int new_columns)
         return;
     }
 
+    if (_reflowLines && new_columns != _columns) {
+        reflowScreen(new_columns);
+    }
+
     if (_cuY > new_lines - 1) {
         // attempt to preserve focus and _lines
         _bottomMargin = _lines - 1; //FIXME: margin lost
@@ -372,6 +399,9 @@ void Screen::resizeImage(int new_lines, int new_columns)
         _lineProperties[i] = LINE_DEFAULT;
     }
 
+    _lineChanges.resize(new_lines + 1);
+    setAllLinesChanged();
+
     clearSelection();
 
     delete[] _screenLines;
@@ -390,6 +420,184 @@ void Screen::resizeImage(int new_lines, int new_columns)
     clearSelection();
 }
 
+void Screen::reflowScreen(int new_columns)
+{
+    clearSelection();
+
+    // the lines after the cursor are only kept if they are not empty
+    int lastLine = _cuY;
+    for (int line = _lines - 1; line > _cuY; line--) {
+        if (!_screenLines[line].isEmpty()) {
+            lastLine = line;
+            break;
+        }
+    }
+
+    QVector<ImageLine> newLines;
+    QVector<LineProperty> newProperties;
+    int cursorX = 0;
+    int cursorY = 0;
+
+    int line = 0;
+    while (line <= lastLine) {
+        const LineProperty properties = _lineProperties[line];
+
+        // double width or height lines are kept as they are
+        if ((properties & (LINE_DOUBLEWIDTH | LINE_DOUBLEHEIGHT)) != 0) {
+            if (line == _cuY) {
+                cursorX = _cuX;
+                cursorY = newLines.size();
+            }
+            newLines.append(_screenLines[line]);
+            newProperties.append(static_cast<LineProperty>(properties & ~LINE_WRAPPED));
+            line++;
+            continue;
+        }
+
+        // join the line and the lines it wraps to
+        ImageLine logicalLine;
+        int cursorPosition = -1;
+        int end = line;
+        forever {
+            if (end == _cuY) {
+                cursorPosition = logicalLine.size() + _cuX;
+            }
+            logicalLine += _screenLines[end];
+            if ((_lineProperties[end] & LINE_WRAPPED) == 0 || end == lastLine) {
+                break;
+            }
+            end++;
+        }
+        const bool wrapped = (_lineProperties[end] & LINE_WRAPPED) != 0;
+
+        // trailing blanks are dropped, unless the cursor is after them
+        int length = logicalLine.size();
+        while (length > 0 && length > cursorPosition && logicalLine.at(length - 1) == Screen::DefaultChar) {
+            length--;
+        }
+        logicalLine.resize(length);
+        while (logicalLine.size() < cursorPosition) {
+            logicalLine.append(Screen::DefaultChar);
+        }
+        length = logicalLine.size();
+
+        int position = 0;
+        do {
+            int count = qMin(new_columns, length - position);
+
+            // double width characters are not split between two lines
+            if (count == new_columns && count > 1 && position + count < length) {
+                const Character &last = logicalLine.at(position + count - 1);
+                if ((last.rendition & RE_EXTENDED_CHAR) == 0 && konsole_wcwidth(last.character) == 2) {
+                    count--;
+                }
+            }
+
+            if (cursorPosition >= position && (cursorPosition < position + count || position + count == length)) {
+                cursorX = cursorPosition - position;
+                cursorY = newLines.size();
+            }
+
+            newLines.append(logicalLine.mid(position, count));
+            position += count;
+            const bool lineWrapped = position < length || wrapped;
+            newProperties.append(static_cast<LineProperty>(lineWrapped ? LINE_WRAPPED : LINE_DEFAULT));
+        } while (position < length);
+
+        line = end + 1;
+    }
+
+    // the lines of the history are rewrapped when they come into view, the
+    // lines which do not fit on the screen anymore are added with the new
+    // width already
+    _historyReflow.setColumns(new_columns);
+    _historyId++;
+    _historyLayoutChanges.clear();
+
+    const int excess = qMax(0, newLines.size() - _lines);
+    for (int i = 0; i < excess; i++) {
+        _screenLines[0] = newLines.at(i);
+        _lineProperties[0] = newProperties.at(i);
+        addHistLine();
+    }
+
+    for (int i = 0; i < _lines; i++) {
+        if (excess + i < newLines.size()) {
+            _screenLines[i] = newLines.at(excess + i);
+            _lineProperties[i] = newProperties.at(excess + i);
+        } else {
+            _screenLines[i].clear();
+            _lineProperties[i] = LINE_DEFAULT;
+        }
+    }
+
+    _cuX = cursorX;
+    _cuY = qMax(0, cursorY - excess);
+    _lastPos = -1;
+}
+
+void Screen::setReflowLines(bool enable)
+{
+    _reflowLines = enable;
+}
+
+bool Screen::reflowLines() const
+{
+    return _reflowLines;
+}
+
+bool Screen::reflowHistory(int startLine, int endLine)
+{
+    // keep the selection on the same lines
+    const bool hasSelection = _selBegin != -1;
+    const bool beginIsTL = (_selBegin == _selTopLeft);
+    const qint64 topLeft = hasSelection ? linePosition(_selTopLeft / _columns) : 0;
+    const qint64 bottomRight = hasSelection ? linePosition(_selBottomRight / _columns) : 0;
+
+    QVector<HistoryReflow::LineChange> changes;
+    if (!_historyReflow.reflow(startLine, qMin(endLine, _historyReflow.getLines() - 1), &changes)) {
+        return false;
+    }
+
+    _historyLayoutId++;
+    foreach (HistoryReflow::LineChange change, changes) {
+        change.firstLine += _totalDroppedLines;
+        const HistoryLayoutChange layoutChange = {_historyLayoutId, change};
+        _historyLayoutChanges.append(layoutChange);
+    }
+    if (_historyLayoutChanges.size() > MAX_HISTORY_LAYOUT_CHANGES) {
+        _historyLayoutChanges.remove(0, _historyLayoutChanges.size() - MAX_HISTORY_LAYOUT_CHANGES);
+    }
+
+    if (hasSelection) {
+        _selTopLeft = loc(_selTopLeft % _columns, lineAtPosition(topLeft));
+        _selBottomRight = loc(_selBottomRight % _columns, lineAtPosition(bottomRight));
+        _selBegin = beginIsTL ? _selTopLeft : _selBottomRight;
+    }
+
+    return true;
+}
+
+qint64 Screen::linePosition(int line) const
+{
+    const int historyLines = _historyReflow.getLines();
+    if (line < historyLines) {
+        return _historyReflow.position(line);
+    }
+
+    // the lines of the screen are not rewrapped by reflowHistory(), they
+    // are counted from the first one
+    return -1 - (line - historyLines);
+}
+
+int Screen::lineAtPosition(qint64 position) const
+{
+    if (position < 0) {
+        return _historyReflow.getLines() + int(-1 - position);
+    }
+    return _historyReflow.line(position);
+}
+
 void Screen::setDefaultMargins()
 {
     _topMargin = 0;
@@ -450,13 +658,13 @@ void Screen::updateEffectiveRendition()
 
 void Screen::copyFromHistory(Character* dest, int startLine, int count) const
 {
-    Q_ASSERT(startLine >= 0 && count > 0 && startLine + count <= _history->getLines());
+    Q_ASSERT(startLine >= 0 && count > 0 && startLine + count <= _historyReflow.getLines());
 
     for (int line = startLine; line < startLine + count; line++) {
-        const int length = qMin(_columns, _history->getLineLen(line));
+        const int length = qMin(_columns, _historyReflow.getLineLen(line));
         const int destLineOffset  = (line - startLine) * _columns;
 
-        _history->getCells(line, 0, length, dest + destLineOffset);
+        _historyReflow.getCells(line, 0, length, dest + destLineOffset);
 
         for (int column = length; column < _columns; column++) {
             dest[destLineOffset + column] = Screen::DefaultChar;
@@ -488,7 +696,7 @@ void Screen::copyFromScreen(Character* dest , int startLine , int count) const
             dest[destIndex] = _screenLines[srcIndex / _columns].value(srcIndex % _columns, Screen::DefaultChar);
 
             // invert selected text
-            if (_selBegin != -1 && isSelected(column, line + _history->getLines())) {
+            if (_selBegin != -1 && isSelected(column, line + _historyReflow.getLines())) {
                 reverseRendition(dest[destIndex]);
             }
         }
@@ -498,14 +706,14 @@ void Screen::copyFromScreen(Character* dest , int startLine , int count) const
 void Screen::getImage(Character* dest, int size, int startLine, int endLine) const
 {
     Q_ASSERT(startLine >= 0);
-    Q_ASSERT(endLine >= startLine && endLine < _history->getLines() + _lines);
+    Q_ASSERT(endLine >= startLine && endLine < _historyReflow.getLines() + _lines);
 
     const int mergedLines = endLine - startLine + 1;
 
     Q_ASSERT(size >= mergedLines * _columns);
     Q_UNUSED(size);
 
-    const int linesInHistoryBuffer = qBound(0, _history->getLines() - startLine, mergedLines);
+    const int linesInHistoryBuffer = qBound(0, _historyReflow.getLines() - startLine, mergedLines);
     const int linesInScreenBuffer = mergedLines - linesInHistoryBuffer;
 
     // copy _lines from history buffer
@@ -516,7 +724,7 @@ void Screen::getImage(Character* dest, int size, int startLine, int endLine) con
     // copy _lines from screen buffer
     if (linesInScreenBuffer > 0) {
         copyFromScreen(dest + linesInHistoryBuffer * _columns,
-                       startLine + linesInHistoryBuffer - _history->getLines(),
+                       startLine + linesInHistoryBuffer - _historyReflow.getLines(),
                        linesInScreenBuffer);
     }
 
@@ -529,19 +737,56 @@ void Screen::getImage(Character* dest, int size, int startLine, int endLine) con
 
     int visX = qMin(_cuX, _columns - 1);
     // mark the character at the current cursor position
-    int cursorIndex = loc(visX, _cuY + linesInHistoryBuffer);
-    if (getMode(MODE_Cursor) && cursorIndex < _columns * mergedLines) {
-        dest[cursorIndex].rendition |= RE_CURSOR;
+    const int cursorLine = _historyReflow.getLines() + _cuY - startLine;
+    if (getMode(MODE_Cursor) && cursorLine >= 0 && cursorLine < mergedLines) {
+        dest[loc(visX, cursorLine)].rendition |= RE_CURSOR;
+    }
+}
+
+void Screen::copyLines(int startLine, int endLine, LineBlock &block) const
+{
+    const int historyLines = _historyReflow.getLines();
+    endLine = qMin(endLine, historyLines + _lines - 1);
+
+    block.firstLine = startLine;
+    block.cells.clear();
+    block.lineEnds.clear();
+    block.lineProperties.clear();
+
+    for (int line = qMax(0, startLine); line <= endLine; line++) {
+        LineProperty properties = 0;
+        const int start = block.cells.size();
+
+        if (line < historyLines) {
+            const int lineLength = _historyReflow.getLineLen(line);
+            block.cells.resize(start + lineLength);
+            _historyReflow.getCells(line, 0, lineLength, block.cells.data() + start);
+
+            if (_historyReflow.isWrappedLine(line)) {
+                properties |= LINE_WRAPPED;
+            }
+        } else {
+            const int screenLine = line - historyLines;
+            block.cells += _screenLines[screenLine];
+            properties |= _lineProperties[screenLine];
+        }
+
+        if ((properties & LINE_WRAPPED) == 0) {
+            block.cells.append(Character('\n'));
+        }
+
+        block.lineEnds.append(block.cells.size());
+        block.lineProperties.append(properties);
     }
 }
 
 QVector<LineProperty> Screen::getLineProperties(int startLine , int endLine) const
 {
     Q_ASSERT(startLine >= 0);
-    Q_ASSERT(endLine >= startLine && endLine < _history->getLines() + _lines);
+    Q_ASSERT(endLine >= startLine && endLine < _historyReflow.getLines() + _lines);
 
     const int mergedLines = endLine - startLine + 1;
-    const int linesInHistory = qBound(0, _history->getLines() - startLine, mergedLines);
+    const int linesInHistory = qBound(0, _historyReflow.getLines() - startLine, mergedLines);
     const int linesInScreen = mergedLines - linesInHistory;
 
     QVector<LineProperty> result(mergedLines);
@@ -550,14 +795,14 @@ QVector<LineProperty> Screen::getLineProperties(int startLine , int endLine) con
     // copy properties for _lines in history
     for (int line = startLine; line < startLine + linesInHistory; line++) {
         //TODO Support for line properties other than wrapped _lines
-        if (_history->isWrappedLine(line)) {
+        if (_historyReflow.isWrappedLine(line)) {
             result[index] = static_cast<LineProperty>(result[index] | LINE_WRAPPED);
         }
         index++;
     }
 
     // copy properties for _lines in screen buffer
-    const int firstScreenLine = startLine + linesInHistory - _history->getLines();
+    const int firstScreenLine = startLine + linesInHistory - _historyReflow.getLines();
     for (int line = firstScreenLine; line < firstScreenLine + linesInScreen; line++) {
         result[index] = _lineProperties[line];
         index++;
@@ -602,6 +847,7 @@ void Screen::backspace()
 
     if (_screenLines[_cuY].size() < _cuX + 1) {
         _screenLines[_cuY].resize(_cuX + 1);
+        setLineChanged(_cuY);
     }
 }
 
@@ -677,7 +923,7 @@ void Screen::checkSelection(int from, int to)
     if (_selBegin == -1) {
         return;
     }
-    const int scr_TL = loc(0, _history->getLines());
+    const int scr_TL = loc(0, _historyReflow.getLines());
     //Clear entire selection if it overlaps region [from, to]
     if ((_selBottomRight >= (from + scr_TL)) && (_selTopLeft <= (to + scr_TL))) {
         clearSelection();
@@ -722,6 +968,7 @@ void Screen::displayCharacter(uint c)
         } while(!_screenLines[charToCombineWithY][charToCombineWithX].isRealCharacter);
 
         Character& currentChar = _screenLines[charToCombineWithY][charToCombineWithX];
+        setLineChanged(charToCombineWithY);
         if ((currentChar.rendition & RE_EXTENDED_CHAR) == 0) {
             const uint chars[2] = { currentChar.character, c };
             currentChar.rendition |= RE_EXTENDED_CHAR;
@@ -767,6 +1014,7 @@ void Screen::displayCharacter(uint c)
     checkSelection(_lastPos, _lastPos);
 
     Character& currentChar = _screenLines[_cuY][_cuX];
+    setLineChanged(_cuY);
 
     currentChar.character = c;
     currentChar.foregroundColor = _effectiveForeground;
@@ -797,6 +1045,69 @@ void Screen::displayCharacter(uint c)
     _cuX = newCursorX;
 }
 
+// returns true if @p c takes exactly one column on the screen
+static inline bool isSingleWidth(uint c)
+{
+    // printable ASCII, by far the most common, does not need a lookup
+    return (c >= 0x20 && c < 0x7f) || konsole_wcwidth(c) == 1;
+}
+
+void Screen::displayCharacters(const uint *chars, int count)
+{
+    int i = 0;
+    while (i < count) {
+        // wide characters, combining characters and insert mode are rare
+        // enough to be handled one character at a time
+        if (!isSingleWidth(chars[i]) || getMode(MODE_Insert)) {
+            displayCharacter(chars[i]);
+            i++;
+            continue;
+        }
+
+        if (_cuX >= _columns) {
+            if (!getMode(MODE_Wrap)) {
+                // the character replaces the one in the last column
+                displayCharacter(chars[i]);
+                i++;
+                continue;
+            }
+            _lineProperties[_cuY] = static_cast<LineProperty>(_lineProperties[_cuY] | LINE_WRAPPED);
+            nextLine();
+        }
+
+        // the run of single column characters which fits on the current line
+        const int room = _columns - _cuX;
+        int end = i + 1;
+        while (end < count && end - i < room && isSingleWidth(chars[end])) {
+            end++;
+        }
+        const int length = end - i;
+
+        ImageLine &line = _screenLines[_cuY];
+        if (line.size() < _cuX + length) {
+            line.resize(_cuX + length);
+        }
+
+        // check if selection is still valid.
+        checkSelection(loc(_cuX, _cuY), loc(_cuX + length - 1, _cuY));
+
+        setLineChanged(_cuY);
+        Character *cell = line.data() + _cuX;
+        for (int j = 0; j < length; j++) {
+            cell[j].character = chars[i + j];
+            cell[j].foregroundColor = _effectiveForeground;
+            cell[j].backgroundColor = _effectiveBackground;
+            cell[j].rendition = _effectiveRendition;
+            cell[j].isRealCharacter = true;
+        }
+
+        _cuX += length;
+        _lastPos = loc(_cuX - 1, _cuY);
+        _lastDrawnChar = chars[end - 1];
+        i = end;
+    }
+}
+
 int Screen::scrolledLines() const
 {
     return _scrolledLines;
@@ -809,6 +1120,57 @@ void Screen::resetDroppedLines()
 {
     _droppedLines = 0;
 }
+qint64 Screen::totalDroppedLines() const
+{
+    return _totalDroppedLines;
+}
+int Screen::historyId() const
+{
+    return _historyId;
+}
+int Screen::historyLayoutId() const
+{
+    return _historyLayoutId;
+}
+bool Screen::historyLayoutChanges(int layoutId, QVector<HistoryReflow::LineChange> &changes) const
+{
+    if (layoutId == _historyLayoutId) {
+        return true;
+    }
+
+    // the changes which led to layoutId + 1 must still be there
+    if (_historyLayoutChanges.isEmpty() || _historyLayoutChanges.first().layoutId > layoutId + 1
+            || (_historyLayoutChanges.first().layoutId == layoutId + 1 && _historyLayoutChanges.size() == MAX_HISTORY_LAYOUT_CHANGES)) {
+        return false;
+    }
+
+    foreach (const HistoryLayoutChange &layoutChange, _historyLayoutChanges) {
+        if (layoutChange.layoutId > layoutId) {
+            changes.append(layoutChange.change);
+        }
+    }
+    return true;
+}
+quint64 Screen::changeCount() const
+{
+    return _changeCount;
+}
+bool Screen::lineChangedSince(int line, quint64 count) const
+{
+    return qMax(_lineChanges.at(line), _allLinesChanged) > count;
+}
+bool Screen::allLinesChangedSince(quint64 count) const
+{
+    return _allLinesChanged > count;
+}
+void Screen::setLineChanged(int line)
+{
+    _lineChanges[line] = ++_changeCount;
+}
+void Screen::setAllLinesChanged()
+{
+    _allLinesChanged = ++_changeCount;
+}
 void Screen::resetScrolledLines()
 {
     _scrolledLines = 0;
@@ -917,7 +1279,7 @@ int Screen::getCursorY() const
 
 void Screen::clearImage(int loca, int loce, char c)
 {
-    const int scr_TL = loc(0, _history->getLines());
+    const int scr_TL = loc(0, _historyReflow.getLines());
     //FIXME: check positions
 
     //Clear entire selection if it overlaps region to be moved...
@@ -936,6 +1298,7 @@ void Screen::clearImage(int loca, int loce, char c)
 
     for (int y = topLine; y <= bottomLine; y++) {
         _lineProperties[y] = 0;
+        setLineChanged(y);
 
         const int endCol = (y == bottomLine) ? loce % _columns : _columns - 1;
         const int startCol = (y == topLine) ? loca % _columns : 0;
@@ -972,11 +1335,13 @@ void Screen::moveImage(int dest, int sourceBegin, int sourceEnd)
         for (int i = 0; i <= lines; i++) {
             _screenLines[(dest / _columns) + i ] = _screenLines[(sourceBegin / _columns) + i ];
             _lineProperties[(dest / _columns) + i] = _lineProperties[(sourceBegin / _columns) + i];
+            setLineChanged((dest / _columns) + i);
         }
     } else {
         for (int i = lines; i >= 0; i--) {
             _screenLines[(dest / _columns) + i ] = _screenLines[(sourceBegin / _columns) + i ];
             _lineProperties[(dest / _columns) + i] = _lineProperties[(sourceBegin / _columns) + i];
+            setLineChanged((dest / _columns) + i);
         }
     }
 
@@ -992,7 +1357,7 @@ void Screen::moveImage(int dest, int sourceBegin, int sourceEnd)
     if (_selBegin != -1) {
         const bool beginIsTL = (_selBegin == _selTopLeft);
         const int diff = dest - sourceBegin; // Scroll by this amount
-        const int scr_TL = loc(0, _history->getLines());
+        const int scr_TL = loc(0, _historyReflow.getLines());
         const int srca = sourceBegin + scr_TL; // Translate index from screen to global
         const int srce = sourceEnd + scr_TL; // Translate index from screen to global
         const int desta = srca + diff;
@@ -1115,6 +1480,10 @@ void Screen::setBackColor(int space, int color)
 
 void Screen::clearSelection()
 {
+    if (_selBegin != -1) {
+        setAllLinesChanged();
+    }
+
     _selBottomRight = -1;
     _selTopLeft = -1;
     _selBegin = -1;
@@ -1151,6 +1520,8 @@ void Screen::setSelectionStart(const int x, const int y, const bool blockSelecti
     _selBottomRight = _selBegin;
     _selTopLeft = _selBegin;
     _blockSelectionMode = blockSelectionMode;
+
+    setAllLinesChanged();
 }
 
 void Screen::setSelectionEnd(const int x, const int y)
@@ -1184,6 +1555,8 @@ void Screen::setSelectionEnd(const int x, const int y)
         _selTopLeft = loc(qMin(topColumn, bottomColumn), topRow);
         _selBottomRight = loc(qMax(topColumn, bottomColumn), bottomRow);
     }
+
+    setAllLinesChanged();
 }
 
 bool Screen::isSelected(const int x, const int y) const
@@ -1307,8 +1680,8 @@ int Screen::copyLineToStream(int line ,
     LineProperty currentLineProperties = 0;
 
     //determine if the line is in the history buffer or the screen image
-    if (line < _history->getLines()) {
-        const int lineLength = _history->getLineLen(line);
+    if (line < _historyReflow.getLines()) {
+        const int lineLength = _historyReflow.getLineLen(line);
 
         // ensure that start position is before end of line
         start = qMin(start, qMax(0, lineLength - 1));
@@ -1325,11 +1698,11 @@ int Screen::copyLineToStream(int line ,
         // safety checks
         Q_ASSERT(start >= 0);
         Q_ASSERT(count >= 0);
-        Q_ASSERT((start + count) <= _history->getLineLen(line));
+        Q_ASSERT((start + count) <= _historyReflow.getLineLen(line));
 
-        _history->getCells(line, start, count, characterBuffer);
+        _historyReflow.getCells(line, start, count, characterBuffer);
 
-        if (_history->isWrappedLine(line)) {
+        if (_historyReflow.isWrappedLine(line)) {
             currentLineProperties |= LINE_WRAPPED;
         }
     } else {
@@ -1339,7 +1712,7 @@ int Screen::copyLineToStream(int line ,
 
         Q_ASSERT(count >= 0);
 
-        int screenLine = line - _history->getLines();
+        int screenLine = line - _historyReflow.getLines();
 
         // FIXME: This can be triggered when clearing history
         //  while having the searchbar open and selecting next/prev
@@ -1425,19 +1798,30 @@ void Screen::addHistLine()
     // we have to take care about scrolling, too...
 
     if (hasScroll()) {
-        const int oldHistLines = _history->getLines();
+        const int oldHistLines = _historyReflow.getLines();
+        const int oldBufferLines = _history->getLines();
 
+        const bool wrapped = (_lineProperties[0] & LINE_WRAPPED) != 0;
         _history->addCellsVector(_screenLines[0]);
-        _history->addLine((_lineProperties[0] & LINE_WRAPPED) != 0);
+        _history->addLine(wrapped);
+
+        // the history buffer is full if it dropped its first line
+        if (_history->getLines() == oldBufferLines) {
+            _historyReflow.removeFirstLine();
+            _searchIndex.removeFirstLine();
+        }
+        _searchIndex.addLine(_screenLines[0].constData(), _screenLines[0].size(), wrapped);
 
-        const int newHistLines = _history->getLines();
+        const int newHistLines = _historyReflow.getLines();
 
         const bool beginIsTL = (_selBegin == _selTopLeft);
 
         // If the history is full, increment the count
-        // of dropped _lines
-        if (newHistLines == oldHistLines) {
-            _droppedLines++;
+        // of dropped _lines.  The dropped line may have been
+        // rewrapped to several lines.
+        if (newHistLines <= oldHistLines) {
+            _droppedLines += oldHistLines + 1 - newHistLines;
+            _totalDroppedLines += oldHistLines + 1 - newHistLines;
         }
 
         // Adjust selection for the new point of reference
@@ -1479,7 +1863,7 @@ void Screen::addHistLine()
 
 int Screen::getHistLines() const
 {
-    return _history->getLines();
+    return _historyReflow.getLines();
 }
 
 void Screen::setScroll(const HistoryType& t , bool copyPreviousScroll)
@@ -1493,6 +1877,15 @@ void Screen::setScroll(const HistoryType& t , bool copyPreviousScroll)
         _history = t.scroll(nullptr);
         delete oldScroll;
     }
+
+    _totalDroppedLines = 0;
+    _historyId++;
+    _historyLayoutChanges.clear();
+
+    // the lines copied from the previous history buffer are not rewrapped
+    // nor indexed
+    _historyReflow.setHistory(_history);
+    _searchIndex.reset(_history->getLines());
 }
 
 bool Screen::hasScroll() const
@@ -1500,6 +1893,23 @@ bool Screen::hasScroll() const
     return _history->hasScroll();
 }
 
+void Screen::flushHistory()
+{
+    _history->flush();
+}
+
+bool Screen::historyMayContain(int startLine, int endLine, const QString &text) const
+{
+    // the index knows the lines of the history buffer, a rewrapped line may
+    // end on the history line where the next one starts
+    const int lastLine = _historyReflow.getLines() - 1;
+    const int startHistoryLine = _historyReflow.sourceLine(qBound(0, startLine, lastLine));
+    const int endHistoryLine = endLine < lastLine ? _historyReflow.sourceLine(endLine + 1)
+                                                  : _history->getLines() - 1;
+
+    return _searchIndex.mayContain(startHistoryLine, endHistoryLine, text);
+}
+
 const HistoryType& Screen::getScroll() const
 {
     return _history->getType();
@@ -1512,6 +1922,7 @@ void Screen::setLineProperty(LineProperty property , bool enable)
     } else {
         _lineProperties[_cuY] = static_cast<LineProperty>(_lineProperties[_cuY] & ~property);
     }
+    setLineChanged(_cuY);
 }
 void Screen::fillWithDefaultChar(Character* dest, int count)
 {
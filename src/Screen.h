@@ -32,6 +32,8 @@
 
 // Konsole
 #include "Character.h"
+#include "HistoryReflow.h"
+#include "HistorySearchIndex.h"
 
 #define MODE_Origin    0
 #define MODE_Wrap      1
@@ -47,6 +49,35 @@ class TerminalDisplay;
 class HistoryType;
 class HistoryScroll;
 
+/**
+ * A copy of a range of lines of a Screen's output, see Screen::copyLines().
+ *
+ * The copy does not change when the screen does, so it can be decoded
+ * at leisure, including from another thread.
+ */
+struct LineBlock {
+    /** The number of the first line in the block, as in Screen::copyLines() */
+    int firstLine;
+    /** The cells of all lines in the block, one line after the other */
+    QVector<Character> cells;
+    /** The position in cells after the last cell of each line */
+    QVector<int> lineEnds;
+    /** The properties of each line */
+    QVector<LineProperty> lineProperties;
+
+    /** Returns the number of lines in the block */
+    int lineCount() const
+    {
+        return lineEnds.size();
+    }
+
+    /** Returns the position in cells of the first cell of line @p index */
+    int lineStart(int index) const
+    {
+        return index == 0 ? 0 : lineEnds.at(index - 1);
+    }
+};
+
 /**
     \brief An image of characters with associated attributes.
 
@@ -362,6 +393,15 @@ public:
      */
     void displayCharacter(uint c);
 
+    /**
+     * Displays @p count characters at the current cursor position, as
+     * displayCharacter() would do for each of them.
+     *
+     * Characters which take a single column are written a whole run at a
+     * time, which is much faster for plain text.
+     */
+    void displayCharacters(const uint *chars, int count);
+
     /**
      * Resizes the image to a new fixed size of @p new_lines by @p new_columns.
      * In the case that @p new_columns is smaller than the current number of columns,
@@ -371,9 +411,37 @@ public:
      * The top and bottom margins are reset to the top and bottom of the new
      * screen size.  Tab stops are also reset and the current selection is
      * cleared.
+     *
+     * If reflowLines() is enabled and the number of columns changes, wrapped
+     * lines are joined and wrapped again to the new width.  Lines of the
+     * screen are rewrapped at once, those of the history when they come into
+     * view, see reflowHistory().
      */
     void resizeImage(int new_lines, int new_columns);
 
+    /** Sets whether wrapped lines are rewrapped when the number of columns changes */
+    void setReflowLines(bool enable);
+    bool reflowLines() const;
+
+    /**
+     * Rewraps the lines of the history from @p startLine to @p endLine which
+     * were not rewrapped yet after the number of columns changed.  Returns
+     * true if the lines of the history changed; the history lines are
+     * numbered differently afterwards, and historyLayoutId() changes.
+     *
+     * Only a limited number of lines are rewrapped per call.
+     */
+    bool reflowHistory(int startLine, int endLine);
+
+    /**
+     * Returns a position which identifies @p line, numbered as for
+     * getImage().  Unlike the line number, the position stays valid when
+     * the lines of the history are rewrapped.  See lineAtPosition()
+     */
+    qint64 linePosition(int line) const;
+    /** Returns the line at @p position.  See linePosition() */
+    int lineAtPosition(qint64 position) const;
+
     /**
      * Returns the current screen image.
      * The result is an array of Characters of size [getLines()][getColumns()] which
@@ -394,6 +462,17 @@ public:
      */
     QVector<LineProperty> getLineProperties(int startLine, int endLine) const;
 
+    /**
+     * Copies lines @p startLine to @p endLine (inclusive) into @p block.
+     * Lines are numbered as for writeLinesToStream(), 0 being the first line
+     * in the history; lines past the end of the screen are ignored.
+     *
+     * Each line keeps its full length, and a '\n' character is appended to
+     * lines which are not wrapped, as writeLinesToStream() does, so decoding
+     * the lines of the block yields the same text.
+     */
+    void copyLines(int startLine, int endLine, LineBlock &block) const;
+
     /** Return the number of lines. */
     int getLines() const
     {
@@ -421,6 +500,17 @@ public:
      * in a history buffer.
      */
     bool hasScroll() const;
+    /**
+     * Writes history lines which are still buffered in memory to the
+     * history's backing storage.
+     */
+    void flushHistory();
+    /**
+     * Returns false if the index of the history, see HistorySearchIndex,
+     * tells that none of the lines of the history from @p startLine to
+     * @p endLine can contain @p text.  Returns true if some of them may.
+     */
+    bool historyMayContain(int startLine, int endLine, const QString &text) const;
 
     /**
      * Sets the start of the selection.
@@ -565,6 +655,59 @@ public:
      */
     void resetDroppedLines();
 
+    /**
+     * Returns the number of lines of output which have been dropped
+     * from the history since it was set with setScroll().  Unlike
+     * droppedLines() this count is never reset otherwise.
+     */
+    qint64 totalDroppedLines() const;
+
+    /**
+     * Returns a number which changes whenever the history is replaced
+     * with setScroll(), or the number of columns changes, after which the
+     * lines of the history may be numbered differently.
+     */
+    int historyId() const;
+
+    /**
+     * Returns a number which changes whenever lines of the history are
+     * rewrapped by reflowHistory(), after which the lines of the history
+     * are numbered differently.  The lines keep their linePosition().
+     */
+    int historyLayoutId() const;
+
+    /**
+     * Appends to @p changes how reflowHistory() renumbered the lines of the
+     * history since historyLayoutId() returned @p layoutId.  The first line
+     * of each change is counted from the first line added to the history,
+     * including the lines dropped since, see totalDroppedLines().
+     *
+     * Returns false if the changes are not known anymore, because there
+     * were too many since, or the history was replaced.
+     */
+    bool historyLayoutChanges(int layoutId, QVector<HistoryReflow::LineChange> &changes) const;
+
+    /**
+     * Returns a number which increases whenever a line of the screen
+     * changes, to be passed to lineChangedSince() later.
+     */
+    quint64 changeCount() const;
+
+    /**
+     * Returns true if @p line of the screen (the first line of the screen
+     * being 0) may have changed since changeCount() returned @p count.
+     *
+     * The cursor is not part of the lines, moving it does not change them.
+     */
+    bool lineChangedSince(int line, quint64 count) const;
+
+    /**
+     * Returns true if everything shown may have changed since changeCount()
+     * returned @p count, including the lines of the history, e.g. because
+     * the selection or the screen mode (MODE_Screen) changed.
+     */
+    bool allLinesChangedSince(quint64 count) const;
+
     /**
       * Fills the buffer @p dest with @p count instances of the default (ie. blank)
       * Character style.
@@ -633,6 +776,14 @@ private:
 
     void addHistLine();
 
+    // rewraps the lines of the screen to @p new_columns, moving the lines
+    // which do not fit anymore to the history
+    void reflowScreen(int new_columns);
+
+    // records that a line or all the lines of the screen changed
+    void setLineChanged(int line);
+    void setAllLinesChanged();
+
     void initTabStops();
 
     void updateEffectiveRendition();
@@ -662,11 +813,34 @@ private:
     QRect _lastScrolledRegion;
 
     int _droppedLines;
+    qint64 _totalDroppedLines;
+    int _historyId;
+    int _historyLayoutId;
+
+    // the latest changes made by reflowHistory(), with the historyLayoutId()
+    // they led to, see historyLayoutChanges()
+    struct HistoryLayoutChange
+    {
+        int layoutId;
+        HistoryReflow::LineChange change;
+    };
+    QVector<HistoryLayoutChange> _historyLayoutChanges;
+    static const int MAX_HISTORY_LAYOUT_CHANGES = 64;
+
+    // the change count when each line of the screen last changed, and when
+    // all of them did, see lineChangedSince()
+    QVector<quint64> _lineChanges;
+    quint64 _changeCount;
+    quint64 _allLinesChanged;
 
     QVarLengthArray<LineProperty, 64> _lineProperties;
 
     // history buffer ---------------
     HistoryScroll *_history;
+    // the lines of _history, rewrapped for the current number of columns
+    HistoryReflow _historyReflow;
+    bool _reflowLines;
+    HistorySearchIndex _searchIndex;
 
     // cursor location
     int _cuX;
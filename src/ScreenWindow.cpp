@@ -35,7 +35,19 @@ ScreenWindow::ScreenWindow(Screen *screen, QObject *parent) :
     _currentLine(0),
     _currentResultLine(-1),
     _trackOutput(true),
-    _scrollCount(0)
+    _scrollCount(0),
+    _historyId(0),
+    _historyLayoutId(0),
+    _currentLinePosition(0),
+    _bufferChangeCount(0),
+    _bufferCurrentLine(0),
+    _bufferColumns(0),
+    _bufferHistoryLines(0),
+    _bufferDroppedLines(0),
+    _bufferCursorLine(0),
+    _bufferCursorColumn(0),
+    _changedLines(),
+    _windows(nullptr)
 {
     setScreen(screen);
 }
@@ -50,6 +62,11 @@ void ScreenWindow::setScreen(Screen *screen)
     Q_ASSERT(screen);
 
     _screen = screen;
+    _bufferNeedsUpdate = true;
+
+    _historyId = _screen->historyId();
+    _historyLayoutId = _screen->historyLayoutId();
+    _currentLinePosition = _screen->linePosition(_currentLine + 1);
 }
 
 Screen *ScreenWindow::screen() const
@@ -57,10 +74,46 @@ Screen *ScreenWindow::screen() const
     return _screen;
 }
 
+void ScreenWindow::setWindows(const QList<ScreenWindow *> *windows)
+{
+    _windows = windows;
+}
+
+const ScreenWindow *ScreenWindow::findCurrentWindow() const
+{
+    if (_windows == nullptr) {
+        return nullptr;
+    }
+
+    foreach (const ScreenWindow *window, *_windows) {
+        if (window != this
+                && window->_screen == _screen
+                && window->_windowBuffer != nullptr
+                && !window->_bufferNeedsUpdate
+                && window->_windowBufferSize == _windowBufferSize
+                && window->windowLines() == windowLines()
+                && window->_bufferCurrentLine == currentLine()
+                && window->_bufferColumns == windowColumns()
+                && window->_bufferHistoryLines == _screen->getHistLines()
+                && window->_bufferDroppedLines == _screen->totalDroppedLines()
+                && window->_bufferChangeCount == _screen->changeCount()
+                && window->_bufferCursorLine == _screen->getCursorY()
+                && window->_bufferCursorColumn == _screen->getCursorX()) {
+            return window;
+        }
+    }
+
+    return nullptr;
+}
+
 Character *ScreenWindow::getImage()
 {
     // reallocate internal buffer if the window size has changed
     int size = windowLines() * windowColumns();
+    if (followHistoryLayout()) {
+        emit scrolled(_currentLine);
+    }
+
     if (_windowBuffer == nullptr || _windowBufferSize != size) {
         delete[] _windowBuffer;
         _windowBufferSize = size;
@@ -68,22 +121,86 @@ Character *ScreenWindow::getImage()
         _bufferNeedsUpdate = true;
     }
 
-    if (!_bufferNeedsUpdate) {
-        return _windowBuffer;
-    }
+    // views of the same session usually show the same lines, which then
+    // only need to be copied out of the screen once
+    const ScreenWindow *window = findCurrentWindow();
+
+    if (!_bufferNeedsUpdate
+            && !_screen->allLinesChangedSince(_bufferChangeCount)
+            && currentLine() == _bufferCurrentLine
+            && windowColumns() == _bufferColumns
+            && _screen->getHistLines() == _bufferHistoryLines
+            && _screen->totalDroppedLines() == _bufferDroppedLines) {
+        updateChangedLines(window);
+    } else if (window != nullptr) {
+        memcpy((void *)_windowBuffer, (const void *)window->_windowBuffer, size * sizeof(Character));
+
+        _changedLines.fill(true, windowLines());
+        _bufferNeedsUpdate = false;
+    } else {
+        _screen->getImage(_windowBuffer, size,
+                          currentLine(), endWindowLine());
 
-    _screen->getImage(_windowBuffer, size,
-                      currentLine(), endWindowLine());
+        // this window may look beyond the end of the screen, in which
+        // case there will be an unused area which needs to be filled
+        // with blank characters
+        fillUnusedArea();
 
-    // this window may look beyond the end of the screen, in which
-    // case there will be an unused area which needs to be filled
-    // with blank characters
-    fillUnusedArea();
+        _changedLines.fill(true, windowLines());
+        _bufferNeedsUpdate = false;
+    }
+
+    _bufferChangeCount = _screen->changeCount();
+    _bufferCurrentLine = currentLine();
+    _bufferColumns = windowColumns();
+    _bufferHistoryLines = _screen->getHistLines();
+    _bufferDroppedLines = _screen->totalDroppedLines();
+    _bufferCursorLine = _screen->getCursorY();
+    _bufferCursorColumn = _screen->getCursorX();
 
-    _bufferNeedsUpdate = false;
     return _windowBuffer;
 }
 
+void ScreenWindow::updateChangedLines(const ScreenWindow *window)
+{
+    const int columns = windowColumns();
+    const int startLine = currentLine();
+    const int endLine = endWindowLine();
+    const int cursorLine = _screen->getCursorY();
+
+    // the window line showing the first line of the screen
+    const int screenStart = _screen->getHistLines() - startLine;
+
+    for (int line = qMax(0, screenStart); startLine + line <= endLine; line++) {
+        const int screenLine = line - screenStart;
+
+        // the lines where the cursor was and is are copied again to move it
+        if (screenLine != cursorLine && screenLine != _bufferCursorLine
+                && !_screen->lineChangedSince(screenLine, _bufferChangeCount)) {
+            continue;
+        }
+
+        if (window != nullptr) {
+            memcpy((void *)(_windowBuffer + line * columns), (const void *)(window->_windowBuffer + line * columns),
+                   columns * sizeof(Character));
+        } else {
+            _screen->getImage(_windowBuffer + line * columns, columns,
+                              startLine + line, startLine + line);
+        }
+        _changedLines.setBit(line);
+    }
+}
+
+bool ScreenWindow::isLineChanged(int line) const
+{
+    return line >= _changedLines.size() || _changedLines.testBit(line);
+}
+
+void ScreenWindow::resetChangedLines()
+{
+    _changedLines.fill(false);
+}
+
 void ScreenWindow::fillUnusedArea()
 {
     int screenEndLine = _screen->getHistLines() + _screen->getLines() - 1;
@@ -117,6 +234,10 @@ int ScreenWindow::endWindowLine() const
 
 QVector<LineProperty> ScreenWindow::getLineProperties()
 {
+    if (followHistoryLayout()) {
+        emit scrolled(_currentLine);
+    }
+
     QVector<LineProperty> result = _screen->getLineProperties(currentLine(), endWindowLine());
 
     if (result.count() != windowLines()) {
@@ -179,13 +300,24 @@ void ScreenWindow::clearSelection()
 {
     _screen->clearSelection();
 
+    _bufferNeedsUpdate = true;
     emit selectionChanged();
 }
 
 void ScreenWindow::setWindowLines(int lines)
 {
     Q_ASSERT(lines > 0);
+    if (lines == _windowLines) {
+        return;
+    }
+
+    _bufferNeedsUpdate = true;
     _windowLines = lines;
+
+    // more lines may have come into view
+    if (reflowHistory()) {
+        emit scrolled(_currentLine);
+    }
 }
 
 int ScreenWindow::windowLines() const
@@ -263,6 +395,11 @@ void ScreenWindow::scrollTo(int line)
 
     const int delta = line - _currentLine;
     _currentLine = line;
+    _currentLinePosition = _screen->linePosition(_currentLine + 1);
+
+    // the lines which come into view may need to be rewrapped, which may
+    // move them
+    reflowHistory();
 
     // keep track of number of lines scrolled by,
     // this can be reset by calling resetScrollCount()
@@ -304,14 +441,53 @@ QRect ScreenWindow::scrollRegion() const
     }
 }
 
+bool ScreenWindow::followHistoryLayout()
+{
+    // the lines of the history may have been rewrapped after a resize,
+    // or by another window
+    if (_screen->historyId() == _historyId && _screen->historyLayoutId() == _historyLayoutId) {
+        return false;
+    }
+
+    _historyId = _screen->historyId();
+    _historyLayoutId = _screen->historyLayoutId();
+    if (_trackOutput) {
+        _currentLine = qMax(0, _screen->getHistLines() - (windowLines() - _screen->getLines()));
+    } else {
+        _currentLine = qMax(0, _screen->lineAtPosition(_currentLinePosition) - 1);
+    }
+    _bufferNeedsUpdate = true;
+    return true;
+}
+
+bool ScreenWindow::reflowHistory()
+{
+    static const int MAX_REFLOWS = 4;
+
+    bool moved = followHistoryLayout();
+
+    // once rewrapped, the lines in view may be different ones which
+    // need to be rewrapped as well
+    for (int i = 0; i < MAX_REFLOWS && _screen->reflowHistory(currentLine(), endWindowLine()); i++) {
+        moved = followHistoryLayout() || moved;
+    }
+
+    return moved;
+}
+
 void ScreenWindow::notifyOutputChanged()
 {
+    const bool moved = reflowHistory();
+    if (moved) {
+        emit scrolled(_currentLine);
+    }
+
     // move window to the bottom of the screen and update scroll count
     // if this window is currently tracking the bottom of the screen
     if (_trackOutput) {
         _scrollCount -= _screen->scrolledLines();
         _currentLine = qMax(0, _screen->getHistLines() - (windowLines() - _screen->getLines()));
-    } else {
+    } else if (!moved) {
         // if the history is not unlimited then it may
         // have run out of space and dropped the oldest
         // lines of output - in this case the screen
@@ -324,8 +500,9 @@ void ScreenWindow::notifyOutputChanged()
         // not go beyond the bottom of the screen
         _currentLine = qMin(_currentLine, _screen->getHistLines());
     }
+    _currentLinePosition = _screen->linePosition(_currentLine + 1);
 
-    _bufferNeedsUpdate = true;
+    // getImage() finds out which lines of the buffer need to be updated
 
     emit outputChanged();
 }
@@ -21,6 +21,7 @@
 #define SCREENWINDOW_H
 
 // Qt
+#include <QBitArray>
 #include <QObject>
 #include <QPoint>
 #include <QRect>
@@ -70,15 +71,37 @@ public:
     /** Returns the screen which this window looks onto */
     Screen *screen() const;
 
+    /**
+     * Sets the windows onto the same emulation as this one.  When one of
+     * them shows the same lines as this window and its image is up to date,
+     * getImage() copies the lines from its image instead of the screen.
+     */
+    void setWindows(const QList<ScreenWindow *> *windows);
+
     /**
      * Returns the image of characters which are currently visible through this window
      * onto the screen.
      *
      * The returned buffer is managed by the ScreenWindow instance and does not need to be
      * deleted by the caller.
+     *
+     * Only the lines of the window which changed since the last call are copied from the
+     * screen, as long as the window shows the same lines, see isLineChanged().
      */
     Character *getImage();
 
+    /**
+     * Returns true if @p line of the window may have changed in the image returned by
+     * getImage() since the last call to resetChangedLines().  Views can compare only these
+     * lines with the image they last drew.
+     */
+    bool isLineChanged(int line) const;
+
+    /**
+     * Resets the lines reported as changed by isLineChanged()
+     */
+    void resetChangedLines();
+
     /**
      * Returns the line attributes associated with the lines of characters which
      * are currently visible through this window
@@ -262,6 +285,18 @@ private:
 
     int endWindowLine() const;
     void fillUnusedArea();
+    // copies the lines of the screen which changed since the buffer was
+    // filled to the buffer, from the image of @p window if it is not null
+    void updateChangedLines(const ScreenWindow *window);
+    // returns another window whose image shows the lines this one does
+    // as they are now, or null
+    const ScreenWindow *findCurrentWindow() const;
+    // follows the lines of the history when they were rewrapped, by this or
+    // another window.  Returns true if the window moved.
+    bool followHistoryLayout();
+    // rewraps the lines which come into view, see Screen::reflowHistory(),
+    // and follows them.  Returns true if the window moved.
+    bool reflowHistory();
 
     Screen *_screen; // see setScreen() , screen()
     Character *_windowBuffer;
@@ -274,6 +309,27 @@ private:
     bool _trackOutput; // see setTrackOutput() , trackOutput()
     int _scrollCount;  // count of lines which the window has been scrolled by since
     // the last call to resetScrollCount()
+
+    // the Screen::historyId() and historyLayoutId() when _currentLinePosition was taken
+    int _historyId;
+    int _historyLayoutId;
+    // the Screen::linePosition() of the line below the top line, so that
+    // scrolling up onto lines which get rewrapped shows one more line
+    qint64 _currentLinePosition;
+
+    // the state of the screen when _windowBuffer was last updated: if the
+    // window still shows the same lines, only the lines which changed since
+    // need to be copied again
+    quint64 _bufferChangeCount;
+    int _bufferCurrentLine;
+    int _bufferColumns;
+    int _bufferHistoryLines;
+    qint64 _bufferDroppedLines;
+    int _bufferCursorLine;
+    int _bufferCursorColumn;
+    QBitArray _changedLines; // see isLineChanged()
+
+    const QList<ScreenWindow *> *_windows; // see setWindows()
 };
 }
 #endif // SCREENWINDOW_H
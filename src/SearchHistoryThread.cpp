@@ -0,0 +1,209 @@
+/*
+    Copyright 2018 by The Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "SearchHistoryThread.h"
+
+// System
+#include <algorithm>
+
+// Qt
+#include <QTextStream>
+
+// Konsole
+#include "ExtendedCharTable.h"
+#include "TerminalCharacterDecoder.h"
+#include "konsole_wcwidth.h"
+
+using namespace Konsole;
+
+SearchHistoryThread::SearchHistoryThread(const QRegularExpression &regExp, QObject *parent) :
+    QThread(parent),
+    _regExp(regExp),
+    _mutex(),
+    _blockAdded(),
+    _blocks(),
+    _blocksInProgress(0),
+    _cancelled(0)
+{
+    // matches are sent to the GUI thread with queued connections
+    qRegisterMetaType<QVector<Konsole::SearchMatch> >();
+}
+
+SearchHistoryThread::~SearchHistoryThread()
+{
+    cancel();
+    wait();
+}
+
+void SearchHistoryThread::addBlock(const LineBlock &block)
+{
+    QMutexLocker locker(&_mutex);
+    _blocks.enqueue(block);
+    _blockAdded.wakeOne();
+}
+
+int SearchHistoryThread::pendingBlocks() const
+{
+    QMutexLocker locker(&_mutex);
+    return _blocks.size() + _blocksInProgress;
+}
+
+void SearchHistoryThread::cancel()
+{
+    QMutexLocker locker(&_mutex);
+    _cancelled.store(1);
+    _blocks.clear();
+    _blockAdded.wakeOne();
+}
+
+void SearchHistoryThread::run()
+{
+    forever {
+        LineBlock block;
+        {
+            QMutexLocker locker(&_mutex);
+            _blocksInProgress = 0;
+            while (_blocks.isEmpty() && _cancelled.load() == 0) {
+                _blockAdded.wait(&_mutex);
+            }
+            if (_cancelled.load() != 0) {
+                return;
+            }
+            block = _blocks.dequeue();
+            _blocksInProgress = 1;
+        }
+
+        const QVector<SearchMatch> matches = searchBlock(block);
+
+        if (_cancelled.load() != 0) {
+            return;
+        }
+        emit blockSearched(block.firstLine, block.lineCount(), matches);
+    }
+}
+
+QVector<SearchMatch> SearchHistoryThread::searchBlock(const LineBlock &block) const
+{
+    QString string;
+    QTextStream searchStream(&string);
+
+    PlainTextDecoder decoder;
+    decoder.setRecordLinePositions(true);
+
+    decoder.begin(&searchStream);
+    for (int i = 0; i < block.lineCount(); i++) {
+        const int start = block.lineStart(i);
+        decoder.decodeLine(block.cells.constData() + start,
+                           block.lineEnds.at(i) - start,
+                           block.lineProperties.at(i));
+    }
+    decoder.end();
+
+    const QList<int> linePositions = decoder.linePositions();
+    QVector<SearchMatch> matches;
+
+    // the index of the line which contains the character at @p position
+    auto lineIndex = [&linePositions](int position) {
+        const int index = std::upper_bound(linePositions.constBegin(), linePositions.constEnd(),
+                                           position) - linePositions.constBegin() - 1;
+        return qMax(0, index);
+    };
+
+    // the columns of the text of one line at a time, since matches are
+    // found in order
+    int columnsIndex = -1;
+    QVector<int> startColumns;
+    QVector<int> endColumns;
+    auto column = [&](int index, int position, bool end) {
+        if (index != columnsIndex) {
+            const int start = block.lineStart(index);
+            textColumns(block.cells.constData() + start, block.lineEnds.at(index) - start,
+                        startColumns, endColumns);
+            columnsIndex = index;
+        }
+        const QVector<int> &columns = end ? endColumns : startColumns;
+        if (columns.isEmpty()) {
+            return 0;
+        }
+        return columns.at(qBound(0, position - linePositions.value(index), columns.size() - 1));
+    };
+
+    QRegularExpressionMatchIterator iter = _regExp.globalMatch(string);
+    while (iter.hasNext() && _cancelled.load() == 0) {
+        const QRegularExpressionMatch match = iter.next();
+
+        const int startIndex = lineIndex(match.capturedStart());
+        const int endIndex = lineIndex(qMax(match.capturedStart(), match.capturedEnd() - 1));
+
+        SearchMatch result;
+        result.startLine = block.firstLine + startIndex;
+        result.startColumn = column(startIndex, match.capturedStart(), false);
+        result.endLine = block.firstLine + endIndex;
+        // the end of the last character of the match, so that cells skipped
+        // after it are not highlighted
+        if (match.capturedLength() > 0) {
+            result.endColumn = column(endIndex, match.capturedEnd() - 1, true);
+        } else {
+            result.endColumn = result.startColumn;
+        }
+        matches.append(result);
+    }
+
+    return matches;
+}
+
+void SearchHistoryThread::textColumns(const Character *cells, int count,
+                                      QVector<int> &startColumns, QVector<int> &endColumns)
+{
+    startColumns.clear();
+    endColumns.clear();
+
+    // the cells are walked the same way as PlainTextDecoder::decodeLine()
+    // does it
+    int realCharacterGuard = -1;
+    for (int i = count - 1; i >= 0; i--) {
+        if (cells[i].isRealCharacter && cells[i].character != '\n') {
+            realCharacterGuard = i;
+            break;
+        }
+    }
+
+    for (int i = 0; i < count;) {
+        QString text;
+        int width = 1;
+        if ((cells[i].rendition & RE_EXTENDED_CHAR) != 0) {
+            ushort extendedCharLength = 0;
+            const uint *chars = ExtendedCharTable::instance.lookupExtendedChar(cells[i].character, extendedCharLength);
+            if (chars != nullptr) {
+                text = QString::fromUcs4(chars, extendedCharLength);
+                width = qMax(1, string_width(text));
+            }
+        } else if (cells[i].isRealCharacter || i <= realCharacterGuard) {
+            text = QString::fromUcs4(&cells[i].character, 1);
+            width = qMax(1, konsole_wcwidth(cells[i].character));
+        }
+
+        for (int j = 0; j < text.length(); j++) {
+            startColumns.append(i);
+            endColumns.append(i + width);
+        }
+        i += width;
+    }
+}
@@ -0,0 +1,115 @@
+/*
+    Copyright 2018 by The Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef SEARCHHISTORYTHREAD_H
+#define SEARCHHISTORYTHREAD_H
+
+// Qt
+#include <QAtomicInt>
+#include <QMutex>
+#include <QQueue>
+#include <QRegularExpression>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+// Konsole
+#include "Screen.h"
+#include "konsoleprivate_export.h"
+
+namespace Konsole {
+/**
+ * The position of a match found by SearchHistoryThread.  Lines are numbered
+ * like the lines of the searched LineBlock, columns are those of the cells
+ * of the lines and the end column is exclusive.
+ */
+struct SearchMatch
+{
+    int startLine;
+    int startColumn;
+    int endLine;
+    int endColumn;
+};
+
+/**
+ * Searches blocks of lines copied out of a screen for matches of a regular
+ * expression, away from the GUI thread.
+ *
+ * The owner copies the output to search with Screen::copyLines() and hands
+ * the blocks over with addBlock(), a few at a time so that memory use stays
+ * bounded.  Blocks are searched in the order in which they were added and
+ * blockSearched() is emitted for each of them.
+ */
+class KONSOLEPRIVATE_EXPORT SearchHistoryThread : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit SearchHistoryThread(const QRegularExpression &regExp, QObject *parent = nullptr);
+    ~SearchHistoryThread() Q_DECL_OVERRIDE;
+
+    /** Queues @p block to be searched */
+    void addBlock(const LineBlock &block);
+
+    /** Returns the number of blocks which have been added but not searched yet */
+    int pendingBlocks() const;
+
+    /**
+     * Stops the search as soon as possible.  Blocks which have not been
+     * searched yet are dropped.
+     */
+    void cancel();
+
+Q_SIGNALS:
+    /**
+     * Emitted when a block has been searched.
+     *
+     * @param firstLine The first line of the block
+     * @param lineCount The number of lines in the block
+     * @param matches The matches found in the block, in order
+     */
+    void blockSearched(int firstLine, int lineCount, const QVector<Konsole::SearchMatch> &matches);
+
+protected:
+    void run() Q_DECL_OVERRIDE;
+
+private:
+    QVector<SearchMatch> searchBlock(const LineBlock &block) const;
+
+    // the cell columns of the text which PlainTextDecoder makes of @p count
+    // @p cells: the first and the last column (exclusive) of the cells which
+    // each QChar of the text comes from
+    static void textColumns(const Character *cells, int count,
+                            QVector<int> &startColumns, QVector<int> &endColumns);
+
+    const QRegularExpression _regExp;
+
+    mutable QMutex _mutex;
+    QWaitCondition _blockAdded;
+    QQueue<LineBlock> _blocks;
+    // number of blocks taken from _blocks which are still being searched
+    int _blocksInProgress;
+    QAtomicInt _cancelled;
+};
+}
+
+Q_DECLARE_TYPEINFO(Konsole::SearchMatch, Q_PRIMITIVE_TYPE);
+Q_DECLARE_METATYPE(Konsole::SearchMatch)
+
+#endif // SEARCHHISTORYTHREAD_H
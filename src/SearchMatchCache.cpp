@@ -0,0 +1,494 @@
+/*
+    Copyright 2018 by The Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "SearchMatchCache.h"
+
+// System
+#include <algorithm>
+#include <climits>
+
+// Konsole
+#include "HistorySearchIndex.h"
+#include "Screen.h"
+#include "ScreenWindow.h"
+
+using namespace Konsole;
+
+// search the output in blocks of 2K lines, as SearchHistoryTask does
+static const int BLOCK_LINES = 2000;
+// the lines are renumbered once this many were dropped from the history
+static const int RENUMBER_LINES = 1 << 20;
+
+static bool startsBefore(const SearchMatch &match, int line)
+{
+    return match.startLine < line;
+}
+
+SearchMatchCache::SearchMatchCache(ScreenWindow *window, QObject *parent) :
+    QObject(parent),
+    _window(window),
+    _screen(nullptr),
+    _historyId(0),
+    _historyLayoutId(0),
+    _firstDroppedLine(0),
+    _regExp(),
+    _requiredText(),
+    _enabled(false),
+    _matches(),
+    _thread(nullptr),
+    _pendingBlocks(),
+    _searchAgain(),
+    _nextLine(0),
+    _firstScreenLine(INT_MAX)
+{
+    connect(window, &Konsole::ScreenWindow::outputChanged, this, &Konsole::SearchMatchCache::outputChanged);
+    // the window scrolls when the lines of the history get rewrapped
+    connect(window, &Konsole::ScreenWindow::scrolled, this, &Konsole::SearchMatchCache::windowScrolled);
+}
+
+SearchMatchCache::~SearchMatchCache()
+{
+    stopSearch();
+}
+
+void SearchMatchCache::setRegExp(const QRegularExpression &regExp)
+{
+    if (_regExp == regExp) {
+        return;
+    }
+
+    _regExp = regExp;
+    _requiredText = HistorySearchIndex::requiredText(regExp);
+    restart();
+}
+
+void SearchMatchCache::setEnabled(bool enabled)
+{
+    if (_enabled == enabled) {
+        return;
+    }
+
+    _enabled = enabled;
+    restart();
+}
+
+bool SearchMatchCache::isEnabled() const
+{
+    return _enabled;
+}
+
+void SearchMatchCache::restart()
+{
+    stopSearch();
+
+    const bool hadMatches = !_matches.isEmpty();
+    _matches.clear();
+    _nextLine = 0;
+    _firstScreenLine = INT_MAX;
+    _searchAgain.clear();
+
+    if (!_window.isNull()) {
+        _screen = _window->screen();
+        _historyId = _screen->historyId();
+        _historyLayoutId = _screen->historyLayoutId();
+        _firstDroppedLine = _screen->totalDroppedLines();
+
+        if (_enabled && !_regExp.pattern().isEmpty()) {
+            startSearch();
+            queueBlocks();
+        }
+    }
+
+    if (hadMatches) {
+        emit matchesChanged();
+    }
+}
+
+void SearchMatchCache::startSearch()
+{
+    _thread = new SearchHistoryThread(_regExp, this);
+    connect(_thread, &Konsole::SearchHistoryThread::blockSearched,
+            this, &Konsole::SearchMatchCache::blockSearched);
+    _thread->start();
+}
+
+void SearchMatchCache::stopSearch()
+{
+    _pendingBlocks.clear();
+
+    if (_thread == nullptr) {
+        return;
+    }
+
+    disconnect(_thread, nullptr, this, nullptr);
+    _thread->cancel();
+    _thread->deleteLater();
+    _thread = nullptr;
+}
+
+void SearchMatchCache::followHistoryLayout()
+{
+    QVector<HistoryReflow::LineChange> changes;
+    if (!_screen->historyLayoutChanges(_historyLayoutId, changes)) {
+        restart();
+        return;
+    }
+    _historyLayoutId = _screen->historyLayoutId();
+
+    // the lines given to the search thread may have been rewrapped since,
+    // they are searched again
+    QVector<LineRange> ranges = _searchAgain + _pendingBlocks;
+    stopSearch();
+
+    bool changed = false;
+    foreach (const HistoryReflow::LineChange &change, changes) {
+        const int first = int(change.firstLine - _firstDroppedLine);
+        const int oldEnd = first + change.oldLineCount;
+        const int newLast = first + change.newLineCount - 1;
+        const int delta = change.newLineCount - change.oldLineCount;
+
+        auto renumber = [=](int line, bool last) {
+            if (line < first) {
+                return line;
+            } else if (line >= oldEnd) {
+                return line + delta;
+            }
+            return last ? newLast : first;
+        };
+
+        // forget the matches on the rewrapped lines, including those which
+        // start before them, and move the later ones
+        auto firstRemoved = std::lower_bound(_matches.begin(), _matches.end(), first, startsBefore);
+        while (firstRemoved != _matches.begin() && (firstRemoved - 1)->endLine >= first) {
+            --firstRemoved;
+        }
+        const int searchStart = firstRemoved != _matches.end() ? qMin(first, firstRemoved->startLine) : first;
+        auto lastRemoved = std::lower_bound(firstRemoved, _matches.end(), oldEnd, startsBefore);
+        if (lastRemoved != _matches.end() && delta != 0) {
+            changed = true;
+        }
+        for (auto iter = lastRemoved; iter != _matches.end(); ++iter) {
+            iter->startLine += delta;
+            iter->endLine += delta;
+        }
+        if (firstRemoved != lastRemoved) {
+            _matches.erase(firstRemoved, lastRemoved);
+            changed = true;
+        }
+
+        QVector<LineRange> renumbered;
+        foreach (const LineRange &range, ranges) {
+            const LineRange moved = {renumber(range.firstLine, false), renumber(range.lastLine, true)};
+            if (moved.firstLine <= moved.lastLine) {
+                renumbered.append(moved);
+            }
+        }
+        ranges = renumbered;
+
+        // the lines which were searched already are searched again
+        _nextLine = renumber(_nextLine, false);
+        if (searchStart < _nextLine) {
+            const LineRange range = {searchStart, qMin(newLast, _nextLine - 1)};
+            if (range.firstLine <= range.lastLine) {
+                ranges.append(range);
+            }
+        }
+
+        if (_firstScreenLine != INT_MAX) {
+            _firstScreenLine = renumber(_firstScreenLine, false);
+        }
+    }
+
+    _searchAgain = ranges;
+    startSearch();
+    queueBlocks();
+
+    if (changed) {
+        emit matchesChanged();
+    }
+}
+
+int SearchMatchCache::droppedLines() const
+{
+    return int(_screen->totalDroppedLines() - _firstDroppedLine);
+}
+
+void SearchMatchCache::renumberLines(int lines)
+{
+    _firstDroppedLine += lines;
+
+    for (int i = 0; i < _matches.size(); i++) {
+        _matches[i].startLine -= lines;
+        _matches[i].endLine -= lines;
+    }
+
+    // the blocks which the search thread has yet to return keep their
+    // numbers, see blockSearched()
+    for (int i = 0; i < _pendingBlocks.size(); i++) {
+        _pendingBlocks[i].firstLine -= lines;
+        _pendingBlocks[i].lastLine -= lines;
+    }
+    for (int i = 0; i < _searchAgain.size(); i++) {
+        _searchAgain[i].firstLine -= lines;
+        _searchAgain[i].lastLine -= lines;
+    }
+
+    _nextLine -= lines;
+    if (_firstScreenLine != INT_MAX) {
+        _firstScreenLine -= lines;
+    }
+}
+
+void SearchMatchCache::windowScrolled()
+{
+    if (_thread == nullptr || _window.isNull()) {
+        return;
+    }
+
+    if (_window->screen() != _screen || _screen->historyId() != _historyId) {
+        restart();
+    } else if (_screen->historyLayoutId() != _historyLayoutId) {
+        followHistoryLayout();
+    }
+}
+
+void SearchMatchCache::outputChanged()
+{
+    if (_thread == nullptr || _window.isNull()) {
+        return;
+    }
+
+    // the lines are numbered differently after switching between the normal
+    // and the alternate screen or after the history was replaced
+    Screen *screen = _window->screen();
+    if (screen != _screen || screen->historyId() != _historyId) {
+        restart();
+        return;
+    }
+    if (screen->historyLayoutId() != _historyLayoutId) {
+        followHistoryLayout();
+    }
+
+    // forget the matches on lines dropped from the history
+    const int dropped = droppedLines();
+    bool changed = false;
+    auto firstKept = std::lower_bound(_matches.begin(), _matches.end(), dropped, startsBefore);
+    if (firstKept != _matches.begin()) {
+        _matches.erase(_matches.begin(), firstKept);
+        changed = true;
+    }
+
+    // the lines which were copied from the screen may have changed since;
+    // lines in the history do not change anymore
+    _nextLine = qMax(qMin(_nextLine, _firstScreenLine), dropped);
+    _firstScreenLine = INT_MAX;
+
+    if (dropped >= RENUMBER_LINES) {
+        renumberLines(dropped);
+    }
+
+    queueBlocks();
+
+    if (changed) {
+        emit matchesChanged();
+    }
+}
+
+void SearchMatchCache::queueBlocks()
+{
+    // a couple of blocks at a time, as SearchHistoryTask does
+    static const int MAX_PENDING_BLOCKS = 2;
+
+    const int dropped = droppedLines();
+    const int historyLines = _screen->getHistLines();
+    const int lastLine = _window->lineCount() - 1;
+
+    _nextLine = qMax(_nextLine, dropped);
+
+    bool changed = false;
+    while (_thread->pendingBlocks() < MAX_PENDING_BLOCKS) {
+        // the rewrapped lines are searched again first
+        const bool again = !_searchAgain.isEmpty();
+        const int firstLine = again ? qMax(_searchAgain.first().firstLine, dropped) : _nextLine;
+        const int maxLine = again ? qMin(_searchAgain.first().lastLine - dropped, lastLine) : lastLine;
+        const int startLine = firstLine - dropped;
+        if (startLine > maxLine) {
+            if (!again) {
+                break;
+            }
+            _searchAgain.removeFirst();
+            continue;
+        }
+
+        // blocks do not span both the history and the screen, so that the
+        // lines of the history are never searched again
+        int endLine = qMin(startLine + BLOCK_LINES - 1, maxLine);
+        if (startLine < historyLines) {
+            endLine = qMin(endLine, historyLines - 1);
+        } else {
+            _firstScreenLine = qMin(_firstScreenLine, firstLine);
+        }
+        if (again) {
+            _searchAgain.first().firstLine = endLine + 1 + dropped;
+        } else {
+            _nextLine = endLine + 1 + dropped;
+        }
+
+        if (queueBlock(startLine, endLine)) {
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        emit matchesChanged();
+    }
+}
+
+bool SearchMatchCache::queueBlock(int startLine, int endLine)
+{
+    const int dropped = droppedLines();
+
+    // skip the lines of the history which the index knows cannot match
+    if (!_requiredText.isEmpty() && endLine < _screen->getHistLines()
+            && !_screen->historyMayContain(startLine, endLine, _requiredText)) {
+        return removeMatches(startLine + dropped, endLine + dropped);
+    }
+
+    // the block overlaps the next one up to the end of the logical line,
+    // so that matches which start before a cut are found; only those which
+    // start in the range are kept, see blockSearched()
+    const int lastLine = _window->lineCount() - 1;
+    int end = endLine;
+    while (end < lastLine && end - endLine < BLOCK_LINES
+            && (_screen->getLineProperties(end, end).at(0) & LINE_WRAPPED) != 0) {
+        end++;
+    }
+
+    LineBlock block;
+    _screen->copyLines(startLine, end, block);
+    block.firstLine = startLine + dropped;
+    _thread->addBlock(block);
+
+    const LineRange range = {block.firstLine, endLine + dropped};
+    _pendingBlocks.append(range);
+    return false;
+}
+
+void SearchMatchCache::blockSearched(int firstLine, int lineCount, const QVector<SearchMatch> &matches)
+{
+    // ignore results which were already queued when the search was stopped
+    if (_thread == nullptr || sender() != _thread) {
+        return;
+    }
+
+    LineRange range = {firstLine, firstLine + lineCount - 1};
+    if (!_pendingBlocks.isEmpty()) {
+        range = _pendingBlocks.takeFirst();
+    }
+    // the lines may have been renumbered since the block was copied
+    const int renumbered = firstLine - range.firstLine;
+
+    bool changed = removeMatches(range.firstLine, range.lastLine);
+
+    // matches found on later lines by a previous search of the screen stay
+    // after the new ones, until those lines are searched again
+    const int position = std::lower_bound(_matches.constBegin(), _matches.constEnd(), range.firstLine, startsBefore)
+                         - _matches.constBegin();
+    const QVector<SearchMatch> later = _matches.mid(position);
+    _matches.resize(position);
+
+    foreach (SearchMatch match, matches) {
+        match.startLine -= renumbered;
+        match.endLine -= renumbered;
+
+        // the matches which start after the range are found in the next block
+        if (match.startLine < range.firstLine || match.startLine > range.lastLine) {
+            continue;
+        }
+        // empty matches cannot be highlighted
+        if (match.startLine == match.endLine && match.startColumn == match.endColumn) {
+            continue;
+        }
+        _matches.append(match);
+        changed = true;
+    }
+    _matches += later;
+
+    queueBlocks();
+
+    if (changed) {
+        emit matchesChanged();
+    }
+}
+
+bool SearchMatchCache::removeMatches(int firstLine, int lastLine)
+{
+    auto first = std::lower_bound(_matches.begin(), _matches.end(), firstLine, startsBefore);
+    auto last = std::lower_bound(first, _matches.end(), lastLine + 1, startsBefore);
+    if (first == last) {
+        return false;
+    }
+
+    _matches.erase(first, last);
+    return true;
+}
+
+QVector<SearchMatch> SearchMatchCache::matches(int startLine, int endLine) const
+{
+    QVector<SearchMatch> result;
+    if (_screen == nullptr) {
+        return result;
+    }
+
+    const int dropped = droppedLines();
+
+    auto iter = std::lower_bound(_matches.constBegin(), _matches.constEnd(), startLine + dropped, startsBefore);
+    // include matches which start before the first line and end on it
+    while (iter != _matches.constBegin() && (iter - 1)->endLine >= startLine + dropped) {
+        --iter;
+    }
+
+    for (; iter != _matches.constEnd() && iter->startLine <= endLine + dropped; ++iter) {
+        SearchMatch match = *iter;
+        match.startLine -= dropped;
+        match.endLine -= dropped;
+        result.append(match);
+    }
+
+    return result;
+}
+
+QVector<int> SearchMatchCache::matchedLines() const
+{
+    QVector<int> lines;
+    if (_screen == nullptr) {
+        return lines;
+    }
+
+    const int dropped = droppedLines();
+    foreach (const SearchMatch &match, _matches) {
+        const int line = match.startLine - dropped;
+        if (line >= 0 && (lines.isEmpty() || lines.last() != line)) {
+            lines.append(line);
+        }
+    }
+
+    return lines;
+}
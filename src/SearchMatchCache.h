@@ -0,0 +1,143 @@
+/*
+    Copyright 2018 by The Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+#ifndef SEARCHMATCHCACHE_H
+#define SEARCHMATCHCACHE_H
+
+// Qt
+#include <QObject>
+#include <QPointer>
+#include <QRegularExpression>
+#include <QVector>
+
+// Konsole
+#include "SearchHistoryThread.h"
+
+namespace Konsole {
+class Screen;
+class ScreenWindow;
+
+/**
+ * Keeps the positions of all the matches of a regular expression in the
+ * output shown by a screen window, so that they can be highlighted.
+ *
+ * The output is searched once, in the background, when the regular
+ * expression is set.  Afterwards only the lines which changed are searched
+ * again: lines added to the history and the lines of the screen.  Matches in
+ * lines dropped from the history are forgotten.
+ *
+ * When lines of the history are rewrapped after a resize, as they come into
+ * view, the matches after them are renumbered and only the rewrapped lines
+ * are searched again, see Screen::historyLayoutChanges().
+ *
+ * Lines are numbered like the lines of the screen window, the first line of
+ * the history being 0.
+ */
+class SearchMatchCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SearchMatchCache(ScreenWindow *window, QObject *parent = nullptr);
+    ~SearchMatchCache() Q_DECL_OVERRIDE;
+
+    /** Sets the regular expression to search for and searches the output again */
+    void setRegExp(const QRegularExpression &regExp);
+
+    /**
+     * Sets whether the matches are searched.  While the cache is disabled,
+     * it is empty and does not follow the output.
+     */
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+
+    /** Returns the matches which are at least partly on the lines from @p startLine to @p endLine */
+    QVector<SearchMatch> matches(int startLine, int endLine) const;
+
+    /** Returns the lines on which matches start, in ascending order and without duplicates */
+    QVector<int> matchedLines() const;
+
+Q_SIGNALS:
+    /** Emitted when matches have been found, or removed */
+    void matchesChanged();
+
+private Q_SLOTS:
+    void outputChanged();
+    void windowScrolled();
+
+private:
+    void restart();
+    void stopSearch();
+    void startSearch();
+    // renumbers the matches and the lines to search after the lines of the
+    // history were rewrapped, and searches the rewrapped lines again
+    void followHistoryLayout();
+    void blockSearched(int firstLine, int lineCount, const QVector<SearchMatch> &matches);
+    // copies the next lines to search and hands them to the search thread
+    void queueBlocks();
+    // hands the lines from @p startLine to @p endLine of the window to the
+    // search thread, returns true if matches were removed instead
+    bool queueBlock(int startLine, int endLine);
+    // removes the matches which start on the lines from @p firstLine to @p lastLine,
+    // returns false if there were none
+    bool removeMatches(int firstLine, int lastLine);
+    // the number of lines dropped from the history since restart(), or
+    // since the lines were renumbered
+    int droppedLines() const;
+    // numbers the lines from @p lines further, once they were dropped, so
+    // that the line numbers do not grow without bound
+    void renumberLines(int lines);
+
+    QPointer<ScreenWindow> _window;
+    Screen *_screen;
+    int _historyId;
+    int _historyLayoutId;
+    qint64 _firstDroppedLine;
+
+    QRegularExpression _regExp;
+    QString _requiredText;
+    bool _enabled;
+
+    // the lines of the matches are counted from the first line of the output
+    // at the last restart() or renumberLines(), including lines dropped since
+    // then.
+    QVector<SearchMatch> _matches;
+
+    SearchHistoryThread *_thread;
+
+    struct LineRange
+    {
+        int firstLine;
+        int lastLine;
+    };
+    // the lines of the blocks handed to the search thread, in order, without
+    // the lines up to the end of the logical line which the blocks go on to
+    QVector<LineRange> _pendingBlocks;
+    // lines before _nextLine which need to be searched again
+    QVector<LineRange> _searchAgain;
+    // the next line to copy for the search thread
+    int _nextLine;
+    // the first line which was copied from the screen, rather than from the
+    // history, since the last output change.  Lines from there on must be
+    // searched again when the output changes.
+    int _firstScreenLine;
+};
+}
+
+#endif // SEARCHMATCHCACHE_H
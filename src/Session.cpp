@@ -36,6 +36,7 @@
 #include <QFile>
 #include <QStringList>
 #include <QKeyEvent>
+#include <QElapsedTimer>
 
 // KDE
 #include <KLocalizedString>
@@ -44,6 +45,7 @@
 #include <KShell>
 #include <KProcess>
 #include <KConfigGroup>
+#include <KPtyDevice>
 
 // Konsole
 #include <sessionadaptor.h>
@@ -67,6 +69,12 @@ static bool show_disallow_certain_dbus_methods_message = true;
 
 static const int ZMODEM_BUFFER_SIZE = 1048576; // 1 Mb
 
+// output is parsed in chunks of this many bytes, for at most
+// OUTPUT_TIME_SLICE milliseconds before the events waiting, like the
+// input and repaints of all sessions, get handled
+static const int OUTPUT_CHUNK_SIZE = 4096;
+static const int OUTPUT_TIME_SLICE = 10;
+
 Session::Session(QObject* parent) :
     QObject(parent)
     , _uniqueIdentifier(QUuid())
@@ -79,6 +87,8 @@ Session::Session(QObject* parent) :
     , _silenceSeconds(10)
     , _silenceTimer(nullptr)
     , _activityTimer(nullptr)
+    , _pendingOutput(QByteArray())
+    , _pendingOutputTimer(nullptr)
     , _autoClose(true)
     , _closePerUserRequest(false)
     , _nameTitle(QString())
@@ -98,9 +108,10 @@ Session::Session(QObject* parent) :
     , _initialWorkingDir(QString())
     , _currentWorkingDir(QString())
     , _reportedWorkingUrl(QUrl())
-    , _sessionProcessInfo(nullptr)
-    , _foregroundProcessInfo(nullptr)
     , _foregroundPid(0)
+    , _processCheckTimer(nullptr)
+    , _foregroundProcessGroup(0)
+    , _inputSinceProcessCheck(false)
     , _zmodemBusy(false)
     , _zmodemProc(nullptr)
     , _zmodemProgress(nullptr)
@@ -143,13 +154,22 @@ Session::Session(QObject* parent) :
     _activityTimer->setSingleShot(true);
     connect(_activityTimer, &QTimer::timeout, this, &Konsole::Session::activityTimerDone);
 
+    _pendingOutputTimer = new QTimer(this);
+    _pendingOutputTimer->setSingleShot(true);
+    connect(_pendingOutputTimer, &QTimer::timeout, this, &Konsole::Session::receivePendingOutput);
+
+    // the foreground process is only checked while there is input or output
+    _processCheckTimer = new QTimer(this);
+    _processCheckTimer->setSingleShot(true);
+    _processCheckTimer->setInterval(PROCESS_CHECK_INTERVAL);
+    connect(_processCheckTimer, &QTimer::timeout, this, &Konsole::Session::checkForegroundProcess);
+    connect(_emulation, &Konsole::Emulation::sendData, this, &Konsole::Session::inputSent);
+
     connect(this, &Konsole::Session::tabRenamedByUser, this, &Konsole::Session::tabTitleSetByUser);
 }
 
 Session::~Session()
 {
-    delete _foregroundProcessInfo;
-    delete _sessionProcessInfo;
     delete _emulation;
     delete _shellProcess;
     delete _zmodemProc;
@@ -163,6 +183,7 @@ void Session::openTeletype(int fd)
     }
 
     delete _shellProcess;
+    _pendingOutput.clear();
 
     if (fd < 0) {
         _shellProcess = new Pty();
@@ -175,6 +196,7 @@ void Session::openTeletype(int fd)
     // connect the I/O between emulator and pty process
     connect(_shellProcess, &Konsole::Pty::receivedData, this, &Konsole::Session::onReceiveBlock);
     connect(_emulation, &Konsole::Emulation::sendData, _shellProcess, &Konsole::Pty::sendData);
+    connect(_shellProcess, &Konsole::Pty::dataSent, this, &Konsole::Session::dataSent);
 
     // UTF8 mode
     connect(_emulation, &Konsole::Emulation::useUtf8Request, _shellProcess, &Konsole::Pty::setUtf8Mode);
@@ -308,6 +330,9 @@ void Session::addView(TerminalDisplay* widget)
     connect(widget, &Konsole::TerminalDisplay::mouseSignal, _emulation, &Konsole::Emulation::sendMouseEvent);
     connect(widget, &Konsole::TerminalDisplay::sendStringToEmu, _emulation, &Konsole::Emulation::sendString);
 
+    // large pastes are sent in parts, as fast as the terminal process reads them
+    connect(this, &Konsole::Session::dataSent, widget, &Konsole::TerminalDisplay::continuePaste);
+
     // allow emulation to notify the view when the foreground process
     // indicates whether or not it is interested in Mouse Tracking events
     connect(_emulation, &Konsole::Emulation::programRequestsMouseTracking, widget, &Konsole::TerminalDisplay::setUsesMouseTracking);
@@ -1040,10 +1065,10 @@ ProcessInfo* Session::getProcessInfo()
     ProcessInfo* process = nullptr;
 
     if (isForegroundProcessActive() && updateForegroundProcessInfo()) {
-        process = _foregroundProcessInfo;
+        process = _foregroundProcessInfo.data();
     } else {
         updateSessionProcessInfo();
-        process = _sessionProcessInfo;
+        process = _sessionProcessInfo.data();
     }
 
     return process;
@@ -1057,10 +1082,9 @@ void Session::updateSessionProcessInfo()
     // The checking for pid changing looks stupid, but it is needed
     // at the moment to workaround the problem that processId() might
     // return 0
-    if ((_sessionProcessInfo == nullptr) ||
+    if (_sessionProcessInfo.isNull() ||
             (processId() != 0 && processId() != _sessionProcessInfo->pid(&ok))) {
-        delete _sessionProcessInfo;
-        _sessionProcessInfo = ProcessInfo::newInstance(processId(),
+        _sessionProcessInfo = ProcessInfo::sharedInstance(processId(),
                     tabTitleFormat(Session::LocalTabTitle));
         _sessionProcessInfo->setUserHomeDir();
     }
@@ -1073,13 +1097,12 @@ bool Session::updateForegroundProcessInfo()
 
     const int foregroundPid = _shellProcess->foregroundProcessGroup();
     if (foregroundPid != _foregroundPid) {
-        delete _foregroundProcessInfo;
-        _foregroundProcessInfo = ProcessInfo::newInstance(foregroundPid,
+        _foregroundProcessInfo = ProcessInfo::sharedInstance(foregroundPid,
                     tabTitleFormat(Session::LocalTabTitle));
         _foregroundPid = foregroundPid;
     }
 
-    if (_foregroundProcessInfo != nullptr) {
+    if (!_foregroundProcessInfo.isNull()) {
         _foregroundProcessInfo->update();
         return _foregroundProcessInfo->isValid();
     } else {
@@ -1380,6 +1403,15 @@ void Session::startZModem(const QString& zmodem, const QString& dir, const QStri
                this, &Konsole::Session::onReceiveBlock);
     connect(_shellProcess, &Konsole::Pty::receivedData, this, &Konsole::Session::zmodemReceiveBlock);
 
+    // the output which was not parsed yet belongs to the transfer
+    if (!_pendingOutput.isEmpty()) {
+        _pendingOutputTimer->stop();
+        const QByteArray output = _pendingOutput;
+        _pendingOutput.clear();
+        _shellProcess->pty()->setSuspended(false);
+        zmodemReceiveBlock(output.constData(), output.size());
+    }
+
     _zmodemProgress = new ZModemDialog(QApplication::activeWindow(), false,
                                        i18n("ZModem Progress"));
 
@@ -1459,9 +1491,81 @@ void Session::zmodemFinished()
     }
 }
 
+void Session::inputSent()
+{
+    _inputSinceProcessCheck = true;
+
+    if (!_processCheckTimer->isActive()) {
+        _processCheckTimer->start();
+    }
+}
+
+void Session::checkForegroundProcess()
+{
+    if (!isRunning()) {
+        return;
+    }
+
+    // reading the foreground process group is cheap, unlike reading the
+    // information about the process, which is left to the receivers
+    const int processGroup = _shellProcess->foregroundProcessGroup();
+    if (processGroup != _foregroundProcessGroup || _inputSinceProcessCheck) {
+        _foregroundProcessGroup = processGroup;
+        _inputSinceProcessCheck = false;
+        emit foregroundProcessChanged();
+    }
+}
+
 void Session::onReceiveBlock(const char* buf, int len)
 {
-    _emulation->receiveData(buf, len);
+    if (!_processCheckTimer->isActive()) {
+        _processCheckTimer->start();
+    }
+
+    if (!_pendingOutput.isEmpty()) {
+        _pendingOutput.append(buf, len);
+        return;
+    }
+
+    const int parsed = receiveOutput(buf, len);
+    if (parsed < len) {
+        // stop reading from the pty until the rest is parsed, so the
+        // terminal program is held back instead of the whole window
+        _pendingOutput = QByteArray(buf + parsed, len - parsed);
+        _shellProcess->pty()->setSuspended(true);
+        _pendingOutputTimer->start(0);
+    }
+}
+
+void Session::receivePendingOutput()
+{
+    if (_pendingOutput.isEmpty()) {
+        return;
+    }
+
+    const int parsed = receiveOutput(_pendingOutput.constData(), _pendingOutput.size());
+    _pendingOutput.remove(0, parsed);
+
+    if (_pendingOutput.isEmpty()) {
+        _shellProcess->pty()->setSuspended(false);
+    } else {
+        _pendingOutputTimer->start(0);
+    }
+}
+
+int Session::receiveOutput(const char *buf, int len)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    int parsed = 0;
+    do {
+        const int length = qMin(OUTPUT_CHUNK_SIZE, len - parsed);
+        _emulation->receiveData(buf + parsed, length);
+        parsed += length;
+    } while (parsed < len && !timer.hasExpired(OUTPUT_TIME_SLICE));
+
+    return parsed;
 }
 
 QSize Session::size()
@@ -1672,6 +1776,11 @@ QString Session::validDirectory(const QString& dir) const
     return validDir;
 }
 
+bool Session::isSendingData() const
+{
+    return _shellProcess->isSendingData();
+}
+
 bool Session::isReadOnly() const
 {
     return _readOnly;
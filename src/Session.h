@@ -30,6 +30,7 @@
 #include <QUuid>
 #include <QSize>
 #include <QProcess>
+#include <QSharedPointer>
 #include <QWidget>
 #include <QUrl>
 
@@ -377,6 +378,13 @@ public:
     bool isReadOnly() const;
     void setReadOnly(bool readOnly);
 
+    /**
+     * Returns true if some of the input sent to the terminal process has
+     * not been written to it yet, in which case dataSent() is emitted once
+     * it has been.
+     */
+    bool isSendingData() const;
+
     // Returns true if the current screen is the secondary/alternate one
     // or false if it's the primary/normal buffer
     bool isPrimaryScreen();
@@ -681,6 +689,22 @@ Q_SIGNALS:
      */
     void flowControlEnabledChanged(bool enabled);
 
+    /**
+     * Emitted when all of the input sent to the terminal process has been
+     * written to it, see Pty::dataSent()
+     */
+    void dataSent();
+
+    /**
+     * Emitted when the foreground process group of the terminal changed,
+     * or when input was sent to the terminal, which may have changed the
+     * state of the foreground process, e.g. its working directory.
+     *
+     * This is only checked while input or output happens, at most every
+     * PROCESS_CHECK_INTERVAL milliseconds, so idle sessions do no work.
+     */
+    void foregroundProcessChanged();
+
     /**
      * Emitted when the active screen is switched, to indicate whether the primary
      * screen is in use.
@@ -719,6 +743,9 @@ private Q_SLOTS:
     void fireZModemUploadDetected();
 
     void onReceiveBlock(const char *buf, int len);
+    void receivePendingOutput();
+    void inputSent();
+    void checkForegroundProcess();
     void silenceTimerDone();
     void activityTimerDone();
 
@@ -758,6 +785,9 @@ private:
     // if the program fails to start, or if the shell exits in
     // an unsuccessful manner
     void terminalWarning(const QString &message);
+    // parses output for at most OUTPUT_TIME_SLICE milliseconds and
+    // returns the number of bytes which were parsed
+    int receiveOutput(const char *buf, int len);
     ProcessInfo *getProcessInfo();
     void updateSessionProcessInfo();
     bool updateForegroundProcessInfo();
@@ -780,6 +810,11 @@ private:
     QTimer *_silenceTimer;
     QTimer *_activityTimer;
 
+    // output of the terminal program which was received but not parsed
+    // yet.  The pty is not read while there is some.
+    QByteArray _pendingOutput;
+    QTimer *_pendingOutputTimer;
+
     bool _autoClose;
     bool _closePerUserRequest;
 
@@ -807,10 +842,17 @@ private:
     QString _currentWorkingDir;
     QUrl _reportedWorkingUrl;
 
-    ProcessInfo *_sessionProcessInfo;
-    ProcessInfo *_foregroundProcessInfo;
+    // shared with the other sessions showing the same processes
+    QSharedPointer<ProcessInfo> _sessionProcessInfo;
+    QSharedPointer<ProcessInfo> _foregroundProcessInfo;
     int _foregroundPid;
 
+    // see foregroundProcessChanged()
+    QTimer *_processCheckTimer;
+    int _foregroundProcessGroup; // as of the previous check
+    bool _inputSinceProcessCheck;
+    static const int PROCESS_CHECK_INTERVAL = 500;
+
     // ZModem
     bool _zmodemBusy;
     KProcess *_zmodemProc;
@@ -33,6 +33,7 @@
 #include <QPrintDialog>
 #include <QFileDialog>
 #include <QPainter>
+#include <QProgressDialog>
 #include <QStandardPaths>
 #include <QUrl>
 #include <QIcon>
@@ -60,12 +61,16 @@
 #include "EditProfileDialog.h"
 #include "CopyInputDialog.h"
 #include "Emulation.h"
+#include "FileListCache.h"
 #include "Filter.h"
 #include "History.h"
+#include "HistorySearchIndex.h"
 #include "HistorySizeDialog.h"
 #include "IncrementalSearchBar.h"
 #include "RenameTabDialog.h"
 #include "ScreenWindow.h"
+#include "SearchHistoryThread.h"
+#include "SearchMatchCache.h"
 #include "Session.h"
 #include "ProfileList.h"
 #include "TerminalDisplay.h"
@@ -76,7 +81,7 @@
 // for SaveHistoryTask
 #include <KIO/Job>
 #include <KJob>
-#include "TerminalCharacterDecoder.h"
+#include "SaveHistoryThread.h"
 
 // For Unix signal names
 #include <signal.h>
@@ -102,14 +107,13 @@ SessionController::SessionController(Session* session , TerminalDisplay* view, Q
     , _sessionIcon(QIcon())
     , _sessionIconName(QString())
     , _previousState(-1)
-    , _searchFilter(nullptr)
+    , _searchMatches(nullptr)
     , _urlFilter(nullptr)
     , _fileFilter(nullptr)
     , _copyInputToAllTabsAction(nullptr)
     , _findAction(nullptr)
     , _findNextAction(nullptr)
     , _findPreviousAction(nullptr)
-    , _interactionTimer(nullptr)
     , _searchStartLine(0)
     , _prevSearchResultLine(0)
     , _codecAction(nullptr)
@@ -124,6 +128,7 @@ SessionController::SessionController(Session* session , TerminalDisplay* view, Q
     , _isSearchBarEnabled(false)
     , _editProfileDialog(nullptr)
     , _searchBar(view->searchBar())
+    , _searchTask(nullptr)
 {
     Q_ASSERT(session);
     Q_ASSERT(view);
@@ -193,24 +198,12 @@ SessionController::SessionController(Session* session , TerminalDisplay* view, Q
     connect(_session.data(), &Konsole::Session::flowControlEnabledChanged, _view.data(), &Konsole::TerminalDisplay::setFlowControlWarningEnabled);
     _view->setFlowControlWarningEnabled(_session->flowControlEnabled());
 
-    // take a snapshot of the session state every so often when
-    // user activity occurs
-    //
-    // the timer is owned by the session so that it will be destroyed along
-    // with the session
-    _interactionTimer = new QTimer(_session);
-    _interactionTimer->setSingleShot(true);
-    _interactionTimer->setInterval(500);
-    connect(_interactionTimer, &QTimer::timeout, this, &Konsole::SessionController::snapshot);
+    // take a snapshot of the session state when the foreground process
+    // changes, or when input is sent to it.  Sessions without input or
+    // output are not looked at.
+    connect(_session.data(), &Konsole::Session::foregroundProcessChanged, this, &Konsole::SessionController::snapshot);
     connect(_view.data(), &Konsole::TerminalDisplay::keyPressedSignal, this, &Konsole::SessionController::interactionHandler);
 
-    // take a snapshot of the session state periodically in the background
-    auto backgroundTimer = new QTimer(_session);
-    backgroundTimer->setSingleShot(false);
-    backgroundTimer->setInterval(2000);
-    connect(backgroundTimer, &QTimer::timeout, this, &Konsole::SessionController::snapshot);
-    backgroundTimer->start();
-
     // xterm '11;?' request
     connect(_session.data(), &Konsole::Session::getBackgroundColor,
             this, &Konsole::SessionController::sendBackgroundColor);
@@ -249,6 +242,16 @@ void SessionController::trackOutput(QKeyEvent* event)
 
     _view->screenWindow()->setTrackOutput(true);
 }
+
+void SessionController::directoryListed()
+{
+    // the hotspots of the file filter only change if the directory listed
+    // is the working directory of this session, see FileFilter::isOutdated()
+    if (!_view.isNull()) {
+        _view->processFilters();
+    }
+}
+
 void SessionController::interactionHandler()
 {
     // This flag is used to make sure those special icons indicating interest
@@ -256,7 +259,6 @@ void SessionController::interactionHandler()
     // happens. Otherwise, those special icons will quickly be replaced by
     // normal icon when ::snapshot() is triggered
     _keepIconUntilInteraction = false;
-    _interactionTimer->start();
 }
 
 void SessionController::snapshot()
@@ -499,15 +501,17 @@ bool SessionController::eventFilter(QObject* watched , QEvent* event)
     return Konsole::ViewProperties::eventFilter(watched, event);
 }
 
-void SessionController::removeSearchFilter()
+void SessionController::removeSearchMatches()
 {
-    if (_searchFilter == nullptr) {
+    if (_searchMatches == nullptr) {
         return;
     }
 
-    _view->filterChain()->removeFilter(_searchFilter);
-    delete _searchFilter;
-    _searchFilter = nullptr;
+    if (!_view.isNull()) {
+        _view->setSearchMatches(nullptr);
+    }
+    delete _searchMatches;
+    _searchMatches = nullptr;
 }
 
 void SessionController::setupSearchBar()
@@ -1127,12 +1131,16 @@ void SessionController::updateFilterList(Profile::Ptr profile)
     bool underlineFiles = profile->underlineFilesEnabled();
 
     if (!underlineFiles && (_fileFilter != nullptr)) {
+        disconnect(FileListCache::instance(), &Konsole::FileListCache::directoryListed,
+                   this, &Konsole::SessionController::directoryListed);
         _view->filterChain()->removeFilter(_fileFilter);
         delete _fileFilter;
         _fileFilter = nullptr;
     } else if (underlineFiles && (_fileFilter == nullptr)) {
         _fileFilter = new FileFilter(_session);
         _view->filterChain()->addFilter(_fileFilter);
+        connect(FileListCache::instance(), &Konsole::FileListCache::directoryListed,
+                this, &Konsole::SessionController::directoryListed);
     }
 
     bool underlineLinks = profile->underlineLinksEnabled();
@@ -1163,20 +1171,11 @@ void SessionController::listenForScreenWindowUpdates()
         return;
     }
 
-    connect(_view->screenWindow(), &Konsole::ScreenWindow::outputChanged, this, &Konsole::SessionController::updateSearchFilter);
-    connect(_view->screenWindow(), &Konsole::ScreenWindow::scrolled, this, &Konsole::SessionController::updateSearchFilter);
     connect(_view->screenWindow(), &Konsole::ScreenWindow::currentResultLineChanged, _view.data(), static_cast<void(TerminalDisplay::*)()>(&Konsole::TerminalDisplay::update));
 
     _listenForScreenWindowUpdates = true;
 }
 
-void SessionController::updateSearchFilter()
-{
-    if ((_searchFilter != nullptr) && (!_searchBar.isNull())) {
-        _view->processFilters();
-    }
-}
-
 void SessionController::searchBarEvent()
 {
     QString selectedText = _view->screenWindow()->selectedText(Screen::PreserveLineBreaks | Screen::TrimLeadingWhitespace | Screen::TrimTrailingWhitespace);
@@ -1217,6 +1216,11 @@ void SessionController::enableSearchBar(bool showSearchBar)
         if ((!_view.isNull()) && (_view->screenWindow() != nullptr)) {
             _view->screenWindow()->setCurrentResultLine(-1);
         }
+        if (!_searchTask.isNull()) {
+            _searchTask->cancel();
+            _searchTask = nullptr;
+        }
+        _searchBar->setSearchProgress(-1);
     }
 }
 
@@ -1257,20 +1261,20 @@ void SessionController::searchHistory(bool showSearchBar)
 
     if (!_searchBar.isNull()) {
         if (showSearchBar) {
-            removeSearchFilter();
+            removeSearchMatches();
 
             listenForScreenWindowUpdates();
 
-            _searchFilter = new RegExpFilter();
-            _searchFilter->setRegExp(regexpFromSearchBarOptions());
-            _view->filterChain()->addFilter(_searchFilter);
-            _view->processFilters();
+            _searchMatches = new SearchMatchCache(_view->screenWindow(), this);
+            _searchMatches->setRegExp(regexpFromSearchBarOptions());
+            _searchMatches->setEnabled(_searchBar->optionsChecked().at(IncrementalSearchBar::HighlightMatches));
+            _view->setSearchMatches(_searchMatches);
 
             setFindNextPrevEnabled(true);
         } else {
             setFindNextPrevEnabled(false);
 
-            removeSearchFilter();
+            removeSearchMatches();
 
             _view->setFocus(Qt::ActiveWindowFocusReason);
         }
@@ -1306,6 +1310,7 @@ void SessionController::searchCompleted(bool success)
     _prevSearchResultLine = _view->screenWindow()->currentResultLine();
 
     if (!_searchBar.isNull()) {
+        _searchBar->setSearchProgress(-1);
         _searchBar->setFoundMatch(success);
     }
 }
@@ -1313,10 +1318,10 @@ void SessionController::searchCompleted(bool success)
 void SessionController::beginSearch(const QString& text, Enum::SearchDirection direction)
 {
     Q_ASSERT(_searchBar);
-    Q_ASSERT(_searchFilter);
+    Q_ASSERT(_searchMatches);
 
     QRegularExpression regExp = regexpFromSearchBarOptions();
-    _searchFilter->setRegExp(regExp);
+    _searchMatches->setRegExp(regExp);
 
     if (_searchStartLine == -1) {
         if (direction == Enum::ForwardsSearch) {
@@ -1326,11 +1331,19 @@ void SessionController::beginSearch(const QString& text, Enum::SearchDirection d
         }
     }
 
+    // a new search replaces the one which may still be running
+    if (!_searchTask.isNull()) {
+        _searchTask->cancel();
+        _searchTask = nullptr;
+    }
+
     if (!regExp.pattern().isEmpty()) {
         _view->screenWindow()->setCurrentResultLine(-1);
         auto task = new SearchHistoryTask(this);
+        _searchTask = task;
 
         connect(task, &Konsole::SearchHistoryTask::completed, this, &Konsole::SessionController::searchCompleted);
+        connect(task, &Konsole::SearchHistoryTask::progressChanged, _searchBar.data(), &Konsole::IncrementalSearchBar::setSearchProgress);
 
         task->setRegExp(regExp);
         task->setSearchDirection(direction);
@@ -1341,16 +1354,11 @@ void SessionController::beginSearch(const QString& text, Enum::SearchDirection d
     } else if (text.isEmpty()) {
         searchCompleted(false);
     }
-
-    _view->processFilters();
 }
 void SessionController::highlightMatches(bool highlight)
 {
-    if (highlight) {
-        _view->filterChain()->addFilter(_searchFilter);
-        _view->processFilters();
-    } else {
-        _view->filterChain()->removeFilter(_searchFilter);
+    if (_searchMatches != nullptr) {
+        _searchMatches->setEnabled(highlight);
     }
 
     _view->update();
@@ -1359,7 +1367,7 @@ void SessionController::highlightMatches(bool highlight)
 void SessionController::searchFrom()
 {
     Q_ASSERT(_searchBar);
-    Q_ASSERT(_searchFilter);
+    Q_ASSERT(_searchMatches);
 
     if (reverseSearchChecked()) {
         setSearchStartTo(_view->screenWindow()->lineCount());
@@ -1373,7 +1381,7 @@ void SessionController::searchFrom()
 void SessionController::findNextInHistory()
 {
     Q_ASSERT(_searchBar);
-    Q_ASSERT(_searchFilter);
+    Q_ASSERT(_searchMatches);
 
     setSearchStartTo(_prevSearchResultLine);
 
@@ -1382,7 +1390,7 @@ void SessionController::findNextInHistory()
 void SessionController::findPreviousInHistory()
 {
     Q_ASSERT(_searchBar);
-    Q_ASSERT(_searchFilter);
+    Q_ASSERT(_searchMatches);
 
     setSearchStartTo(_prevSearchResultLine);
 
@@ -1391,7 +1399,7 @@ void SessionController::findPreviousInHistory()
 void SessionController::changeSearchMatch()
 {
     Q_ASSERT(_searchBar);
-    Q_ASSERT(_searchFilter);
+    Q_ASSERT(_searchMatches);
 
     // reset Selection for new case match
     _view->screenWindow()->clearSelection();
@@ -1403,7 +1411,9 @@ void SessionController::showHistoryOptions()
     const HistoryType& currentHistory = _session->historyType();
 
     if (currentHistory.isEnabled()) {
-        if (currentHistory.isUnlimited()) {
+        if (dynamic_cast<const CompressedHistoryType *>(&currentHistory) != nullptr) {
+            dialog->setMode(Enum::CompressedUnlimitedHistory);
+        } else if (currentHistory.isUnlimited()) {
             dialog->setMode(Enum::UnlimitedHistory);
         } else {
             dialog->setMode(Enum::FixedSizeHistory);
@@ -1440,6 +1450,9 @@ void SessionController::scrollBackOptionsChanged(int mode, int lines)
     case Enum::UnlimitedHistory:
         _session->setHistoryType(HistoryTypeFile());
         break;
+    case Enum::CompressedUnlimitedHistory:
+        _session->setHistoryType(CompressedHistoryType());
+        break;
     }
 }
 
@@ -1630,7 +1643,8 @@ void SessionController::showDisplayContextMenu(const QPoint& position)
         updateReadOnlyActionStates();
 
         // prepend content-specific actions such as "Open Link", "Copy Email Address" etc.
-        QList<QAction*> contentActions = _view->filterActions(position);
+        const QList<QAction*> filterActions = _view->filterActions(position);
+        QList<QAction*> contentActions = filterActions;
         auto contentSeparator = new QAction(popup);
         contentSeparator->setSeparator(true);
         contentActions << contentSeparator;
@@ -1672,6 +1686,10 @@ void SessionController::showDisplayContextMenu(const QPoint& position)
         if ((chosen != nullptr) && chosen->objectName() == QLatin1String("close-session")) {
             chosen->trigger();
         }
+
+        // the filter actions are owned by the menu rather than the hotspot,
+        // which may have been deleted by output arriving while the menu was open
+        qDeleteAll(filterActions);
     } else {
         qCDebug(KonsoleDebug) << "Unable to display popup menu for session"
                    << _session->title(Session::NameRole)
@@ -1793,16 +1811,30 @@ QList<SessionPtr> SessionTask::sessions() const
 
 SaveHistoryTask::SaveHistoryTask(QObject* parent)
     : SessionTask(parent)
+    , _saveJobs()
 {
 }
-SaveHistoryTask::~SaveHistoryTask() = default;
+
+SaveHistoryTask::~SaveHistoryTask()
+{
+    foreach (SaveJob *info, _saveJobs) {
+        if (info->job != nullptr) {
+            disconnect(info->job, nullptr, this, nullptr);
+            info->job->kill();
+        }
+        delete info->progress;
+        // waits until the thread stopped
+        delete info->thread;
+        delete info->lines;
+        delete info;
+    }
+}
 
 void SaveHistoryTask::execute()
 {
     // TODO - think about the UI when saving multiple history sessions, if there are more than two or
     //        three then providing a URL for each one will be tedious
 
-    // TODO - show a warning ( preferably passive ) if saving the history output fails
     QFileDialog* dialog = new QFileDialog(QApplication::activeWindow(),
             QString(),
             QDir::homePath());
@@ -1815,7 +1847,7 @@ void SaveHistoryTask::execute()
 
     // iterate over each session in the task and display a dialog to allow the user to choose where
     // to save that session's history.
-    // then start a KIO job to transfer the data from the history to the chosen URL
+    // then start a thread to save the history to the chosen URL
     foreach(const SessionPtr& session, sessions()) {
         dialog->setWindowTitle(i18n("Save Output From %1", session->title(Session::NameRole)));
 
@@ -1833,91 +1865,256 @@ void SaveHistoryTask::execute()
             continue;
         }
 
-        KIO::TransferJob* job = KIO::put(url,
-                                         -1,   // no special permissions
-                                         // overwrite existing files
-                                         // do not resume an existing transfer
-                                         // show progress information only for remote
-                                         // URLs
-                                         KIO::Overwrite | (url.isLocalFile() ? KIO::HideProgressInfo : KIO::DefaultFlags)
-                                         // a better solution would be to show progress
-                                         // information after a certain period of time
-                                         // instead, since the overall speed of transfer
-                                         // depends on factors other than just the protocol
-                                         // used
-                                        );
-
-        SaveJob jobInfo;
-        jobInfo.session = session;
-        jobInfo.lastLineFetched = -1;  // when each request for data comes in from the KIO subsystem
-        // lastLineFetched is used to keep track of how much of the history
-        // has already been sent, and where the next request should continue
-        // from.
-        // this is set to -1 to indicate the job has just been started
-
+        SaveHistoryThread::Format format = SaveHistoryThread::PlainText;
         if (((dialog->selectedNameFilter()).contains(QLatin1String("html"), Qt::CaseInsensitive)) ||
            ((dialog->selectedFiles()).at(0).endsWith(QLatin1String("html"), Qt::CaseInsensitive))) {
-            jobInfo.decoder = new HTMLDecoder();
-        } else {
-            jobInfo.decoder = new PlainTextDecoder();
+            format = SaveHistoryThread::Html;
+        }
+
+        auto info = new SaveJob();
+        info->session = session;
+        // lines which are added to the output while saving are not saved
+        info->lines = new SaveHistoryLines(session->emulation()->currentScreen());
+        info->blockLines = 1000;
+        info->linesSaved = 0;
+
+        // local files are written by the thread, without a round trip
+        // through KIO for every block of output
+        info->thread = new SaveHistoryThread(format, url.isLocalFile() ? url.toLocalFile() : QString(), this);
+        info->job = nullptr;
+        info->dataRequested = false;
+        info->threadFinished = false;
+
+        if (!url.isLocalFile()) {
+            info->job = KIO::put(url,
+                                 -1,   // no special permissions
+                                 // overwrite existing files
+                                 // the progress is shown by the dialog below
+                                 KIO::Overwrite | KIO::HideProgressInfo);
+            // the data is sent once the thread decoded it
+            info->job->setAsyncDataEnabled(true);
+
+            connect(info->job, &KIO::TransferJob::dataReq, this, &Konsole::SaveHistoryTask::jobDataRequested);
+            connect(info->job, &KIO::TransferJob::result, this, &Konsole::SaveHistoryTask::jobResult);
         }
 
-        _jobSession.insert(job, jobInfo);
+        // the progress dialog only shows up if saving takes a while
+        info->progress = new QProgressDialog(QApplication::activeWindow());
+        info->progress->setWindowTitle(i18n("Save Output"));
+        info->progress->setLabelText(i18n("Saving output from %1 to %2",
+                                          session->title(Session::NameRole),
+                                          url.toDisplayString(QUrl::PreferLocalFile)));
+        info->progress->setMinimumDuration(1000);
+        info->progress->setRange(0, 100);
+        connect(info->progress, &QProgressDialog::canceled, this, [this, info]() {
+            finishSave(info, false);
+        });
+
+        connect(info->thread, &Konsole::SaveHistoryThread::blockSaved,
+                this, &Konsole::SaveHistoryTask::blockSaved);
+        connect(info->thread, &QThread::finished, this, &Konsole::SaveHistoryTask::threadFinished);
+
+        _saveJobs << info;
 
-        connect(job, &KIO::TransferJob::dataReq, this, &Konsole::SaveHistoryTask::jobDataRequested);
-        connect(job, &KIO::TransferJob::result, this, &Konsole::SaveHistoryTask::jobResult);
+        info->timer.start();
+        info->thread->start();
+        queueBlocks(info);
     }
 
     dialog->deleteLater();
+
+    if (_saveJobs.isEmpty() && autoDelete()) {
+        deleteLater();
+    }
 }
-void SaveHistoryTask::jobDataRequested(KIO::Job* job , QByteArray& data)
+
+SaveHistoryTask::SaveJob *SaveHistoryTask::findSaveJob(const QObject *object) const
+{
+    foreach (SaveJob *info, _saveJobs) {
+        if (info->thread == object || info->job == object) {
+            return info;
+        }
+    }
+
+    return nullptr;
+}
+
+void SaveHistoryTask::queueBlocks(SaveJob *info)
 {
-    // TODO - Report progress information for the job
+    // keep a couple of blocks ready for the thread, and only a few megabytes
+    // of output waiting for a remote URL
+    static const int MAX_PENDING_BLOCKS = 2;
+    static const int MAX_PENDING_DATA = 4 * 1024 * 1024;
 
-    // PERFORMANCE:  Do some tests and tweak this value to get faster saving
-    const int LINES_PER_REQUEST = 500;
+    // every block is copied from the screen on the GUI thread, so the
+    // number of lines per block is adapted to keep the time spent there
+    // around a few milliseconds
+    static const qint64 BLOCK_COPY_TIME = 5 * 1000 * 1000; // ns
+    static const int MIN_BLOCK_LINES = 100;
+    static const int MAX_BLOCK_LINES = 100000;
 
-    SaveJob& info = _jobSession[job];
+    // the screen goes away with the session
+    if (info->session.isNull() && !info->lines->atEnd()) {
+        finishSave(info, false);
+        KMessageBox::sorry(nullptr, i18n("A problem occurred when saving the output.\n%1",
+                                         i18n("The session was closed before all of its output was saved.")));
+        return;
+    }
 
-    // transfer LINES_PER_REQUEST lines from the session's history
-    // to the save location
-    if (!info.session.isNull()) {
-        // note:  when retrieving lines from the emulation,
-        // the first line is at index 0.
+    while (!info->lines->atEnd()
+            && info->thread->pendingBlocks() < MAX_PENDING_BLOCKS
+            && info->data.size() < MAX_PENDING_DATA) {
+        QElapsedTimer timer;
+        timer.start();
 
-        int sessionLines = info.session->emulation()->lineCount();
+        // the lines cannot be followed once the history was replaced or the
+        // terminal was resized; a partial file is not kept
+        LineBlock block;
+        if (!info->lines->copyBlock(info->blockLines, block)) {
+            finishSave(info, false);
+            KMessageBox::sorry(nullptr, i18n("A problem occurred when saving the output.\n%1",
+                                             i18n("The output was replaced before all of it was saved.")));
+            return;
+        }
+        if (block.lineCount() > 0) {
+            info->thread->addBlock(block);
+        }
 
-        if (sessionLines - 1 == info.lastLineFetched) {
-            return; // if there is no more data to transfer then stop the job
+        const qint64 elapsed = timer.nsecsElapsed();
+        if (elapsed < BLOCK_COPY_TIME / 2) {
+            info->blockLines = qMin(info->blockLines * 2, MAX_BLOCK_LINES);
+        } else if (elapsed > BLOCK_COPY_TIME) {
+            info->blockLines = qMax(info->blockLines / 2, MIN_BLOCK_LINES);
         }
+    }
 
-        int copyUpToLine = qMin(info.lastLineFetched + LINES_PER_REQUEST ,
-                                sessionLines - 1);
+    if (info->lines->atEnd()) {
+        info->thread->finish();
+    }
+}
+
+void SaveHistoryTask::blockSaved(int lineCount, const QByteArray &data)
+{
+    SaveJob *info = findSaveJob(sender());
+    if (info == nullptr) {
+        return;
+    }
 
-        QTextStream stream(&data, QIODevice::ReadWrite);
-        info.decoder->begin(&stream);
-        info.session->emulation()->writeToStream(info.decoder , info.lastLineFetched + 1 , copyUpToLine);
-        info.decoder->end();
+    info->linesSaved += lineCount;
+    info->progress->setValue(static_cast<int>(qMin<qint64>(99, info->linesSaved * qint64(100) / info->lines->lineCount())));
 
-        info.lastLineFetched = copyUpToLine;
+    info->data += data;
+    sendData(info);
+    queueBlocks(info);
+}
+
+void SaveHistoryTask::threadFinished()
+{
+    SaveJob *info = findSaveJob(sender());
+    if (info == nullptr) {
+        return;
+    }
+
+    const QString errorString = info->thread->errorString();
+    if (!errorString.isEmpty()) {
+        finishSave(info, false);
+        KMessageBox::sorry(nullptr , i18n("A problem occurred when saving the output.\n%1", errorString));
+        return;
+    }
+
+    info->threadFinished = true;
+
+    if (info->job == nullptr) {
+        finishSave(info, true);
+    } else {
+        sendData(info);
     }
 }
+
+void SaveHistoryTask::sendData(SaveJob *info)
+{
+    // the largest block of data sent to the job at once
+    static const int MAX_DATA_SIZE = 1024 * 1024;
+
+    // sending empty data ends the transfer
+    if (info->job == nullptr || !info->dataRequested
+            || (info->data.isEmpty() && !info->threadFinished)) {
+        return;
+    }
+
+    const QByteArray data = info->data.left(MAX_DATA_SIZE);
+    info->data.remove(0, data.size());
+    info->dataRequested = false;
+
+    info->job->sendAsyncData(data);
+}
+
+void SaveHistoryTask::jobDataRequested(KIO::Job* job , QByteArray& data)
+{
+    // the data is sent with sendAsyncData() once it is decoded
+    Q_UNUSED(data);
+
+    SaveJob *info = findSaveJob(job);
+    if (info == nullptr) {
+        return;
+    }
+
+    info->dataRequested = true;
+    sendData(info);
+    queueBlocks(info);
+}
+
 void SaveHistoryTask::jobResult(KJob* job)
 {
+    SaveJob *info = findSaveJob(job);
+    if (info == nullptr) {
+        return;
+    }
+
+    // the job deletes itself
+    info->job = nullptr;
+
     if (job->error() != 0) {
-        KMessageBox::sorry(nullptr , i18n("A problem occurred when saving the output.\n%1", job->errorString()));
+        const QString errorString = job->errorString();
+        finishSave(info, false);
+        KMessageBox::sorry(nullptr , i18n("A problem occurred when saving the output.\n%1", errorString));
+        return;
     }
 
-    TerminalCharacterDecoder * decoder = _jobSession[job].decoder;
+    finishSave(info, true);
+}
+
+void SaveHistoryTask::finishSave(SaveJob *info, bool success)
+{
+    _saveJobs.removeOne(info);
+
+    if (info->job != nullptr) {
+        disconnect(info->job, nullptr, this, nullptr);
+        info->job->kill();
+    }
+
+    if (success) {
+        const qint64 bytes = info->thread->bytesSaved();
+        const qint64 elapsed = qMax<qint64>(1, info->timer.elapsed());
+        qCDebug(KonsoleDebug) << "Saved" << bytes << "bytes of output in" << elapsed << "ms,"
+                              << (bytes / (1024.0 * 1024.0)) / (elapsed / 1000.0) << "MB/s";
+    }
+
+    disconnect(info->thread, nullptr, this, nullptr);
+    info->thread->cancel();
+    info->thread->deleteLater();
 
-    _jobSession.remove(job);
+    // this may be called from the dialog's canceled() signal
+    disconnect(info->progress, nullptr, this, nullptr);
+    info->progress->deleteLater();
 
-    delete decoder;
+    delete info->lines;
+    delete info;
 
     // notify the world that the task is done
-    emit completed(true);
+    emit completed(success);
 
-    if (autoDelete()) {
+    if (autoDelete() && _saveJobs.isEmpty()) {
         deleteLater();
     }
 }
@@ -1931,7 +2128,40 @@ void SearchHistoryTask::execute()
 
     while (iter.hasNext()) {
         iter.next();
-        executeOnScreenWindow(iter.key() , iter.value());
+        _pendingWindows << qMakePair(iter.key(), iter.value());
+    }
+
+    executeNextScreenWindow();
+}
+
+void SearchHistoryTask::cancel()
+{
+    _pendingWindows.clear();
+    _ranges.clear();
+    _pendingRanges.clear();
+
+    if (_thread != nullptr) {
+        disconnect(_thread, nullptr, this, nullptr);
+        _thread->cancel();
+    }
+
+    if (autoDelete()) {
+        deleteLater();
+    }
+}
+
+void SearchHistoryTask::executeNextScreenWindow()
+{
+    while (!_pendingWindows.isEmpty()) {
+        const QPair<SessionPtr, ScreenWindowPtr> next = _pendingWindows.takeFirst();
+        if (!next.first.isNull() && !next.second.isNull()) {
+            executeOnScreenWindow(next.first, next.second);
+            return;
+        }
+    }
+
+    if (autoDelete()) {
+        deleteLater();
     }
 }
 
@@ -1940,123 +2170,181 @@ void SearchHistoryTask::executeOnScreenWindow(SessionPtr session , ScreenWindowP
     Q_ASSERT(session);
     Q_ASSERT(window);
 
-    Emulation* emulation = session->emulation();
+    const int lastLine = window->lineCount() - 1;
 
-    if (!_regExp.pattern().isEmpty()) {
-        int pos = -1;
-        const bool forwards = (_direction == Enum::ForwardsSearch);
-        const int lastLine = window->lineCount() - 1;
+    if (_regExp.pattern().isEmpty() || lastLine < 0) {
+        emit completed(false);
+        executeNextScreenWindow();
+        return;
+    }
 
-        int startLine;
-        if (forwards && (_startLine == lastLine)) {
-            startLine = 0;
-        } else if (!forwards && (_startLine == 0)) {
-            startLine = lastLine;
-        } else {
-            startLine = _startLine + (forwards ? 1 : -1);
+    const bool forwards = (_direction == Enum::ForwardsSearch);
+
+    int startLine;
+    if (forwards && (_startLine == lastLine)) {
+        startLine = 0;
+    } else if (!forwards && (_startLine == 0)) {
+        startLine = lastLine;
+    } else {
+        startLine = _startLine + (forwards ? 1 : -1);
+    }
+    startLine = qBound(0, startLine, lastLine);
+
+    // search from the start line to the end of the output in the search
+    // direction, then continue from the other end
+    _ranges.clear();
+    if (forwards) {
+        for (int line = startLine; line <= lastLine; line += BLOCK_LINES) {
+            _ranges.enqueue(qMakePair(line, qMin(line + BLOCK_LINES - 1, lastLine)));
+        }
+        for (int line = 0; line < startLine; line += BLOCK_LINES) {
+            _ranges.enqueue(qMakePair(line, qMin(line + BLOCK_LINES - 1, startLine - 1)));
+        }
+    } else {
+        for (int line = startLine; line >= 0; line -= BLOCK_LINES) {
+            _ranges.enqueue(qMakePair(qMax(line - BLOCK_LINES + 1, 0), line));
         }
+        for (int line = lastLine; line > startLine; line -= BLOCK_LINES) {
+            _ranges.enqueue(qMakePair(qMax(line - BLOCK_LINES + 1, startLine + 1), line));
+        }
+    }
 
-        QString string;
-
-        //text stream to read history into string for pattern or regular expression searching
-        QTextStream searchStream(&string);
-
-        PlainTextDecoder decoder;
-        decoder.setRecordLinePositions(true);
-
-        //setup first and last lines depending on search direction
-        int line = startLine;
-
-        //read through and search history in blocks of 10K lines.
-        //this balances the need to retrieve lots of data from the history each time
-        //(for efficient searching)
-        //without using silly amounts of memory if the history is very large.
-        const int maxDelta = qMin(window->lineCount(), 10000);
-        int delta = forwards ? maxDelta : -maxDelta;
-
-        int endLine = line;
-        bool hasWrapped = false;  // set to true when we reach the top/bottom
-        // of the output and continue from the other
-        // end
-
-        //loop through history in blocks of <delta> lines.
-        do {
-            // ensure that application does not appear to hang
-            // if searching through a lengthy output
-            QApplication::processEvents();
-
-            // calculate lines to search in this iteration
-            if (hasWrapped) {
-                if (endLine == lastLine) {
-                    line = 0;
-                } else if (endLine == 0) {
-                    line = lastLine;
-                }
-
-                endLine += delta;
-
-                if (forwards) {
-                    endLine = qMin(startLine , endLine);
-                } else {
-                    endLine = qMax(startLine , endLine);
-                }
-            } else {
-                endLine += delta;
-
-                if (endLine > lastLine) {
-                    hasWrapped = true;
-                    endLine = lastLine;
-                } else if (endLine < 0) {
-                    hasWrapped = true;
-                    endLine = 0;
-                }
-            }
+    _session = session;
+    _window = window;
+    _screen = window->screen();
+    _historyId = _screen->historyId();
+    _firstDroppedLine = _screen->totalDroppedLines();
+    _pendingRanges.clear();
+    _requiredText = HistorySearchIndex::requiredText(_regExp);
+    _linesSearched = 0;
+    _lineCount = lastLine + 1;
 
-            decoder.begin(&searchStream);
-            emulation->writeToStream(&decoder, qMin(endLine, line) , qMax(endLine, line));
-            decoder.end();
+    _thread = new SearchHistoryThread(_regExp, this);
+    connect(_thread, &Konsole::SearchHistoryThread::blockSearched,
+            this, &Konsole::SearchHistoryTask::blockSearched);
 
-            // line number search below assumes that the buffer ends with a new-line
-            string.append(QLatin1Char('\n'));
+    _thread->start();
+    continueSearch();
+}
 
-            if (forwards) {
-                pos = string.indexOf(_regExp);
-            } else {
-                pos = string.lastIndexOf(_regExp);
-            }
+void SearchHistoryTask::queueBlocks()
+{
+    // keep a couple of blocks ready for the search thread; copying more
+    // in advance would only use memory if a match is found early
+    static const int MAX_PENDING_BLOCKS = 2;
 
-            //if a match is found, position the cursor on that line and update the screen
-            if (pos != -1) {
-                int newLines = 0;
-                QList<int> linePositions = decoder.linePositions();
-                while (newLines < linePositions.count() && linePositions[newLines] <= pos) {
-                    newLines++;
-                }
+    const int historyLines = _screen->getHistLines();
+    const int lastLine = historyLines + _screen->getLines() - 1;
+    const int dropped = droppedLines();
 
-                // ignore the new line at the start of the buffer
-                newLines--;
+    while (!_ranges.isEmpty() && _thread->pendingBlocks() < MAX_PENDING_BLOCKS) {
+        const QPair<int, int> range = _ranges.dequeue();
 
-                int findPos = qMin(line, endLine) + newLines;
+        // the output moves up when lines are dropped from the history
+        const int first = qMax(0, range.first - dropped);
+        const int last = qMin(range.second - dropped, lastLine);
 
-                highlightResult(window, findPos);
+        // skip the lines of the history which the index knows cannot match,
+        // and those which were dropped
+        if (first > last || (!_requiredText.isEmpty() && last < historyLines
+                             && !_screen->historyMayContain(first, last, _requiredText))) {
+            _linesSearched += range.second - range.first + 1;
+            continue;
+        }
 
-                emit completed(true);
+        // the block overlaps the next one up to the end of the logical line
+        int end = last;
+        while (end < lastLine && end - last < BLOCK_LINES
+                && (_screen->getLineProperties(end, end).at(0) & LINE_WRAPPED) != 0) {
+            end++;
+        }
 
-                return;
-            }
+        LineBlock block;
+        _screen->copyLines(first, end, block);
+        block.firstLine = first + dropped;
+        _thread->addBlock(block);
+        _pendingRanges.enqueue(qMakePair(first + dropped, range.second));
+    }
+}
+
+int SearchHistoryTask::droppedLines() const
+{
+    return static_cast<int>(_screen->totalDroppedLines() - _firstDroppedLine);
+}
+
+void SearchHistoryTask::blockSearched(int firstLine, int lineCount, const QVector<SearchMatch> &matches)
+{
+    // ignore results which were already queued when the search was stopped
+    if (_thread == nullptr || sender() != _thread) {
+        return;
+    }
+
+    // the lines are numbered differently after switching between the normal
+    // and the alternate screen or after the history was replaced
+    if (_session.isNull() || _window.isNull()
+            || _window->screen() != _screen || _screen->historyId() != _historyId) {
+        finishScreenWindow(false);
+        return;
+    }
+
+    const QPair<int, int> range = !_pendingRanges.isEmpty() ? _pendingRanges.dequeue()
+                                                            : qMakePair(firstLine, firstLine + lineCount - 1);
+
+    // the matches which start after the range are found in the next block
+    QVector<SearchMatch> found;
+    foreach (const SearchMatch &match, matches) {
+        if (match.startLine >= range.first && match.startLine <= range.second) {
+            found.append(match);
+        }
+    }
+
+    //if a match is found, position the cursor on that line and update the screen
+    if (!found.isEmpty()) {
+        const bool forwards = (_direction == Enum::ForwardsSearch);
+        const int line = forwards ? found.first().startLine : found.last().startLine;
+        highlightResult(_window, qMax(0, line - droppedLines()));
+        finishScreenWindow(true);
+        return;
+    }
 
-            //clear the current block of text and move to the next one
-            string.clear();
-            line = endLine;
-        } while (startLine != endLine);
+    _linesSearched += range.second - range.first + 1;
 
+    continueSearch();
+}
+
+void SearchHistoryTask::continueSearch()
+{
+    queueBlocks();
+
+    if (_ranges.isEmpty() && _thread->pendingBlocks() == 0) {
         // if no match was found, clear selection to indicate this
-        window->clearSelection();
-        window->notifyOutputChanged();
+        _window->clearSelection();
+        _window->notifyOutputChanged();
+
+        finishScreenWindow(false);
+        return;
     }
 
-    emit completed(false);
+    emit progressChanged(static_cast<int>(qMin<qint64>(100, qint64(_linesSearched) * 100 / _lineCount)));
 }
+
+void SearchHistoryTask::finishScreenWindow(bool found)
+{
+    _ranges.clear();
+    _pendingRanges.clear();
+
+    if (_thread != nullptr) {
+        disconnect(_thread, nullptr, this, nullptr);
+        _thread->cancel();
+        _thread->deleteLater();
+        _thread = nullptr;
+    }
+
+    emit completed(found);
+
+    executeNextScreenWindow();
+}
+
 void SearchHistoryTask::highlightResult(ScreenWindowPtr window , int findPos)
 {
     //work out how many lines into the current block of text the search result was found
@@ -2084,8 +2372,17 @@ SearchHistoryTask::SearchHistoryTask(QObject* parent)
     : SessionTask(parent)
     , _direction(Enum::BackwardsSearch)
     , _startLine(0)
+    , _screen(nullptr)
+    , _historyId(0)
+    , _firstDroppedLine(0)
+    , _thread(nullptr)
+    , _linesSearched(0)
+    , _lineCount(0)
 {
 }
+
+SearchHistoryTask::~SearchHistoryTask() = default;
+
 void SearchHistoryTask::setSearchDirection(Enum::SearchDirection direction)
 {
     _direction = direction;
@@ -22,12 +22,16 @@
 #define SESSIONCONTROLLER_H
 
 // Qt
+#include <QElapsedTimer>
 #include <QList>
 #include <QSet>
 #include <QPointer>
 #include <QString>
 #include <QHash>
+#include <QPair>
+#include <QQueue>
 #include <QRegularExpression>
+#include <QVector>
 
 // KDE
 #include <KXMLGUIClient>
@@ -39,12 +43,13 @@
 
 namespace KIO {
 class Job;
+class TransferJob;
 }
 
 class QAction;
 class QTextCodec;
 class QKeyEvent;
-class QTimer;
+class QProgressDialog;
 class QUrl;
 
 class KCodecAction;
@@ -55,17 +60,22 @@ class KActionMenu;
 namespace Konsole {
 class Session;
 class SessionGroup;
+class Screen;
 class ScreenWindow;
 class TerminalDisplay;
 class IncrementalSearchBar;
 class ProfileList;
-class RegExpFilter;
 class UrlFilter;
 class FileFilter;
 class EditProfileDialog;
+class SearchHistoryTask;
+class SearchHistoryThread;
+class SearchMatchCache;
+struct SearchMatch;
 
 // SaveHistoryTask
-class TerminalCharacterDecoder;
+class SaveHistoryThread;
+class SaveHistoryLines;
 
 typedef QPointer<Session> SessionPtr;
 
@@ -270,6 +280,7 @@ private Q_SLOTS:
     // history search bar's close button
 
     void updateFilterList(Profile::Ptr profile); // Called when the profile has changed, so we might need to change the list of filters
+    void directoryListed(); // called when a directory was listed for the file filters
 
     void interactionHandler();
     void snapshot(); // called periodically as the user types
@@ -283,8 +294,6 @@ private Q_SLOTS:
     // when a key press occurs in the
     // display area
 
-    void updateSearchFilter();
-
     void zmodemDownload();
     void zmodemUpload();
 
@@ -304,7 +313,7 @@ private:
     bool reverseSearchChecked() const;
     void setupCommonActions();
     void setupExtraActions();
-    void removeSearchFilter(); // remove and delete the current search filter if set
+    void removeSearchMatches(); // remove and delete the current search matches if set
     void setFindNextPrevEnabled(bool enabled);
     void listenForScreenWindowUpdates();
 
@@ -322,7 +331,7 @@ private:
     QString _sessionIconName;
     int _previousState;
 
-    RegExpFilter *_searchFilter;
+    SearchMatchCache *_searchMatches;
     UrlFilter *_urlFilter;
     FileFilter *_fileFilter;
 
@@ -332,8 +341,6 @@ private:
     QAction *_findNextAction;
     QAction *_findPreviousAction;
 
-    QTimer *_interactionTimer;
-
     int _searchStartLine;
     int _prevSearchResultLine;
 
@@ -361,6 +368,8 @@ private:
 
     QString _searchText;
     QPointer<IncrementalSearchBar> _searchBar;
+    // the search which is currently running in the background, if any
+    QPointer<SearchHistoryTask> _searchTask;
 };
 inline bool SessionController::isValid() const
 {
@@ -424,6 +433,11 @@ private:
 /**
  * A task which prompts for a URL for each session and saves that session's output
  * to the given URL
+ *
+ * The output is copied from the screen in blocks of lines on the GUI thread, while
+ * decoding and writing happen in a SaveHistoryThread.  The lines which are saved are
+ * those in the output when the save starts.  Local files are written directly by
+ * the thread, the output for remote URLs is sent with a KIO job.
  */
 class SaveHistoryTask : public SessionTask
 {
@@ -439,30 +453,46 @@ public:
      * each session's history to the given URL.
      *
      * The data transfer is performed asynchronously and will continue after execute() returns.
+     * A progress dialog, which allows to cancel the transfer, is shown if it takes a while.
      */
     void execute() Q_DECL_OVERRIDE;
 
 private Q_SLOTS:
     void jobDataRequested(KIO::Job *job, QByteArray &data);
     void jobResult(KJob *job);
+    void blockSaved(int lineCount, const QByteArray &data);
+    void threadFinished();
 
 private:
-    class SaveJob // structure to keep information needed to process
-        // incoming data requests from jobs
+    class SaveJob // structure to keep information needed to copy
+        // the output to the thread, and the data to the job
     {
     public:
         SessionPtr session; // the session associated with a history save job
-        int lastLineFetched; // the last line processed in the previous data request
-        // set this to -1 at the start of the save job
-
-        TerminalCharacterDecoder *decoder;  // decoder used to convert terminal characters
-        // into output
+        SaveHistoryLines *lines; // copies the lines of the screen to save,
+        // whichever screen is used later
+        int blockLines; // the number of lines copied at a time, adapted to
+        // how long copying takes
+        int linesSaved; // the number of lines saved by the thread so far
+
+        SaveHistoryThread *thread; // decodes the output, and writes local files
+        KIO::TransferJob *job; // transfers the output to remote URLs, or null
+        QByteArray data; // output waiting to be sent to the job
+        bool dataRequested; // whether the job waits for data
+        bool threadFinished; // whether the thread decoded all of the output
+
+        QProgressDialog *progress;
+        QElapsedTimer timer; // measures the throughput
     };
 
-    QHash<KJob *, SaveJob> _jobSession;
+    SaveJob *findSaveJob(const QObject *object) const;
+    void queueBlocks(SaveJob *info);
+    void sendData(SaveJob *info);
+    void finishSave(SaveJob *info, bool success);
+
+    QList<SaveJob *> _saveJobs;
 };
 
-//class SearchHistoryThread;
 /**
  * A task which searches through the output of sessions for matches for a given regular expression.
  * SearchHistoryTask operates on ScreenWindow instances rather than sessions added by addSession().
@@ -471,11 +501,14 @@ private:
  * When execute() is called, the search begins in the direction specified by searchDirection(),
  * starting at the position of the current selection.
  *
+ * The output is copied from the screen in blocks of lines on the GUI thread, while decoding and
+ * matching happen in a SearchHistoryThread, so the application stays responsive when searching
+ * very large output logs.  Lines which are added to the output while searching are not searched,
+ * lines which are dropped from the history are skipped.  Each block goes on to the end of the
+ * logical line of its last line, so that matches which span two blocks are found.
+ *
  * FIXME - This is not a proper implementation of SessionTask, in that it ignores sessions specified
  * with addSession()
- *
- * TODO - Implementation requirements:
- *          May provide progress feedback to the user when searching very large output logs.
  */
 class SearchHistoryTask : public SessionTask
 {
@@ -486,6 +519,7 @@ public:
      * Constructs a new search task.
      */
     explicit SearchHistoryTask(QObject *parent = nullptr);
+    ~SearchHistoryTask() Q_DECL_OVERRIDE;
 
     /** Adds a screen window to the list to search when execute() is called. */
     void addScreenWindow(Session *session, ScreenWindow *searchWindow);
@@ -504,29 +538,81 @@ public:
     void setStartLine(int line);
 
     /**
-     * Performs a search through the session's history, starting at the position
+     * Starts a search through the session's history, starting at the position
      * of the current selection, in the direction specified by setSearchDirection().
      *
+     * The search runs in the background and execute() returns immediately.
      * If it finds a match, the ScreenWindow specified in the constructor is
      * scrolled to the position where the match occurred and the selection
-     * is set to the matching text.  execute() then returns immediately.
+     * is set to the matching text.  completed() is emitted once the search of
+     * each screen window has finished.
      *
      * To continue the search looking for further matches, call execute() again.
      */
     void execute() Q_DECL_OVERRIDE;
 
+    /**
+     * Stops the search if it is still running.  completed() is not emitted
+     * for the screen windows which have not been searched completely.
+     */
+    void cancel();
+
+Q_SIGNALS:
+    /**
+     * Emitted while searching a screen window, when another part of its output
+     * has been searched.
+     *
+     * @param percent How much of the output has been searched so far
+     */
+    void progressChanged(int percent);
+
 private:
     typedef QPointer<ScreenWindow> ScreenWindowPtr;
 
+    void blockSearched(int firstLine, int lineCount, const QVector<SearchMatch> &matches);
+
+    void executeNextScreenWindow();
     void executeOnScreenWindow(SessionPtr session, ScreenWindowPtr window);
+    // copies the next blocks of lines to search and hands them to the search thread
+    void queueBlocks();
+    // queues more blocks, or finishes the search once everything was searched
+    void continueSearch();
+    void finishScreenWindow(bool found);
     void highlightResult(ScreenWindowPtr window, int position);
+    // the number of lines dropped from the history since the search of the
+    // current screen window started
+    int droppedLines() const;
+
+    // the output is searched in blocks of 2K lines.  Every block is copied
+    // from the screen on the GUI thread, so this keeps the time spent there
+    // short, while giving the search thread enough text to work on.
+    static const int BLOCK_LINES = 2000;
 
     QMap< SessionPtr, ScreenWindowPtr > _windows;
     QRegularExpression _regExp;
     Enum::SearchDirection _direction;
     int _startLine;
 
-    //static QPointer<SearchHistoryThread> _thread;
+    // the screen windows which have not been searched yet
+    QList< QPair<SessionPtr, ScreenWindowPtr> > _pendingWindows;
+
+    // the search of the current screen window
+    SessionPtr _session;
+    ScreenWindowPtr _window;
+    // the screen of the window when the search started, and its history
+    Screen *_screen;
+    int _historyId;
+    qint64 _firstDroppedLine;
+    SearchHistoryThread *_thread;
+    // ranges of lines (first, last) which still have to be searched, in search order,
+    // and those handed to the search thread.  Lines are numbered as they were when the
+    // search started, see droppedLines().
+    QQueue< QPair<int, int> > _ranges;
+    QQueue< QPair<int, int> > _pendingRanges;
+    // text which every match contains, used to skip lines with the search index
+    QString _requiredText;
+    int _linesSearched;
+    int _lineCount;
 };
 }
 
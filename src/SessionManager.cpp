@@ -259,6 +259,10 @@ void SessionManager::applyProfile(Session *session, const Profile::Ptr profile,
         case Enum::UnlimitedHistory:
             session->setHistoryType(HistoryTypeFile());
             break;
+
+        case Enum::CompressedUnlimitedHistory:
+            session->setHistoryType(CompressedHistoryType());
+            break;
         }
     }
 
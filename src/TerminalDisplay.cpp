@@ -41,6 +41,7 @@
 #include <QPixmap>
 #include <QScrollBar>
 #include <QStyle>
+#include <QStyleOptionSlider>
 #include <QTimer>
 #include <QDrag>
 #include <QDesktopServices>
@@ -72,6 +73,7 @@
 #include "Session.h"
 #include "WindowSystemInfo.h"
 #include "IncrementalSearchBar.h"
+#include "SearchMatchCache.h"
 
 using namespace Konsole;
 
@@ -118,6 +120,7 @@ void TerminalDisplay::setScreenWindow(ScreenWindow* window)
     }
 
     _screenWindow = window;
+    _compareAllLines = true;
 
     if (!_screenWindow.isNull()) {
         connect(_screenWindow.data() , &Konsole::ScreenWindow::outputChanged , this , &Konsole::TerminalDisplay::updateLineProperties);
@@ -231,6 +234,8 @@ void TerminalDisplay::fontChange(const QFont&)
 
     _fontAscent = fm.ascent();
 
+    _glyphCache.setFont(font());
+
     emit changedFontMetricSignal(_fontHeight, _fontWidth);
     propagateSize();
     update();
@@ -369,6 +374,7 @@ TerminalDisplay::TerminalDisplay(QWidget* parent)
     , _fontHeight(1)
     , _fontWidth(1)
     , _fontAscent(1)
+    , _glyphCache()
     , _boldIntense(true)
     , _lines(1)
     , _columns(1)
@@ -398,6 +404,11 @@ TerminalDisplay::TerminalDisplay(QWidget* parent)
     , _middleClickPasteMode(Enum::PasteFromX11Selection)
     , _scrollBar(nullptr)
     , _scrollbarLocation(Enum::ScrollBarRight)
+    , _searchMatches(nullptr)
+    , _scrollBarMarkers()
+    , _scrollBarMarkersChanged(false)
+    , _scrollBarMarkersLineCount(0)
+    , _scrollBarMarkersHeight(0)
     , _scrollFullPage(false)
     , _wordCharacters(QStringLiteral(":@-./_~"))
     , _bellMode(Enum::NotifyBell)
@@ -406,6 +417,8 @@ TerminalDisplay::TerminalDisplay(QWidget* parent)
     , _textBlinking(false)
     , _cursorBlinking(false)
     , _hasTextBlinker(false)
+    , _blinkingCells(QVector<QRect>())
+    , _compareAllLines(true)
     , _urlHintsModifiers(Qt::NoModifier)
     , _showUrlHint(false)
     , _openLinksByDirectClick(false)
@@ -437,6 +450,11 @@ TerminalDisplay::TerminalDisplay(QWidget* parent)
     , _centerContents(false)
     , _readOnlyMessageWidget(nullptr)
     , _readOnly(false)
+    , _pasteQueue()
+    , _pendingKeyEvents()
+    , _pastePosition(0)
+    , _pasteBracketed(false)
+    , _pasteMessageWidget(nullptr)
     , _opacity(1.0)
     , _scrollWheelState(ScrollState())
     , _searchBar(new IncrementalSearchBar(this))
@@ -454,6 +472,8 @@ TerminalDisplay::TerminalDisplay(QWidget* parent)
     _scrollBar->setCursor(Qt::ArrowCursor);
     connect(_scrollBar, &QScrollBar::valueChanged, this, &Konsole::TerminalDisplay::scrollBarPositionChanged);
     connect(_scrollBar, &QScrollBar::sliderMoved, this, &Konsole::TerminalDisplay::viewScrolledByUser);
+    // draws the search match markers over the scroll bar
+    _scrollBar->installEventFilter(this);
 
     // setup timers for blinking text
     _blinkTextTimer = new QTimer(this);
@@ -515,11 +535,13 @@ TerminalDisplay::~TerminalDisplay()
 
     delete _readOnlyMessageWidget;
     delete _outputSuspendedMessageWidget;
+    delete _pasteMessageWidget;
     delete[] _image;
     delete _filterChain;
 
     _readOnlyMessageWidget = nullptr;
     _outputSuspendedMessageWidget = nullptr;
+    _pasteMessageWidget = nullptr;
 }
 
 /* ------------------------------------------------------------------------- */
@@ -949,20 +971,6 @@ void TerminalDisplay::drawCharacters(QPainter& painter,
     const bool useStrikeOut = ((style->rendition & RE_STRIKEOUT) != 0) || font().strikeOut();
     const bool useOverline = ((style->rendition & RE_OVERLINE) != 0) || font().overline();
 
-    QFont font = painter.font();
-    if (font.bold() != useBold
-            || font.underline() != useUnderline
-            || font.italic() != useItalic
-            || font.strikeOut() != useStrikeOut
-            || font.overline() != useOverline) {
-        font.setBold(useBold);
-        font.setUnderline(useUnderline);
-        font.setItalic(useItalic);
-        font.setStrikeOut(useStrikeOut);
-        font.setOverline(useOverline);
-        painter.setFont(font);
-    }
-
     // setup pen
     const CharacterColor& textColor = (invertCharacterColor ? style->backgroundColor : style->foregroundColor);
     const QColor color = textColor.color(_colorTable);
@@ -975,7 +983,32 @@ void TerminalDisplay::drawCharacters(QPainter& painter,
     // draw text
     if (isLineCharString(text) && !_useFontLineCharacters) {
         drawLineCharString(painter, rect.x(), rect.y(), text, style);
+    } else if (_fixedFont && painter.device() == this
+               && _glyphCache.glyphRun(text, useBold, useItalic, _fontWidth, _glyphRun)) {
+        // simple text is drawn one glyph per cell from the glyph cache,
+        // without shaping it
+        _glyphRun.setUnderline(useUnderline);
+        _glyphRun.setStrikeOut(useStrikeOut);
+        _glyphRun.setOverline(useOverline);
+
+        painter.setClipRect(rect);
+        painter.drawGlyphRun(QPointF(rect.x(), rect.y() + _fontAscent + _lineSpacing), _glyphRun);
+        painter.setClipping(false);
     } else {
+        QFont font = painter.font();
+        if (font.bold() != useBold
+                || font.underline() != useUnderline
+                || font.italic() != useItalic
+                || font.strikeOut() != useStrikeOut
+                || font.overline() != useOverline) {
+            font.setBold(useBold);
+            font.setUnderline(useUnderline);
+            font.setItalic(useItalic);
+            font.setStrikeOut(useStrikeOut);
+            font.setOverline(useOverline);
+            painter.setFont(font);
+        }
+
         // Force using LTR as the document layout for the terminal area, because
         // there is no use cases for RTL emulator and RTL terminal application.
         //
@@ -997,7 +1030,7 @@ void TerminalDisplay::drawTextFragment(QPainter& painter ,
                                        const QString& text,
                                        const Character* style)
 {
-    painter.save();
+    // the state of the painter is saved by drawContents()
 
     // setup painter
     const QColor foregroundColor = style->foregroundColor.color(_colorTable);
@@ -1018,8 +1051,6 @@ void TerminalDisplay::drawTextFragment(QPainter& painter ,
 
     // draw text
     drawCharacters(painter, rect, text, style, invertCharacterColor);
-
-    painter.restore();
 }
 
 void TerminalDisplay::drawPrinterFriendlyTextFragment(QPainter& painter,
@@ -1076,6 +1107,10 @@ void TerminalDisplay::scrollImage(int lines , const QRect& screenWindowRegion)
         return;
     }
 
+    if ((_pasteMessageWidget != nullptr) && _pasteMessageWidget->isVisible()) {
+        return;
+    }
+
     // constrain the region to the display
     // the bottom of the region is capped to the number of lines in the display's
     // internal image - 2, so that the height of 'region' is strictly less
@@ -1191,7 +1226,9 @@ void TerminalDisplay::processFilters()
         return;
     }
 
-    if (!_filterUpdateRequired) {
+    // filters may also be outdated without the output changing, like
+    // the file filter after the working directory was listed again
+    if (!_filterUpdateRequired && !_filterChain->isOutdated()) {
         return;
     }
 
@@ -1225,6 +1262,9 @@ void TerminalDisplay::updateImage()
     // can simply be moved up or down
     // disable this shortcut for transparent konsole with scaled pixels, otherwise we get rendering artefacts, see BUG 350651
     if (!(WindowSystemInfo::HAVE_TRANSPARENCY && (qApp->devicePixelRatio() > 1.0)) && _wallpaper->isNull()) {
+        if (_screenWindow->scrollCount() != 0) {
+            _compareAllLines = true;
+        }
         scrollImage(_screenWindow->scrollCount() ,
                     _screenWindow->scrollRegion());
         _screenWindow->resetScrollCount();
@@ -1250,13 +1290,18 @@ void TerminalDisplay::updateImage()
     const QPoint tL  = contentsRect().topLeft();
     const int    tLx = tL.x();
     const int    tLy = tL.y();
-    _hasTextBlinker = false;
 
     CharacterColor cf;       // undefined
 
     const int linesToUpdate = qMin(_lines, qMax(0, lines));
     const int columnsToUpdate = qMin(_columns, qMax(0, columns));
 
+    // blinking text can only have changed on the lines which are compared
+    _blinkingCells.resize(_lines);
+    for (y = linesToUpdate; y < _lines; ++y) {
+        _blinkingCells[y] = QRect();
+    }
+
     auto dirtyMask = new char[columnsToUpdate + 2];
     QRegion dirtyRegion;
 
@@ -1266,6 +1311,12 @@ void TerminalDisplay::updateImage()
     int dirtyLineCount = 0;
 
     for (y = 0; y < linesToUpdate; ++y) {
+        // unless _image changed otherwise, the lines which did not change in
+        // the screen window are the same in _image
+        if (!_compareAllLines && !_screenWindow->isLineChanged(y)) {
+            continue;
+        }
+
         const Character* currentLine = &_image[y * _columns];
         const Character* const newLine = &newimg[y * columns];
 
@@ -1276,16 +1327,24 @@ void TerminalDisplay::updateImage()
         // its cell boundaries
         memset(dirtyMask, 0, columnsToUpdate + 2);
 
+        int firstBlinking = -1;
+        int lastBlinking = -1;
         for (x = 0 ; x < columnsToUpdate ; ++x) {
             if (newLine[x] != currentLine[x]) {
                 dirtyMask[x] = 1;
             }
+            if ((newLine[x].rendition & RE_BLINK) != 0) {
+                if (firstBlinking == -1) {
+                    firstBlinking = x;
+                }
+                lastBlinking = x;
+            }
         }
+        // one more column, for characters exceeding their cell
+        _blinkingCells[y] = firstBlinking == -1 ? QRect() : QRect(firstBlinking, y, lastBlinking - firstBlinking + 2, 1);
 
         if (!_resizing) { // not while _resizing, we're expecting a paintEvent
             for (x = 0; x < columnsToUpdate; ++x) {
-                _hasTextBlinker |= (newLine[x].rendition & RE_BLINK);
-
                 // Start drawing if this character or the next one differs.
                 // We also take the next one into account to handle the situation
                 // where characters exceed their cell width.
@@ -1387,7 +1446,18 @@ void TerminalDisplay::updateImage()
     // update the parts of the display which have changed
     update(dirtyRegion);
 
-    if (_allowBlinkingText && _hasTextBlinker && !_blinkTextTimer->isActive()) {
+    _screenWindow->resetChangedLines();
+    _compareAllLines = false;
+
+    _hasTextBlinker = false;
+    foreach (const QRect &cells, _blinkingCells) {
+        if (!cells.isEmpty()) {
+            _hasTextBlinker = true;
+            break;
+        }
+    }
+
+    if (_allowBlinkingText && _hasTextBlinker && !_blinkTextTimer->isActive() && isBlinkingVisible()) {
         _blinkTextTimer->start();
     }
     if (!_hasTextBlinker && _blinkTextTimer->isActive()) {
@@ -1439,6 +1509,7 @@ void TerminalDisplay::paintEvent(QPaintEvent* pe)
         drawContents(paint, rect);
     }
     drawCurrentResultRect(paint);
+    drawSearchMatches(paint);
     drawInputMethodPreeditString(paint, preeditRect());
     paintFilters(paint);
 }
@@ -1653,6 +1724,10 @@ void TerminalDisplay::drawContents(QPainter& paint, const QRect& rect)
     const int rlx = qMin(_usedColumns - 1, qMax(0, (rect.right()  - tLx - _contentRect.left()) / _fontWidth));
     const int rly = qMin(_usedLines - 1,  qMax(0, (rect.bottom() - tLy - _contentRect.top()) / _fontHeight));
 
+    // the fragments change the pen, the font and the clipping of the
+    // painter, which are restored once at the end
+    paint.save();
+
     const int numberOfColumns = _usedColumns;
     QVector<uint> univec;
     univec.reserve(numberOfColumns);
@@ -1812,6 +1887,8 @@ void TerminalDisplay::drawContents(QPainter& paint, const QRect& rect)
             x += len - 1;
         }
     }
+
+    paint.restore();
 }
 
 void TerminalDisplay::drawCurrentResultRect(QPainter& painter)
@@ -1825,6 +1902,121 @@ void TerminalDisplay::drawCurrentResultRect(QPainter& painter)
     painter.fillRect(r, QColor(0, 0, 255, 80));
 }
 
+void TerminalDisplay::drawSearchMatches(QPainter& painter)
+{
+    if (_searchMatches.isNull() || !_searchMatches->isEnabled() || _screenWindow.isNull()) {
+        return;
+    }
+
+    const int firstLine = _screenWindow->currentLine();
+    const int lastLine = firstLine + _usedLines - 1;
+
+    foreach (const SearchMatch &match, _searchMatches->matches(firstLine, lastLine)) {
+        // matches can span several wrapped lines
+        for (int line = qMax(match.startLine, firstLine); line <= qMin(match.endLine, lastLine); line++) {
+            const int startColumn = (line == match.startLine) ? match.startColumn : 0;
+            const int endColumn = (line == match.endLine) ? match.endColumn : _usedColumns;
+
+            QRect r;
+            r.setCoords(startColumn * _fontWidth + _contentRect.left(),
+                        (line - firstLine) * _fontHeight + _contentRect.top(),
+                        endColumn * _fontWidth + _contentRect.left() - 1,
+                        (line - firstLine + 1) * _fontHeight + _contentRect.top() - 1);
+
+            const bool isCurrentResultLine = (_screenWindow->currentResultLine() == line);
+            painter.fillRect(r, searchMatchColor(isCurrentResultLine, 120));
+        }
+    }
+}
+
+QColor TerminalDisplay::searchMatchColor(bool current, int alpha) const
+{
+    // the system colors follow the default colors in the color table
+    static const int RED = 2 + 1;
+    static const int YELLOW = 2 + 3;
+
+    QColor color = _colorTable[current ? YELLOW : RED];
+    color.setAlpha(alpha);
+    return color;
+}
+
+void TerminalDisplay::setSearchMatches(SearchMatchCache *matches)
+{
+    if (!_searchMatches.isNull()) {
+        disconnect(_searchMatches.data(), nullptr, this, nullptr);
+    }
+
+    _searchMatches = matches;
+
+    if (matches != nullptr) {
+        connect(matches, &Konsole::SearchMatchCache::matchesChanged, this, &Konsole::TerminalDisplay::searchMatchesChanged);
+    }
+
+    searchMatchesChanged();
+}
+
+void TerminalDisplay::searchMatchesChanged()
+{
+    _scrollBarMarkersChanged = true;
+    _scrollBar->update();
+    update();
+}
+
+void TerminalDisplay::drawScrollBarMarkers()
+{
+    QStyleOptionSlider option;
+    option.initFrom(_scrollBar);
+    option.orientation = _scrollBar->orientation();
+    option.minimum = _scrollBar->minimum();
+    option.maximum = _scrollBar->maximum();
+    option.sliderPosition = _scrollBar->sliderPosition();
+    option.sliderValue = _scrollBar->value();
+    option.singleStep = _scrollBar->singleStep();
+    option.pageStep = _scrollBar->pageStep();
+    const QRect groove = _scrollBar->style()->subControlRect(QStyle::CC_ScrollBar, &option,
+                                                             QStyle::SC_ScrollBarGroove, _scrollBar);
+
+    const int lineCount = _screenWindow->lineCount();
+    if (groove.height() <= 0 || lineCount <= 0) {
+        return;
+    }
+
+    // the markers are only computed again when something changed, rather
+    // than for each repaint of the scroll bar
+    if (_scrollBarMarkersChanged || _scrollBarMarkersLineCount != lineCount
+            || _scrollBarMarkersHeight != groove.height()) {
+        _scrollBarMarkers.clear();
+        foreach (int line, _searchMatches->matchedLines()) {
+            const int y = static_cast<int>(static_cast<qint64>(line) * groove.height() / lineCount);
+            if (_scrollBarMarkers.isEmpty() || _scrollBarMarkers.last() != y) {
+                _scrollBarMarkers.append(y);
+            }
+        }
+        _scrollBarMarkersChanged = false;
+        _scrollBarMarkersLineCount = lineCount;
+        _scrollBarMarkersHeight = groove.height();
+    }
+
+    QPainter painter(_scrollBar);
+    const QColor color = searchMatchColor(false, 160);
+    foreach (int y, _scrollBarMarkers) {
+        painter.fillRect(groove.left(), groove.top() + y, groove.width(), 2, color);
+    }
+}
+
+bool TerminalDisplay::eventFilter(QObject *watched, QEvent *event)
+{
+    if (watched == _scrollBar && event->type() == QEvent::Paint
+            && !_searchMatches.isNull() && _searchMatches->isEnabled() && !_screenWindow.isNull()) {
+        // paint the scroll bar first, then the markers over it
+        _scrollBar->event(event);
+        drawScrollBarMarkers();
+        return true;
+    }
+
+    return QWidget::eventFilter(watched, event);
+}
+
 QRect TerminalDisplay::imageToWidget(const QRect& imageArea) const
 {
     QRect result;
@@ -1846,7 +2038,7 @@ void TerminalDisplay::setBlinkingCursorEnabled(bool blink)
 {
     _allowBlinkingCursor = blink;
 
-    if (blink && !_blinkCursorTimer->isActive()) {
+    if (blink && !_blinkCursorTimer->isActive() && isBlinkingVisible()) {
         _blinkCursorTimer->start();
     }
 
@@ -1864,37 +2056,27 @@ void TerminalDisplay::setBlinkingTextEnabled(bool blink)
 {
     _allowBlinkingText = blink;
 
-    if (blink && !_blinkTextTimer->isActive()) {
+    if (blink && _hasTextBlinker && !_blinkTextTimer->isActive() && isBlinkingVisible()) {
         _blinkTextTimer->start();
     }
 
     if (!blink && _blinkTextTimer->isActive()) {
         _blinkTextTimer->stop();
-        _textBlinking = false;
+        if (_textBlinking) {
+            _textBlinking = false;
+            update(blinkingTextRegion());
+        }
     }
 }
 
 void TerminalDisplay::focusOutEvent(QFocusEvent*)
 {
-    // trigger a repaint of the cursor so that it is both:
-    //
-    //   * visible (in case it was hidden during blinking)
-    //   * drawn in a focused out state
-    _cursorBlinking = false;
-    updateCursor();
-
-    // suppress further cursor blinking
-    _blinkCursorTimer->stop();
-    Q_ASSERT(!_cursorBlinking);
-
-    // if text is blinking (hidden), blink it again to make it shown
-    if (_textBlinking) {
-        blinkTextEvent();
-    }
+    // suppress further blinking, showing the cursor and the text in case
+    // they were hidden
+    stopBlinking();
 
-    // suppress further text blinking
-    _blinkTextTimer->stop();
-    Q_ASSERT(!_textBlinking);
+    // trigger a repaint of the cursor so that it is drawn in a focused out state
+    updateCursor();
 
     _showUrlHint = false;
 
@@ -1922,9 +2104,7 @@ void TerminalDisplay::blinkTextEvent()
 
     _textBlinking = !_textBlinking;
 
-    // TODO: Optimize to only repaint the areas of the widget where there is
-    // blinking text rather than repainting the whole widget.
-    update();
+    update(blinkingTextRegion());
 }
 
 void TerminalDisplay::blinkCursorEvent()
@@ -1935,6 +2115,37 @@ void TerminalDisplay::blinkCursorEvent()
     updateCursor();
 }
 
+QRegion TerminalDisplay::blinkingTextRegion() const
+{
+    QRegion region;
+    foreach (const QRect &cells, _blinkingCells) {
+        if (!cells.isEmpty()) {
+            region |= imageToWidget(cells);
+        }
+    }
+    return region;
+}
+
+bool TerminalDisplay::isBlinkingVisible() const
+{
+    return isVisible() && hasFocus() && isActiveWindow();
+}
+
+void TerminalDisplay::stopBlinking()
+{
+    _blinkCursorTimer->stop();
+    if (_cursorBlinking) {
+        _cursorBlinking = false;
+        updateCursor();
+    }
+
+    _blinkTextTimer->stop();
+    if (_textBlinking) {
+        _textBlinking = false;
+        update(blinkingTextRegion());
+    }
+}
+
 void TerminalDisplay::updateCursor()
 {
     if (!isCursorOnDisplay()){
@@ -2025,6 +2236,8 @@ void TerminalDisplay::makeImage()
 
 void TerminalDisplay::clearImage()
 {
+    _compareAllLines = true;
+
     for (int i = 0; i < _imageSize; ++i) {
         _image[i] = Screen::DefaultChar;
     }
@@ -2091,6 +2304,9 @@ void TerminalDisplay::showEvent(QShowEvent*)
 }
 void TerminalDisplay::hideEvent(QHideEvent*)
 {
+    // nothing blinks where it cannot be seen
+    stopBlinking();
+
     emit changedContentSizeSignal(_contentRect.height(), _contentRect.width());
 }
 
@@ -2220,6 +2436,12 @@ void TerminalDisplay::mousePressEvent(QMouseEvent* ev)
         }
     }
 
+    if (_pasteMessageWidget != nullptr) {
+        if (_pasteMessageWidget->isVisible() && _pasteMessageWidget->frameGeometry().contains(ev->pos())) {
+            return;
+        }
+    }
+
     int charLine;
     int charColumn;
     getCharacterPosition(ev->pos(), charLine, charColumn, !_usesMouseTracking);
@@ -3260,16 +3482,148 @@ void TerminalDisplay::doPaste(QString text, bool appendReturn)
     }
 
     if (!text.isEmpty()) {
-        text.replace(QLatin1Char('\n'), QLatin1Char('\r'));
-        if (bracketedPasteMode()) {
-            text.remove(QLatin1String("\033"));
-            text.prepend(QLatin1String("\033[200~"));
-            text.append(QLatin1String("\033[201~"));
-        }
-        // perform paste by simulating keypress events
-        QKeyEvent e(QEvent::KeyPress, 0, Qt::NoModifier, text);
+        // large pastes are sent in parts, a paste which is made while
+        // another one is sent goes after it
+        _pasteQueue.enqueue(text);
+        if (_pasteQueue.size() == 1) {
+            _pastePosition = 0;
+            continuePaste();
+        }
+    }
+}
+
+void TerminalDisplay::continuePaste()
+{
+    // the number of characters sent at once; the next part of a paste is only
+    // sent once the terminal process read the previous one, so that a large
+    // paste is neither buffered as a whole nor blocks the application
+    static const int PASTE_CHUNK_SIZE = 4096;
+
+    if (_pasteQueue.isEmpty()) {
+        return;
+    }
+
+    const QString &text = _pasteQueue.head();
+    const bool first = (_pastePosition == 0);
+    if (first) {
+        _pasteBracketed = bracketedPasteMode();
+    }
+
+    int end = qMin(_pastePosition + PASTE_CHUNK_SIZE, text.length());
+    if (end < text.length() && text.at(end - 1).isHighSurrogate()) {
+        end++;
+    }
+    const bool last = (end == text.length());
+
+    QString chunk;
+    chunk.reserve(end - _pastePosition + 12);
+    if (first && _pasteBracketed) {
+        chunk.append(QLatin1String("\033[200~"));
+    }
+
+    // translate the newlines, and remove the escape characters which could
+    // end a bracketed paste, in one pass
+    const QChar *data = text.constData();
+    for (int i = _pastePosition; i < end; i++) {
+        if (data[i] == QLatin1Char('\n')) {
+            chunk.append(QLatin1Char('\r'));
+        } else if (!_pasteBracketed || data[i] != QLatin1Char('\033')) {
+            chunk.append(data[i]);
+        }
+    }
+
+    if (last && _pasteBracketed) {
+        chunk.append(QLatin1String("\033[201~"));
+    }
+
+    if (last) {
+        _pasteQueue.dequeue();
+        _pastePosition = 0;
+    } else {
+        _pastePosition = end;
+    }
+
+    updatePasteMessage();
+
+    if (chunk.isEmpty()) {
+        // nothing is written to the terminal process which would continue
+        // the paste
+        QMetaObject::invokeMethod(this, "continuePaste", Qt::QueuedConnection);
+        return;
+    }
+
+    // perform paste by simulating keypress events
+    QKeyEvent e(QEvent::KeyPress, 0, Qt::NoModifier, chunk);
+    emit keyPressedSignal(&e);
+
+    if (last) {
+        sendPendingKeyEvents();
+    }
+
+    // the paste goes on once the chunk was written.  Nothing is written when
+    // the session became read-only or the terminal process cannot take
+    // input anymore, and the paste would never end.
+    if (!_pasteQueue.isEmpty() && _sessionController != nullptr
+            && !_sessionController->session()->isSendingData()) {
+        cancelPaste();
+    }
+}
+
+void TerminalDisplay::sendPendingKeyEvents()
+{
+    const QList<QKeyEvent> events = _pendingKeyEvents;
+    _pendingKeyEvents.clear();
+
+    foreach (QKeyEvent event, events) {
+        emit keyPressedSignal(&event);
+    }
+}
+
+void TerminalDisplay::cancelPaste()
+{
+    // let the program know that the paste it was receiving ended
+    if (_pastePosition > 0 && _pasteBracketed) {
+        QKeyEvent e(QEvent::KeyPress, 0, Qt::NoModifier, QStringLiteral("\033[201~"));
         emit keyPressedSignal(&e);
     }
+
+    _pasteQueue.clear();
+    _pastePosition = 0;
+
+    updatePasteMessage();
+    sendPendingKeyEvents();
+}
+
+void TerminalDisplay::updatePasteMessage()
+{
+    // only pastes which take a while to send show up
+    static const int PASTE_MESSAGE_SIZE = 64 * 1024;
+
+    if (_pastePosition == 0 || _pasteQueue.head().length() < PASTE_MESSAGE_SIZE) {
+        if (_pasteMessageWidget != nullptr && _pasteMessageWidget->isVisible()) {
+            _pasteMessageWidget->animatedHide();
+        }
+        return;
+    }
+
+    if (_pasteMessageWidget == nullptr) {
+        _pasteMessageWidget = createMessageWidget(QString());
+        _pasteMessageWidget->setMessageType(KMessageWidget::Information);
+        _pasteMessageWidget->setCloseButtonVisible(false);
+
+        auto cancelAction = new QAction(QIcon::fromTheme(QStringLiteral("dialog-cancel")),
+                                        i18n("Cancel"), _pasteMessageWidget);
+        connect(cancelAction, &QAction::triggered, this, &Konsole::TerminalDisplay::cancelPaste);
+        _pasteMessageWidget->addAction(cancelAction);
+    }
+
+    const int length = _pasteQueue.head().length();
+    const QString text = i18n("Pasting %1 of %2 characters...", _pastePosition, length);
+    _pasteMessageWidget->setText(text);
+
+    if (!_pasteMessageWidget->isVisible()) {
+        _pasteMessageWidget->animatedShow();
+    }
 }
 
 void TerminalDisplay::setAutoCopySelectedText(bool enabled)
@@ -3556,7 +3910,13 @@ void TerminalDisplay::keyPressEvent(QKeyEvent* event)
         }
     }
 
-    emit keyPressedSignal(event);
+    // keys typed while a bracketed paste is sent would end up in the middle
+    // of the pasted text, they are sent after it
+    if (_pastePosition > 0 && _pasteBracketed) {
+        _pendingKeyEvents.append(*event);
+    } else {
+        emit keyPressedSignal(event);
+    }
 
 #ifndef QT_NO_ACCESSIBILITY
     if (!_readOnly) {
@@ -23,7 +23,9 @@
 
 // Qt
 #include <QColor>
+#include <QKeyEvent>
 #include <QPointer>
+#include <QQueue>
 #include <QWidget>
 
 // Konsole
@@ -33,6 +35,7 @@
 #include "ColorScheme.h"
 #include "Enumeration.h"
 #include "ScrollState.h"
+#include "GlyphCache.h"
 
 class QDrag;
 class QDragEnterEvent;
@@ -53,6 +56,7 @@ class FilterChain;
 class TerminalImageFilterChain;
 class SessionController;
 class IncrementalSearchBar;
+class SearchMatchCache;
 /**
  * A widget which displays output from a terminal emulation and sends input keypresses and mouse activity
  * to the terminal.
@@ -148,6 +152,13 @@ public:
      */
     QList<QAction *> filterActions(const QPoint &position);
 
+    /**
+     * Sets the matches of the current search, which are highlighted in the
+     * display and marked on the scroll bar while the cache is enabled.
+     * @p matches may be null to remove them.
+     */
+    void setSearchMatches(SearchMatchCache *matches);
+
     /** Specifies whether or not the cursor can blink. */
     void setBlinkingCursorEnabled(bool blink);
     /** Returns true if the cursor is allowed to blink or false otherwise. */
@@ -612,6 +623,12 @@ public Q_SLOTS:
      */
     void pasteFromX11Selection(bool appendEnter = false);
 
+    /**
+     * Sends the next part of a large paste, once the terminal process read
+     * the previous one.  Does nothing if no paste is in progress.
+     */
+    void continuePaste();
+
     /**
        * Changes whether the flow control warning box should be shown when the flow control
        * stop key (Ctrl+S) are pressed.
@@ -730,6 +747,7 @@ Q_SIGNALS:
 
 protected:
     bool event(QEvent *event) Q_DECL_OVERRIDE;
+    bool eventFilter(QObject *watched, QEvent *event) Q_DECL_OVERRIDE;
 
     void paintEvent(QPaintEvent *pe) Q_DECL_OVERRIDE;
 
@@ -806,6 +824,11 @@ private Q_SLOTS:
 
     void dismissOutputSuspendedMessage();
 
+    // stops sending the pastes which are in progress
+    void cancelPaste();
+
+    void searchMatchesChanged();
+
 private:
     Q_DISABLE_COPY(TerminalDisplay)
 
@@ -818,6 +841,13 @@ private:
     void drawContents(QPainter &painter, const QRect &rect);
     // draw a transparent rectangle over the line of the current match
     void drawCurrentResultRect(QPainter &painter);
+    // draw transparent rectangles over the visible search matches
+    void drawSearchMatches(QPainter &painter);
+    // draw a mark on the scroll bar for each line with a search match
+    void drawScrollBarMarkers();
+    // the color of the search matches, taken from the color scheme: yellow
+    // for the @p current result line, red otherwise
+    QColor searchMatchColor(bool current, int alpha) const;
     // draws a section of text, all the text in this section
     // has a common color and style
     void drawTextFragment(QPainter &painter, const QRect &rect, const QString &text,
@@ -889,9 +919,25 @@ private:
     // redraws the cursor
     void updateCursor();
 
+    // returns a region covering the areas of the widget which contain
+    // blinking text
+    QRegion blinkingTextRegion() const;
+
+    // returns true if blinking can be seen, which is only the case while
+    // the display is shown and has the focus of the active window
+    bool isBlinkingVisible() const;
+
+    // shows the cursor and the blinking text if they are hidden, and stops
+    // blinking them
+    void stopBlinking();
+
     bool handleShortcutOverrideEvent(QKeyEvent *keyEvent);
 
     void doPaste(QString text, bool appendReturn);
+    // shows the progress of a paste which is sent in parts
+    void updatePasteMessage();
+    // sends the keys which were typed while a bracketed paste was sent
+    void sendPendingKeyEvents();
 
     void processMidButtonClick(QMouseEvent *ev);
 
@@ -920,6 +966,8 @@ private:
     int _fontHeight;      // height
     int _fontWidth;      // width
     int _fontAscent;      // ascend
+    GlyphCache _glyphCache; // glyphs of the font, to draw simple text without shaping it
+    QGlyphRun _glyphRun;    // the glyphs drawn by drawCharacters()
     bool _boldIntense;   // Whether intense colors should be rendered with bold font
 
     int _lines;      // the number of lines that can be displayed in the widget
@@ -965,6 +1013,14 @@ private:
 
     QScrollBar *_scrollBar;
     Enum::ScrollBarPositionEnum _scrollbarLocation;
+
+    QPointer<SearchMatchCache> _searchMatches;
+    // the positions of the search match markers in the scroll bar's groove,
+    // computed again when the matches, the output or the groove change
+    QVector<int> _scrollBarMarkers;
+    bool _scrollBarMarkersChanged;
+    int _scrollBarMarkersLineCount;
+    int _scrollBarMarkersHeight;
     bool _scrollFullPage;
     QString _wordCharacters;
     int _bellMode;
@@ -974,6 +1030,12 @@ private:
     bool _textBlinking;   // text is blinking, hide it when drawing
     bool _cursorBlinking;     // cursor is blinking, hide it when drawing
     bool _hasTextBlinker; // has characters to blink
+    // the cells of each line of _image between the first and the last
+    // character with blinking text, or an empty rectangle
+    QVector<QRect> _blinkingCells;
+    // whether updateImage() compares all the lines of _image with the image of
+    // the screen window, or only the ones it reports as changed
+    bool _compareAllLines;
     QTimer *_blinkTextTimer;
     QTimer *_blinkCursorTimer;
 
@@ -1048,6 +1110,13 @@ private:
     // Needed to know whether the mode really changed between update calls
     bool _readOnly;
 
+    // the pastes which are being sent to the terminal, see continuePaste()
+    QQueue<QString> _pasteQueue;
+    int _pastePosition; // the next character of the first paste to send
+    bool _pasteBracketed; // whether the first paste is sent in bracketed paste mode
+    QList<QKeyEvent> _pendingKeyEvents; // keys typed while a bracketed paste is sent
+    KMessageWidget *_pasteMessageWidget; // shows the progress of large pastes
+
     qreal _opacity;
 
     ScrollState _scrollWheelState;
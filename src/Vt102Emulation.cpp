@@ -471,6 +471,49 @@ void Vt102Emulation::receiveChar(uint cc)
   }
 }
 
+// returns true if @p cc is displayed as it is when it is not part of an
+// escape sequence
+static inline bool isPlainText(uint cc)
+{
+    return cc >= SP && cc != DEL && cc != ESC + 128;
+}
+
+void Vt102Emulation::receiveChars(const uint *chars, int count)
+{
+    int i = 0;
+    while (i < count) {
+        if (tokenBufferPos != 0 || !getMode(MODE_Ansi) || !isPlainText(chars[i])) {
+            receiveChar(chars[i]);
+            i++;
+            continue;
+        }
+
+        // plain text outside of escape sequences is handed to the screen a
+        // whole run at a time, rather than going through the tokenizer
+        int end = i + 1;
+        while (end < count && isPlainText(chars[end])) {
+            end++;
+        }
+
+        const CharCodes &charset = _charset[_currentScreen == _screen[1]];
+        if (charset.graphic || charset.pound) {
+            static const int BUFFER_SIZE = 256;
+            uint buffer[BUFFER_SIZE];
+            for (int start = i; start < end; start += BUFFER_SIZE) {
+                const int length = qMin(BUFFER_SIZE, end - start);
+                for (int j = 0; j < length; j++) {
+                    buffer[j] = applyCharset(chars[start + j]);
+                }
+                _currentScreen->displayCharacters(buffer, length);
+            }
+        } else {
+            _currentScreen->displayCharacters(chars + i, end - i);
+        }
+
+        i = end;
+    }
+}
+
 void Vt102Emulation::processSessionAttributeRequest()
 {
   // Describes the window or terminal session attribute to change
@@ -101,6 +101,7 @@ protected:
     void setMode(int mode) Q_DECL_OVERRIDE;
     void resetMode(int mode) Q_DECL_OVERRIDE;
     void receiveChar(uint cc) Q_DECL_OVERRIDE;
+    void receiveChars(const uint *chars, int count) Q_DECL_OVERRIDE;
 
 private Q_SLOTS:
     // Causes sessionAttributeChanged() to be emitted for each (int,QString)
@@ -0,0 +1,270 @@
+/*
+    Copyright 2018 by The Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "FilterTest.h"
+
+// Qt
+#include <QAction>
+#include <QDir>
+#include <QFile>
+#include <QPointer>
+#include <QSignalSpy>
+#include <QStringList>
+#include <QTemporaryDir>
+
+// KDE
+#include <qtest.h>
+
+// Konsole
+#include "../FileListCache.h"
+#include "../Filter.h"
+
+using namespace Konsole;
+
+static QVector<Character> createImage(const QStringList &lines, int columns)
+{
+    QVector<Character> image(lines.count() * columns);
+    for (int line = 0; line < lines.count(); line++) {
+        const QString &text = lines.at(line);
+        for (int column = 0; column < columns && column < text.length(); column++) {
+            image[line * columns + column] = Character(text.at(column).unicode());
+        }
+    }
+    return image;
+}
+
+static void setImage(TerminalImageFilterChain &chain, const QVector<Character> &image, int columns)
+{
+    const int lines = image.count() / columns;
+    chain.setImage(image.constData(), lines, columns, QVector<LineProperty>(lines, LINE_DEFAULT));
+    chain.process();
+}
+
+void FilterTest::testIncrementalHotSpots()
+{
+    const int columns = 40;
+    TerminalImageFilterChain chain;
+    chain.addFilter(new UrlFilter());
+
+    setImage(chain, createImage(QStringList() << QStringLiteral("a http://a.org")
+                                              << QStringLiteral("b")
+                                              << QStringLiteral("c http://c.org")
+                                              << QStringLiteral("d"), columns), columns);
+    QList<Filter::HotSpot *> spots = chain.hotSpots();
+    QCOMPARE(spots.count(), 2);
+    QCOMPARE(spots.at(0)->startLine(), 0);
+    QCOMPARE(spots.at(1)->startLine(), 2);
+    Filter::HotSpot *spot = spots.at(1);
+
+    // the image scrolls up by one line, the hotspot of the line which is
+    // still there moves along with it
+    setImage(chain, createImage(QStringList() << QStringLiteral("b")
+                                              << QStringLiteral("c http://c.org")
+                                              << QStringLiteral("d")
+                                              << QStringLiteral("e http://e.org"), columns), columns);
+    spots = chain.hotSpots();
+    QCOMPARE(spots.count(), 2);
+    QCOMPARE(spots.at(0), spot);
+    QCOMPARE(spot->startLine(), 1);
+    QCOMPARE(spot->startColumn(), 2);
+    QCOMPARE(spots.at(1)->startLine(), 3);
+    QCOMPARE(chain.hotSpotAt(1, 5), spot);
+    QVERIFY(chain.hotSpotAt(2, 5) == nullptr);
+
+    // a line which changed is filtered again
+    setImage(chain, createImage(QStringList() << QStringLiteral("b")
+                                              << QStringLiteral("c http://changed.org")
+                                              << QStringLiteral("d")
+                                              << QStringLiteral("e http://e.org"), columns), columns);
+    spots = chain.hotSpots();
+    QCOMPARE(spots.count(), 2);
+    QCOMPARE(spots.at(0)->startLine(), 1);
+    QCOMPARE(static_cast<RegExpFilter::HotSpot *>(spots.at(0))->capturedTexts().first(),
+             QStringLiteral("http://changed.org"));
+    QCOMPARE(spots.at(1)->startLine(), 3);
+
+    // filters added to the chain process the whole image
+    auto filter = new RegExpFilter();
+    filter->setRegExp(QRegularExpression(QStringLiteral("^[a-e]\\b"), QRegularExpression::MultilineOption));
+    chain.addFilter(filter);
+    setImage(chain, createImage(QStringList() << QStringLiteral("b")
+                                              << QStringLiteral("c http://changed.org")
+                                              << QStringLiteral("d")
+                                              << QStringLiteral("e http://e.org"), columns), columns);
+    QCOMPARE(filter->hotSpots().count(), 4);
+    QCOMPARE(chain.hotSpots().count(), 6);
+}
+
+void FilterTest::testHotSpotPositions()
+{
+    // the first two characters are two columns wide
+    const QString text = QString::fromUtf8("\xe4\xb8\xad\xe6\x96\x87 ab\nabcd\n");
+    const QList<int> linePositions = QList<int>() << 0 << 6 << 11;
+
+    RegExpFilter filter;
+    filter.setRegExp(QRegularExpression(QStringLiteral("[a-z]{2}")));
+    filter.setBuffer(&text, &linePositions);
+    filter.process();
+
+    const QList<Filter::HotSpot *> spots = filter.hotSpots();
+    QCOMPARE(spots.count(), 3);
+    QCOMPARE(spots.at(0)->startLine(), 0);
+    QCOMPARE(spots.at(0)->startColumn(), 5);
+    QCOMPARE(spots.at(0)->endColumn(), 7);
+    QCOMPARE(spots.at(1)->startLine(), 1);
+    QCOMPARE(spots.at(1)->startColumn(), 0);
+    QCOMPARE(spots.at(2)->startColumn(), 2);
+    QCOMPARE(spots.at(2)->endColumn(), 4);
+
+    QVERIFY(filter.hotSpotAt(0, 4) == nullptr);
+    QCOMPARE(filter.hotSpotAt(0, 6), spots.at(0));
+    QCOMPARE(filter.hotSpotAt(1, 1), spots.at(1));
+    // where two hotspots meet, the second one is hit
+    QCOMPARE(filter.hotSpotAt(1, 2), spots.at(2));
+    QCOMPARE(filter.hotSpotAt(1, 4), spots.at(2));
+    QVERIFY(filter.hotSpotAt(1, 5) == nullptr);
+    QVERIFY(filter.hotSpotAt(2, 0) == nullptr);
+}
+
+void FilterTest::testLiterals()
+{
+    const QString text = QStringLiteral("see http://a.org\nftp\nand ftp://b.org\n");
+    const QList<int> linePositions = QList<int>() << 0 << 17 << 21 << 37;
+
+    RegExpFilter filter;
+    filter.setRegExp(QRegularExpression(QStringLiteral("[a-z]+://[a-z.]+")));
+    filter.setLiterals(QStringList() << QStringLiteral("://"));
+    filter.setBuffer(&text, &linePositions);
+    filter.process();
+
+    const QList<Filter::HotSpot *> spots = filter.hotSpots();
+    QCOMPARE(spots.count(), 2);
+    QCOMPARE(spots.at(0)->startLine(), 0);
+    QCOMPARE(spots.at(0)->startColumn(), 4);
+    QCOMPARE(spots.at(0)->endColumn(), 16);
+    QCOMPARE(spots.at(1)->startLine(), 2);
+    QCOMPARE(spots.at(1)->startColumn(), 4);
+    QCOMPARE(static_cast<RegExpFilter::HotSpot *>(spots.at(1))->capturedTexts().first(),
+             QStringLiteral("ftp://b.org"));
+}
+
+void FilterTest::testHotSpotActions()
+{
+    const QString text = QStringLiteral("see http://a.org\n");
+    const QList<int> linePositions = QList<int>() << 0;
+
+    UrlFilter filter;
+    filter.setBuffer(&text, &linePositions);
+    filter.process();
+    QCOMPARE(filter.hotSpots().count(), 1);
+
+    const QList<QAction *> actions = filter.hotSpots().first()->actions();
+    QCOMPARE(actions.count(), 2);
+    QPointer<QAction> action = actions.first();
+
+    // the actions of a context menu outlive the hotspots, which are deleted
+    // when output arrives while the menu is open
+    filter.reset();
+    filter.process();
+    QVERIFY(!action.isNull());
+    action->trigger();
+
+    qDeleteAll(actions);
+    QVERIFY(action.isNull());
+}
+
+void FilterTest::testFileListCache()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QFile file(dir.path() + QStringLiteral("/a.txt"));
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.close();
+
+    FileListCache cache;
+    QSignalSpy spy(&cache, &FileListCache::directoryListed);
+    QString canonicalPath;
+
+    // nothing is known until the directory was listed
+    QVERIFY(cache.files(dir.path(), canonicalPath).isEmpty());
+    QVERIFY(canonicalPath.isEmpty());
+    QCOMPARE(cache.revision(dir.path()), 0);
+    QVERIFY(spy.wait());
+
+    QCOMPARE(cache.files(dir.path(), canonicalPath), QSet<QString>() << QStringLiteral("a.txt"));
+    QCOMPARE(canonicalPath, QDir(dir.path()).canonicalPath());
+    QCOMPARE(cache.revision(dir.path()), 1);
+
+    // the directory is listed again when its files change
+    QFile otherFile(dir.path() + QStringLiteral("/b.txt"));
+    QVERIFY(otherFile.open(QIODevice::WriteOnly));
+    otherFile.close();
+    QTRY_VERIFY(cache.files(dir.path(), canonicalPath).contains(QStringLiteral("b.txt")));
+    QVERIFY(cache.revision(dir.path()) > 1);
+}
+
+void FilterTest::benchmarkFilters_data()
+{
+    QTest::addColumn<int>("changedLines");
+    QTest::addColumn<int>("scrolledLines");
+
+    QTest::newRow("unchanged") << 0 << 0;
+    QTest::newRow("one line changed") << 1 << 0;
+    QTest::newRow("scrolled by one line") << 0 << 1;
+    QTest::newRow("all lines changed") << 60 << 0;
+}
+
+void FilterTest::benchmarkFilters()
+{
+    QFETCH(int, changedLines);
+    QFETCH(int, scrolledLines);
+
+    const int lines = 60;
+    const int columns = 200;
+
+    // two images the filters are given in turn, showing the difference
+    // between two frames of a busy terminal
+    QStringList text;
+    for (int i = 0; i < lines + scrolledLines; i++) {
+        text << QStringLiteral("%1 see https://www.example.org/page/%1 or mail user%1@example.org").arg(i);
+    }
+    QStringList otherText = text.mid(scrolledLines);
+    text = text.mid(0, lines);
+    for (int i = 0; i < changedLines; i++) {
+        otherText[lines - 1 - i] = QStringLiteral("changed %1 https://changed.example.org/%1").arg(i);
+    }
+    const QVector<Character> images[2] = {createImage(text, columns), createImage(otherText, columns)};
+
+    TerminalImageFilterChain chain;
+    chain.addFilter(new UrlFilter());
+    auto filter = new RegExpFilter();
+    filter->setRegExp(QRegularExpression(QStringLiteral("\\b[0-9]+\\b")));
+    chain.addFilter(filter);
+
+    int frame = 0;
+    QBENCHMARK {
+        setImage(chain, images[frame % 2], columns);
+        frame++;
+    }
+
+    QVERIFY(!chain.hotSpots().isEmpty());
+}
+
+QTEST_MAIN(FilterTest)
@@ -26,6 +26,9 @@
 #include "../Session.h"
 #include "../Emulation.h"
 #include "../History.h"
+#include "../HistoryReflow.h"
+#include "../HistorySearchIndex.h"
+#include "../Screen.h"
 
 using namespace Konsole;
 
@@ -140,4 +143,524 @@ void HistoryTest::testHistoryScroll()
     delete historyScroll;
 }
 
+static TextLine makeLine(uint c, int length)
+{
+    TextLine line(length);
+    for (int i = 0; i < length; i++) {
+        line[i].character = c;
+    }
+    return line;
+}
+
+void HistoryTest::testCompactHistoryOverflow()
+{
+    CompactHistoryScroll history(3);
+
+    for (uint c = 'a'; c <= 'e'; c++) {
+        history.addCellsVector(makeLine(c, 10 + c - 'a'));
+        history.addLine(c == 'd');
+    }
+
+    // only the three most recent lines are kept, oldest first
+    QCOMPARE(history.getLines(), 3);
+    Character cell;
+    for (int i = 0; i < 3; i++) {
+        QCOMPARE(history.getLineLen(i), 12 + i);
+        history.getCells(i, 0, 1, &cell);
+        QCOMPARE(cell.character, static_cast<uint>('c' + i));
+    }
+    QCOMPARE(history.isWrappedLine(0), false);
+    QCOMPARE(history.isWrappedLine(1), true);
+    QCOMPARE(history.isWrappedLine(2), false);
+
+    // shrinking drops the oldest lines and keeps the order
+    history.setMaxNbLines(2);
+    QCOMPARE(history.getLines(), 2);
+    history.getCells(0, 0, 1, &cell);
+    QCOMPARE(cell.character, static_cast<uint>('d'));
+
+    history.addCellsVector(makeLine('f', 5));
+    history.addLine(false);
+    QCOMPARE(history.getLines(), 2);
+    history.getCells(0, 0, 1, &cell);
+    QCOMPARE(cell.character, static_cast<uint>('e'));
+    history.getCells(1, 0, 1, &cell);
+    QCOMPARE(cell.character, static_cast<uint>('f'));
+
+    // growing keeps the existing lines
+    history.setMaxNbLines(10);
+    QCOMPARE(history.getLines(), 2);
+    history.addCellsVector(makeLine('g', 5));
+    history.addLine(false);
+    QCOMPARE(history.getLines(), 3);
+    history.getCells(2, 0, 1, &cell);
+    QCOMPARE(cell.character, static_cast<uint>('g'));
+}
+
+static TextLine makeLine(const QString &text)
+{
+    const QVector<uint> characters = text.toUcs4();
+    TextLine line(characters.size());
+    for (int i = 0; i < characters.size(); i++) {
+        line[i].character = characters[i];
+    }
+    return line;
+}
+
+void HistoryTest::testHistorySearchIndex()
+{
+    HistorySearchIndex index;
+
+    for (int i = 0; i < 2000; i++) {
+        QString text = QStringLiteral("line %1").arg(i);
+        bool wrapped = false;
+        if (i == 1500) {
+            text += QStringLiteral(" needle");
+        } else if (i == 600 || i == 1700) {
+            text += QStringLiteral(" nee");
+            wrapped = (i == 1700);
+        } else if (i == 601 || i == 1701) {
+            text = QStringLiteral("dle ") + text;
+        }
+        const TextLine line = makeLine(text);
+        index.addLine(line.constData(), line.size(), wrapped);
+    }
+
+    QCOMPARE(index.mayContain(0, 1023, QStringLiteral("needle")), false);
+    QCOMPARE(index.mayContain(1024, 1535, QStringLiteral("needle")), true);
+    QCOMPARE(index.mayContain(1024, 1535, QStringLiteral("NeEdLe")), true);
+    QCOMPARE(index.mayContain(0, 1999, QStringLiteral("needle")), true);
+
+    // the text of wrapped lines is joined
+    QCOMPARE(index.mayContain(1536, 1999, QStringLiteral("needle")), true);
+
+    // short texts and lines which are not indexed may contain anything
+    QCOMPARE(index.mayContain(0, 511, QStringLiteral("ne")), true);
+    QCOMPARE(index.mayContain(1990, 2005, QStringLiteral("needle")), true);
+
+    // lines are renumbered when the first ones are dropped
+    for (int i = 0; i < 600; i++) {
+        index.removeFirstLine();
+    }
+    QCOMPARE(index.mayContain(0, 400, QStringLiteral("needle")), false);
+    QCOMPARE(index.mayContain(0, 1000, QStringLiteral("needle")), true);
+
+    // lines which were there before a reset are not indexed
+    index.reset(100);
+    QCOMPARE(index.mayContain(0, 50, QStringLiteral("needle")), true);
+    const TextLine line = makeLine(QStringLiteral("haystack"));
+    index.addLine(line.constData(), line.size(), false);
+    QCOMPARE(index.mayContain(100, 100, QStringLiteral("needle")), false);
+    QCOMPARE(index.mayContain(100, 100, QStringLiteral("stack")), true);
+
+    // text which is wrapped from the last line of a block to the first line
+    // of the next one is found in the block where it starts
+    index.reset();
+    for (int i = 0; i < 1024; i++) {
+        QString text = QStringLiteral("line %1").arg(i);
+        if (i == 511) {
+            text += QStringLiteral(" nee");
+        } else if (i == 512) {
+            text = QStringLiteral("dle ") + text;
+        }
+        const TextLine cells = makeLine(text);
+        index.addLine(cells.constData(), cells.size(), i == 511);
+    }
+    QCOMPARE(index.mayContain(0, 511, QStringLiteral("needle")), true);
+    QCOMPARE(index.mayContain(0, 1023, QStringLiteral("needle")), true);
+    QCOMPARE(index.mayContain(512, 1023, QStringLiteral("needle")), false);
+
+    // including when it goes on past the first line of the next block
+    index.reset();
+    for (int i = 0; i < 1024; i++) {
+        QString text = QStringLiteral("line %1").arg(i);
+        if (i == 511) {
+            text += QStringLiteral(" ne");
+        } else if (i == 512) {
+            text = QStringLiteral("ed");
+        } else if (i == 513) {
+            text = QStringLiteral("le ") + text;
+        }
+        const TextLine cells = makeLine(text);
+        index.addLine(cells.constData(), cells.size(), i == 511 || i == 512);
+    }
+    QCOMPARE(index.mayContain(0, 511, QStringLiteral("needle")), true);
+    QCOMPARE(index.mayContain(0, 511, QStringLiteral("needle line 513")), true);
+}
+
+void HistoryTest::testHistorySearchIndexRequiredText()
+{
+    const QString text = QStringLiteral("a.b (c) [d] \\e");
+    QCOMPARE(HistorySearchIndex::requiredText(QRegularExpression(QRegularExpression::escape(text))), text);
+    QCOMPARE(HistorySearchIndex::requiredText(QRegularExpression(QStringLiteral("needle"))), QStringLiteral("needle"));
+    QCOMPARE(HistorySearchIndex::requiredText(QRegularExpression(QStringLiteral("nee.le"))), QString());
+    QCOMPARE(HistorySearchIndex::requiredText(QRegularExpression(QStringLiteral("needle\\d"))), QString());
+    QCOMPARE(HistorySearchIndex::requiredText(QRegularExpression(QStringLiteral("a|b"))), QString());
+}
+
+static QString lineText(const HistoryReflow &reflow, int line)
+{
+    QVector<Character> cells(reflow.getLineLen(line));
+    reflow.getCells(line, 0, cells.size(), cells.data());
+
+    QString text;
+    foreach (const Character &cell, cells) {
+        text += QChar(cell.character);
+    }
+    return text;
+}
+
+static void addLine(HistoryScroll &history, const QString &text, bool wrapped)
+{
+    history.addCellsVector(makeLine(text));
+    history.addLine(wrapped);
+}
+
+void HistoryTest::testHistoryReflow()
+{
+    CompactHistoryScroll history(1000);
+    HistoryReflow reflow;
+    reflow.setHistory(&history);
+
+    addLine(history, QStringLiteral("abcdefghij"), true);
+    addLine(history, QStringLiteral("klmnopqrst"), true);
+    addLine(history, QStringLiteral("uv"), false);
+    addLine(history, QStringLiteral("xyz"), false);
+    QCOMPARE(reflow.getLines(), 4);
+
+    // lines are shown as they are until they are rewrapped
+    reflow.setColumns(5);
+    QCOMPARE(reflow.getLines(), 4);
+    QCOMPARE(lineText(reflow, 1), QStringLiteral("klmnopqrst"));
+
+    QVERIFY(reflow.reflow(0, 3));
+    QCOMPARE(reflow.getLines(), 6);
+    QCOMPARE(lineText(reflow, 0), QStringLiteral("abcde"));
+    QCOMPARE(lineText(reflow, 1), QStringLiteral("fghij"));
+    QCOMPARE(lineText(reflow, 2), QStringLiteral("klmno"));
+    QCOMPARE(lineText(reflow, 4), QStringLiteral("uv"));
+    QCOMPARE(lineText(reflow, 5), QStringLiteral("xyz"));
+    QCOMPARE(reflow.isWrappedLine(3), true);
+    QCOMPARE(reflow.isWrappedLine(4), false);
+    QCOMPARE(reflow.sourceLine(3), 1);
+    QVERIFY(!reflow.reflow(0, 5));
+
+    // positions find the same lines after rewrapping
+    const qint64 position = reflow.position(3);
+    QCOMPARE(reflow.line(position), 3);
+
+    // lines added after setColumns() are shown as they are
+    addLine(history, QStringLiteral("12345678"), false);
+    QCOMPARE(reflow.getLines(), 7);
+    QCOMPARE(lineText(reflow, 6), QStringLiteral("12345678"));
+
+    // lines are rewrapped from where they are looked at
+    reflow.setColumns(30);
+    QCOMPARE(reflow.getLines(), 5);
+    QVERIFY(reflow.reflow(4, 4));
+    QCOMPARE(reflow.getLines(), 5);
+    QVERIFY(reflow.reflow(0, 3));
+    QCOMPARE(reflow.getLines(), 3);
+    QCOMPARE(lineText(reflow, 0), QStringLiteral("abcdefghijklmnopqrstuv"));
+    QCOMPARE(reflow.line(position), 0);
+
+    // rewrapped lines are dropped with the history lines
+    CompactHistoryScroll smallHistory(2);
+    reflow.setHistory(&smallHistory);
+    addLine(smallHistory, QStringLiteral("abcdefghij"), true);
+    addLine(smallHistory, QStringLiteral("klm"), false);
+    reflow.setColumns(4);
+    QVERIFY(reflow.reflow(0, 1));
+    QCOMPARE(reflow.getLines(), 4);
+
+    addLine(smallHistory, QStringLiteral("xyz"), false);
+    reflow.removeFirstLine();
+    QCOMPARE(reflow.getLines(), 2);
+    QCOMPARE(lineText(reflow, 1), QStringLiteral("xyz"));
+}
+
+void HistoryTest::testHistoryReflowRanges()
+{
+    const int rangeDistance = 2100;
+    const int historyLines = rangeDistance * (HistoryReflow::MAX_RANGES + 1);
+    CompactHistoryScroll history(historyLines);
+    HistoryReflow reflow;
+    reflow.setHistory(&history);
+
+    for (int i = 0; i < historyLines / 2; i++) {
+        addLine(history, QStringLiteral("abcdefghij"), true);
+        addLine(history, QStringLiteral("klmnopqrst"), false);
+    }
+    reflow.setColumns(5);
+
+    // each rewrapped range reports how the lines were renumbered
+    QVector<HistoryReflow::LineChange> changes;
+    QVERIFY(reflow.reflow(0, 9, &changes));
+    QCOMPARE(changes.size(), 1);
+    QCOMPARE(changes.at(0).firstLine, qint64(0));
+    QCOMPARE(changes.at(0).oldLineCount, 10);
+    QCOMPARE(changes.at(0).newLineCount, 20);
+
+    // ranges far apart are kept separately, the lines in between are shown
+    // as they are
+    for (int i = 1; i < HistoryReflow::MAX_RANGES; i++) {
+        const int line = i * rangeDistance + i * 10;
+        changes.clear();
+        QVERIFY(reflow.reflow(line, line + 9, &changes));
+        QCOMPARE(changes.size(), 1);
+        QCOMPARE(changes.at(0).firstLine, qint64(line));
+        QCOMPARE(lineText(reflow, line), QStringLiteral("abcde"));
+        QCOMPARE(lineText(reflow, line + 20), QStringLiteral("abcdefghij"));
+    }
+    QCOMPARE(lineText(reflow, 0), QStringLiteral("abcde"));
+    QCOMPARE(lineText(reflow, 20), QStringLiteral("abcdefghij"));
+    QVERIFY(!reflow.reflow(0, 9));
+    QCOMPARE(reflow.getLines(), historyLines + HistoryReflow::MAX_RANGES * 10);
+
+    // beyond that, the range used least recently is shown as it is again
+    const int line = HistoryReflow::MAX_RANGES * rangeDistance + HistoryReflow::MAX_RANGES * 10;
+    changes.clear();
+    QVERIFY(reflow.reflow(line, line + 9, &changes));
+    QCOMPARE(changes.size(), 2);
+    QCOMPARE(changes.at(1).firstLine, qint64(rangeDistance + 10));
+    QCOMPARE(changes.at(1).oldLineCount, 20);
+    QCOMPARE(changes.at(1).newLineCount, 10);
+    QCOMPARE(lineText(reflow, 0), QStringLiteral("abcde"));
+    QCOMPARE(lineText(reflow, rangeDistance + 10), QStringLiteral("abcdefghij"));
+    QCOMPARE(reflow.getLines(), historyLines + HistoryReflow::MAX_RANGES * 10);
+}
+
+void HistoryTest::testScreenReflow()
+{
+    Screen screen(3, 10);
+    screen.setScroll(CompactHistoryType(100));
+    screen.setReflowLines(true);
+
+    const QVector<uint> text = QStringLiteral("abcdefghijklmnopqrstuvwxy").toUcs4();
+    screen.displayCharacters(text.constData(), text.size());
+    QCOMPARE(screen.getCursorY(), 2);
+    QCOMPARE(screen.getCursorX(), 5);
+
+    // the lines of the screen are rewrapped at once
+    screen.resizeImage(3, 20);
+    QCOMPARE(screen.getHistLines(), 0);
+    QCOMPARE(screen.getCursorY(), 1);
+    QCOMPARE(screen.getCursorX(), 5);
+    QVector<LineProperty> properties = screen.getLineProperties(0, 1);
+    QVERIFY(properties[0] & LINE_WRAPPED);
+    QVERIFY(!(properties[1] & LINE_WRAPPED));
+
+    // lines which do not fit go to the history
+    screen.resizeImage(3, 4);
+    QCOMPARE(screen.getHistLines(), 4);
+    QCOMPARE(screen.getCursorY(), 2);
+    QCOMPARE(screen.getCursorX(), 1);
+
+    // while the history is rewrapped when it is looked at
+    const int historyId = screen.historyId();
+    screen.resizeImage(3, 10);
+    QVERIFY(screen.historyId() != historyId);
+    QCOMPARE(screen.getCursorY(), 0);
+    QCOMPARE(screen.getCursorX(), 9);
+    QCOMPARE(screen.getHistLines(), 4);
+
+    const qint64 position = screen.linePosition(3);
+    const int resizedHistoryId = screen.historyId();
+    const int layoutId = screen.historyLayoutId();
+    QVERIFY(screen.reflowHistory(0, 3));
+    QCOMPARE(screen.getHistLines(), 2);
+    QCOMPARE(screen.lineAtPosition(position), 1);
+    QCOMPARE(screen.lineAtPosition(screen.linePosition(2)), 2);
+
+    // rewrapping lines as they come into view does not replace the history,
+    // the lines are renumbered
+    QCOMPARE(screen.historyId(), resizedHistoryId);
+    QVERIFY(screen.historyLayoutId() != layoutId);
+    QVector<HistoryReflow::LineChange> changes;
+    QVERIFY(screen.historyLayoutChanges(layoutId, changes));
+    QCOMPARE(changes.size(), 1);
+    QCOMPARE(changes.at(0).firstLine, qint64(0));
+    QCOMPARE(changes.at(0).oldLineCount, 4);
+    QCOMPARE(changes.at(0).newLineCount, 2);
+
+    // the changes are forgotten when the history is replaced
+    screen.resizeImage(3, 5);
+    changes.clear();
+    QVERIFY(!screen.historyLayoutChanges(layoutId, changes));
+}
+
+void HistoryTest::testHistoryFileReadWhileWriting()
+{
+    // enough lines to span several mapped segments of the cells file
+    const int lineCount = 10000;
+    const int lineLength = 80;
+
+    HistoryScrollFile history(QString());
+    Character cells[lineLength];
+    for (int i = 0; i < lineCount; i++) {
+        const TextLine line = makeLine(i, lineLength);
+        history.addCells(line.constData(), lineLength);
+        history.addLine(i % 3 == 0);
+
+        // interleave reads of old and new lines with the writes
+        if (i % 1000 == 999) {
+            history.getCells(i, 0, lineLength, cells);
+            QCOMPARE(cells[lineLength - 1].character, static_cast<uint>(i));
+            history.getCells(i / 2, 0, lineLength, cells);
+            QCOMPARE(cells[0].character, static_cast<uint>(i / 2));
+        }
+    }
+
+    QCOMPARE(history.getLines(), lineCount);
+    for (int i = 0; i < lineCount; i += 7) {
+        QCOMPARE(history.getLineLen(i), lineLength);
+        QCOMPARE(history.isWrappedLine(i), i % 3 == 0);
+        history.getCells(i, 0, lineLength, cells);
+        QCOMPARE(cells[0].character, static_cast<uint>(i));
+        QCOMPARE(cells[lineLength - 1].character, static_cast<uint>(i));
+    }
+}
+
+void HistoryTest::testCompressedHistory()
+{
+    HistoryType *history;
+
+    history = new CompressedHistoryType();
+    QCOMPARE(history->isEnabled(), true);
+    QCOMPARE(history->isUnlimited(), true);
+    QCOMPARE(history->maximumLineCount(), -1);
+    delete history;
+}
+
+void HistoryTest::testCompressedHistoryScroll()
+{
+    HistoryScroll *historyScroll = new CompressedHistoryScroll();
+    QVERIFY(historyScroll->hasScroll());
+    QCOMPARE(historyScroll->getLines(), 0);
+    QCOMPARE(historyScroll->getLineLen(0), 0);
+    QCOMPARE(historyScroll->isWrappedLine(0), false);
+
+    // enough lines to fill several compressed blocks, with a mix of
+    // formats and characters which need more than one byte to store
+    const int lineCount = 5000;
+    const int lineLength = 60;
+    for (int i = 0; i < lineCount; i++) {
+        TextLine line = makeLine(0x20 + (i % 0x3000), lineLength);
+        line[10].rendition = RE_BOLD;
+        line[11].foregroundColor = CharacterColor(COLOR_SPACE_256, i % 256);
+        line[12].isRealCharacter = false;
+        historyScroll->addCells(line.constData(), 30);
+        historyScroll->addCells(line.constData() + 30, lineLength - 30);
+        historyScroll->addLine(i % 2 == 0);
+    }
+
+    QCOMPARE(historyScroll->getLines(), lineCount);
+    Character cells[lineLength];
+    for (int i = 0; i < lineCount; i += 13) {
+        QCOMPARE(historyScroll->getLineLen(i), lineLength);
+        QCOMPARE(historyScroll->isWrappedLine(i), i % 2 == 0);
+
+        historyScroll->getCells(i, 0, lineLength, cells);
+        QCOMPARE(cells[0].character, static_cast<uint>(0x20 + (i % 0x3000)));
+        QCOMPARE(cells[lineLength - 1].character, static_cast<uint>(0x20 + (i % 0x3000)));
+        QCOMPARE(cells[9].rendition, DEFAULT_RENDITION);
+        QCOMPARE(cells[10].rendition, RE_BOLD);
+        QVERIFY(cells[11].foregroundColor == CharacterColor(COLOR_SPACE_256, i % 256));
+        QCOMPARE(cells[12].isRealCharacter, false);
+        QCOMPARE(cells[13].isRealCharacter, true);
+
+        // partial reads starting inside the line
+        historyScroll->getCells(i, 11, 2, cells);
+        QVERIFY(cells[0].foregroundColor == CharacterColor(COLOR_SPACE_256, i % 256));
+        QCOMPARE(cells[1].isRealCharacter, false);
+    }
+
+    // converting to another history type keeps the content
+    HistoryScroll *fileScroll = HistoryTypeFile().scroll(historyScroll);
+    QCOMPARE(fileScroll->getLines(), lineCount);
+    fileScroll->getCells(lineCount - 1, 0, lineLength, cells);
+    QCOMPARE(cells[0].character, static_cast<uint>(0x20 + ((lineCount - 1) % 0x3000)));
+    QCOMPARE(cells[10].rendition, RE_BOLD);
+    QCOMPARE(fileScroll->isWrappedLine(lineCount - 1), (lineCount - 1) % 2 == 0);
+
+    delete fileScroll;
+}
+
+void HistoryTest::testCompressedHistoryExtendedChars()
+{
+    CompressedHistoryScroll historyScroll;
+
+    // the characters of extended cells are ExtendedCharTable hashes, which
+    // use all 32 bits
+    const uint characters[] = {0x41, 0x1F600, 0x200000, 0x7FFFFFFF, 0x80000001, 0xFFFFFFFF};
+    const int count = sizeof(characters) / sizeof(characters[0]);
+    TextLine line = makeLine(0x20, count);
+    for (int i = 0; i < count; i++) {
+        line[i].character = characters[i];
+        if (characters[i] > 0x10FFFF) {
+            line[i].rendition = RE_EXTENDED_CHAR;
+        }
+    }
+    historyScroll.addCells(line.constData(), count);
+    historyScroll.addLine(false);
+
+    Character cells[count];
+    historyScroll.getCells(0, 0, count, cells);
+    for (int i = 0; i < count; i++) {
+        QCOMPARE(cells[i].character, characters[i]);
+        QCOMPARE(cells[i].rendition, line[i].rendition);
+    }
+}
+
+void HistoryTest::benchmarkCompactHistoryAdd_data()
+{
+    QTest::addColumn<int>("maxLines");
+
+    QTest::newRow("1000") << 1000;
+    QTest::newRow("10000") << 10000;
+    QTest::newRow("100000") << 100000;
+}
+
+void HistoryTest::benchmarkCompactHistoryAdd()
+{
+    QFETCH(int, maxLines);
+
+    // fill the history so that every added line evicts the oldest one;
+    // the cost per line should not depend on maxLines
+    CompactHistoryScroll history(maxLines);
+    const TextLine line = makeLine('x', 80);
+    for (int i = 0; i < maxLines; i++) {
+        history.addCellsVector(line);
+        history.addLine(false);
+    }
+
+    QBENCHMARK {
+        for (int i = 0; i < 10000; i++) {
+            history.addCellsVector(line);
+            history.addLine(false);
+        }
+    }
+
+    QCOMPARE(history.getLines(), maxLines);
+}
+
+void HistoryTest::benchmarkHistoryFileAdd()
+{
+    // Lines are buffered and written in large chunks, so the number of
+    // write syscalls no longer grows with the number of lines; compare with
+    // strace -c ./HistoryTest benchmarkHistoryFileAdd
+    const int lineCount = 100000;
+    const TextLine line = makeLine('x', 10);
+
+    QBENCHMARK {
+        HistoryScrollFile history(QString());
+        for (int i = 0; i < lineCount; i++) {
+            history.addCells(line.constData(), line.size());
+            history.addLine(false);
+        }
+        history.flush();
+        QCOMPARE(history.getLines(), lineCount);
+    }
+}
+
 QTEST_MAIN(HistoryTest)
@@ -35,6 +35,20 @@ private Q_SLOTS:
     void testCompactHistory();
     void testEmulationHistory();
     void testHistoryScroll();
+    void testCompactHistoryOverflow();
+    void testHistoryFileReadWhileWriting();
+    void testCompressedHistory();
+    void testCompressedHistoryScroll();
+    void testCompressedHistoryExtendedChars();
+    void testHistorySearchIndex();
+    void testHistorySearchIndexRequiredText();
+    void testHistoryReflow();
+    void testHistoryReflowRanges();
+    void testScreenReflow();
+
+    void benchmarkCompactHistoryAdd_data();
+    void benchmarkCompactHistoryAdd();
+    void benchmarkHistoryFileAdd();
 
 private:
 };
@@ -0,0 +1,73 @@
+/*
+    Copyright 2018 by The Konsole Developers
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301  USA.
+*/
+
+// Own
+#include "ProcessInfoTest.h"
+
+// Qt
+#include <QCoreApplication>
+#include <QDir>
+
+// KDE
+#include <KUser>
+#include <qtest.h>
+
+// Konsole
+#include "../ProcessInfo.h"
+
+using namespace Konsole;
+
+void ProcessInfoTest::testSharedInstance()
+{
+    const int pid = static_cast<int>(QCoreApplication::applicationPid());
+
+    QSharedPointer<ProcessInfo> info = ProcessInfo::sharedInstance(pid, QString());
+    if (!info->isValid()) {
+        QSKIP("Reading process information is not supported on this platform.");
+    }
+
+    // everyone asking for the same process gets the same instance
+    QSharedPointer<ProcessInfo> otherInfo = ProcessInfo::sharedInstance(pid, QString());
+    QCOMPARE(otherInfo.data(), info.data());
+
+    bool ok = false;
+    QCOMPARE(info->pid(&ok), pid);
+    QVERIFY(ok);
+
+    info->update();
+    QCOMPARE(info->currentDir(&ok), QDir::currentPath());
+    QVERIFY(ok);
+}
+
+void ProcessInfoTest::testUserName()
+{
+    const int pid = static_cast<int>(QCoreApplication::applicationPid());
+
+    QSharedPointer<ProcessInfo> info = ProcessInfo::sharedInstance(pid, QString());
+    if (!info->isValid()) {
+        QSKIP("Reading process information is not supported on this platform.");
+    }
+
+    // the user name is read once a title format needs it
+    QSharedPointer<ProcessInfo> otherInfo = ProcessInfo::sharedInstance(pid, QStringLiteral("%u"));
+    QCOMPARE(otherInfo.data(), info.data());
+    QCOMPARE(info->userName(), KUser(KUser::UseRealUserID).loginName());
+}
+
+QTEST_GUILESS_MAIN(ProcessInfoTest)
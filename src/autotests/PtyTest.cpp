@@ -21,10 +21,12 @@
 #include "PtyTest.h"
 
 // Qt
+#include <QSignalSpy>
 #include <QSize>
 #include <QStringList>
 
 // KDE
+#include <KPtyDevice>
 #include <qtest.h>
 
 using namespace Konsole;
@@ -89,4 +91,50 @@ void PtyTest::testRunProgram()
     QCOMPARE(pty.foregroundProcessGroup(), pty.pid());
 }
 
+void PtyTest::testDataSent()
+{
+    Pty pty;
+    QString program = QStringLiteral("cat");
+    QStringList arguments;
+    arguments << program;
+    QStringList environments;
+    QCOMPARE(pty.start(program, arguments, environments), 0);
+
+    QSignalSpy sentSpy(&pty, SIGNAL(dataSent()));
+    QVERIFY(sentSpy.isValid());
+
+    // the signal comes once all of the data was written to the process
+    QByteArray data;
+    for (int i = 0; i < 1000; i++) {
+        data += "line " + QByteArray::number(i) + '\n';
+    }
+    pty.sendData(data);
+    QCOMPARE(sentSpy.count(), 0);
+
+    QVERIFY(sentSpy.wait(5000));
+    QCOMPARE(pty.pty()->bytesToWrite(), static_cast<qint64>(0));
+}
+
+void PtyTest::testReceivedData()
+{
+    Pty pty;
+    QByteArray received;
+    connect(&pty, &Konsole::Pty::receivedData, this, [&received](const char *buffer, int length) {
+        received.append(buffer, length);
+    });
+
+    QString program = QStringLiteral("sh");
+    QStringList arguments;
+    arguments << program << QStringLiteral("-c") << QStringLiteral("seq 1 10000");
+    QStringList environments;
+    QCOMPARE(pty.start(program, arguments, environments), 0);
+
+    QTRY_VERIFY(received.contains("10000"));
+
+    // the lines arrive in blocks, which are counted
+    QCOMPARE(pty.receivedByteCount(), static_cast<qint64>(received.size()));
+    QVERIFY(pty.receivedBlockCount() > 0);
+    QVERIFY(pty.receivedBlockCount() < 10000);
+}
+
 QTEST_GUILESS_MAIN(PtyTest)
@@ -22,10 +22,16 @@
 
 #include "qtest.h"
 
+// Qt
+#include <QFontDatabase>
+#include <QImage>
+#include <QPainter>
+
 // Konsole
 #include "../TerminalDisplay.h"
 #include "../CharacterColor.h"
 #include "../ColorScheme.h"
+#include "../GlyphCache.h"
 
 using namespace Konsole;
 
@@ -89,4 +95,75 @@ void TerminalTest::testSize()
     delete display;
 }
 
+void TerminalTest::testGlyphCache()
+{
+    const QFont font = QFontDatabase::systemFont(QFontDatabase::FixedFont);
+    if (!QRawFont::fromFont(font).isValid()) {
+        QSKIP("No font to draw with");
+    }
+
+    GlyphCache cache;
+    cache.setFont(font);
+
+    QGlyphRun run;
+    QVERIFY(cache.glyphRun(QStringLiteral("konsole"), false, false, 10, run));
+    QCOMPARE(run.glyphIndexes().size(), 7);
+    QCOMPARE(run.positions().at(3), QPointF(30, 0));
+    QVERIFY(run.glyphIndexes().at(1) == run.glyphIndexes().at(4));
+
+    QVERIFY(cache.glyphRun(QStringLiteral("konsole"), true, false, 10, run));
+
+    // text which needs shaping is left to QPainter::drawText()
+    QVERIFY(!cache.glyphRun(QString::fromUtf8("e\xcc\x81"), false, false, 10, run));
+    QVERIFY(!cache.glyphRun(QString::fromUtf8("\xd9\x85\xd8\xb1\xd8\xad\xd8\xa8\xd8\xa7"), false, false, 10, run));
+    QVERIFY(!cache.glyphRun(QString::fromUtf8("\xe4\xb8\xad\xe6\x96\x87"), false, false, 10, run));
+}
+
+void TerminalTest::benchmarkDrawText_data()
+{
+    QTest::addColumn<bool>("glyphCache");
+
+    QTest::newRow("drawText") << false;
+    QTest::newRow("glyph cache") << true;
+}
+
+void TerminalTest::benchmarkDrawText()
+{
+    QFETCH(bool, glyphCache);
+
+    const QFont font = QFontDatabase::systemFont(QFontDatabase::FixedFont);
+    if (!QRawFont::fromFont(font).isValid()) {
+        QSKIP("No font to draw with");
+    }
+
+    // a 300x80 terminal filled with fragments of 10 characters, like
+    // colorful output
+    const QFontMetrics metrics(font);
+    const int cellWidth = metrics.width(QLatin1Char('x'));
+    const int columns = 300;
+    const int lines = 80;
+    QImage image(columns * cellWidth, lines * metrics.height(), QImage::Format_ARGB32_Premultiplied);
+
+    GlyphCache cache;
+    cache.setFont(font);
+    const QString text = QStringLiteral("int main()");
+
+    QBENCHMARK {
+        QPainter painter(&image);
+        painter.setFont(font);
+        for (int y = 0; y < lines; y++) {
+            for (int x = 0; x < columns; x += text.length()) {
+                painter.setPen(QColor::fromHsv(x % 360, 255, 255));
+                const QPointF position(x * cellWidth, y * metrics.height() + metrics.ascent());
+                QGlyphRun run;
+                if (glyphCache && cache.glyphRun(text, false, false, cellWidth, run)) {
+                    painter.drawGlyphRun(position, run);
+                } else {
+                    painter.drawText(position, text);
+                }
+            }
+        }
+    }
+}
+
 QTEST_MAIN(TerminalTest)
@@ -33,6 +33,10 @@ private Q_SLOTS:
     void testScrollBarPositions();
     void testColorTable();
     void testSize();
+    void testGlyphCache();
+
+    void benchmarkDrawText_data();
+    void benchmarkDrawText();
 
 private:
 };
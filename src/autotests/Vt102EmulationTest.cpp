@@ -22,6 +22,21 @@
 
 #include "qtest.h"
 
+// Qt
+#include <QFile>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QTextCodec>
+#include <QTextStream>
+
+// Konsole
+#include "../History.h"
+#include "../SaveHistoryThread.h"
+#include "../SearchHistoryThread.h"
+#include "../Vt102Emulation.h"
+#include "../ScreenWindow.h"
+#include "../TerminalCharacterDecoder.h"
+
 // The below is to verify the old #defines match the new constexprs
 // Just copy/paste for now from Vt102Emulation.cpp
 #define TY_CONSTRUCT(T,A,N) ( ((((int)(N)) & 0xffff) << 16) | ((((int)(A)) & 0xff) << 8) | (((int)(T)) & 0xff) )
@@ -39,6 +54,39 @@
 
 using namespace Konsole;
 
+// Receives data the way Emulation::receiveData() did before it scanned for
+// ASCII, by decoding everything and then looking for ZMODEM headers
+class CodecEmulation : public Vt102Emulation
+{
+public:
+    void receiveDecodedData(const char *text, int length)
+    {
+        const QVector<uint> unicodeText = _decoder->toUnicode(text, length).toUcs4();
+        receiveChars(unicodeText.constData(), unicodeText.size());
+
+        for (int i = 0; i < length; i++) {
+            if (text[i] == '\030' && length - i - 1 > 3) {
+                if (qstrncmp(text + i + 1, "B00", 3) == 0) {
+                    emit zmodemDownloadDetected();
+                } else if (qstrncmp(text + i + 1, "B01", 3) == 0) {
+                    emit zmodemUploadDetected();
+                }
+            }
+        }
+    }
+};
+
+static QString outputText(Emulation &emulation)
+{
+    QString text;
+    QTextStream stream(&text);
+    PlainTextDecoder decoder;
+    decoder.begin(&stream);
+    emulation.writeToStream(&decoder, 0, emulation.lineCount() - 1);
+    decoder.end();
+    return text;
+}
+
 constexpr int token_construct(int t, int a, int n)
 {
     return (((n & 0xffff) << 16) | ((a & 0xff) << 8) | (t & 0xff));
@@ -112,4 +160,427 @@ void Vt102EmulationTest::testTokenFunctions()
 
 }
 
+void Vt102EmulationTest::testReceivePlainText()
+{
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation.setImageSize(5, 10);
+
+    // a run which wraps, one which goes through the line drawing charset,
+    // then wide characters in the middle of a run
+    const QByteArray data = QByteArrayLiteral("abcdefghijklm\r\n"
+                                              "xy\033(0qq\033(Bq\r\n"
+                                              "a\xe4\xb8\xad" "b");
+    emulation.receiveData(data.constData(), data.size());
+
+    ScreenWindow *window = emulation.createWindow();
+    const Character *image = window->getImage();
+
+    const QString firstLines = QStringLiteral("abcdefghijklm");
+    for (int i = 0; i < firstLines.size(); i++) {
+        QCOMPARE(image[i].character, static_cast<uint>(firstLines.at(i).unicode()));
+    }
+    QVERIFY((window->getLineProperties().at(0) & LINE_WRAPPED) != 0);
+
+    QCOMPARE(image[20].character, static_cast<uint>('x'));
+    QCOMPARE(image[21].character, static_cast<uint>('y'));
+    QCOMPARE(image[22].character, static_cast<uint>(0x2500));
+    QCOMPARE(image[23].character, static_cast<uint>(0x2500));
+    QCOMPARE(image[24].character, static_cast<uint>('q'));
+
+    QCOMPARE(image[30].character, static_cast<uint>('a'));
+    QCOMPARE(image[31].character, static_cast<uint>(0x4e2d));
+    QCOMPARE(image[32].isRealCharacter, false);
+    QCOMPARE(image[33].character, static_cast<uint>('b'));
+    QCOMPARE(window->cursorPosition(), QPoint(4, 3));
+}
+
+void Vt102EmulationTest::testWindowChangedLines()
+{
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation.setImageSize(5, 10);
+
+    ScreenWindow *window = emulation.createWindow();
+    window->setWindowLines(5);
+
+    const QByteArray prompt = QByteArrayLiteral("$ ls\r\nfoo\r\n$ ");
+    emulation.receiveData(prompt.constData(), prompt.size());
+    window->getImage();
+    window->resetChangedLines();
+
+    // typing at the prompt only changes its line
+    emulation.receiveData("x", 1);
+    const Character *image = window->getImage();
+    QCOMPARE(image[22].character, static_cast<uint>('x'));
+    for (int line = 0; line < 5; line++) {
+        QCOMPARE(window->isLineChanged(line), line == 2);
+    }
+    window->resetChangedLines();
+
+    // moving the cursor changes the lines it moves from and to
+    emulation.receiveData("\033[H", 3);
+    image = window->getImage();
+    QVERIFY((image[0].rendition & RE_CURSOR) != 0);
+    QVERIFY((image[23].rendition & RE_CURSOR) == 0);
+    for (int line = 0; line < 5; line++) {
+        QCOMPARE(window->isLineChanged(line), line == 0 || line == 2);
+    }
+    window->resetChangedLines();
+
+    // without output, only the line of the cursor is copied again
+    window->getImage();
+    for (int line = 0; line < 5; line++) {
+        QCOMPARE(window->isLineChanged(line), line == 0);
+    }
+
+    // clearing the screen changes all the lines
+    emulation.receiveData("\033[2J", 4);
+    image = window->getImage();
+    QCOMPARE(image[22].character, static_cast<uint>(' '));
+    for (int line = 0; line < 5; line++) {
+        QCOMPARE(window->isLineChanged(line), true);
+    }
+}
+
+void Vt102EmulationTest::testWindowSelectionInHistory()
+{
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation.setHistory(CompactHistoryType(100));
+    emulation.setImageSize(5, 10);
+
+    ScreenWindow *window = emulation.createWindow();
+    window->setWindowLines(5);
+
+    for (int i = 0; i < 10; i++) {
+        const QByteArray line = QByteArrayLiteral("line ") + QByteArray::number(i) + QByteArrayLiteral("\r\n");
+        emulation.receiveData(line.constData(), line.size());
+    }
+
+    // the selected text in the history is shown reversed
+    window->scrollTo(0);
+    window->setSelectionStart(0, 0, false);
+    window->setSelectionEnd(3, 0);
+    const Character *image = window->getImage();
+    QVERIFY(!(image[0].backgroundColor == image[5].backgroundColor));
+    window->resetChangedLines();
+
+    // output overwriting the selection clears it through the screen, the
+    // lines of the history are copied again as well
+    window->screen()->clearSelection();
+    image = window->getImage();
+    QVERIFY(image[0].backgroundColor == image[5].backgroundColor);
+    QCOMPARE(window->isLineChanged(0), true);
+}
+
+void Vt102EmulationTest::testSharedWindowImage()
+{
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation.setHistory(CompactHistoryType(100));
+    emulation.setImageSize(5, 10);
+
+    ScreenWindow *first = emulation.createWindow();
+    ScreenWindow *second = emulation.createWindow();
+    first->setWindowLines(5);
+    second->setWindowLines(5);
+
+    for (int i = 0; i < 10; i++) {
+        const QByteArray line = QByteArrayLiteral("line ") + QByteArray::number(i) + QByteArrayLiteral("\r\n");
+        emulation.receiveData(line.constData(), line.size());
+    }
+    first->scrollTo(6);
+    second->scrollTo(6);
+
+    // the second window copies the image of the first one
+    const Character *firstImage = first->getImage();
+    const Character *secondImage = second->getImage();
+    QCOMPARE(secondImage[5].character, static_cast<uint>('6'));
+    for (int i = 0; i < 50; i++) {
+        QVERIFY(secondImage[i] == firstImage[i]);
+    }
+    first->resetChangedLines();
+    second->resetChangedLines();
+
+    // and then only the lines which changed
+    emulation.receiveData("x", 1);
+    firstImage = first->getImage();
+    secondImage = second->getImage();
+    QCOMPARE(secondImage[40].character, static_cast<uint>('x'));
+    for (int i = 0; i < 50; i++) {
+        QVERIFY(secondImage[i] == firstImage[i]);
+    }
+    for (int line = 0; line < 5; line++) {
+        QCOMPARE(second->isLineChanged(line), line == 4);
+    }
+
+    // a window showing other lines copies them from the screen
+    second->scrollTo(3);
+    secondImage = second->getImage();
+    QCOMPARE(secondImage[5].character, static_cast<uint>('3'));
+    QCOMPARE(first->getImage()[5].character, static_cast<uint>('6'));
+}
+
+void Vt102EmulationTest::testSaveHistory()
+{
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation.setHistory(CompactHistoryType(1000));
+    emulation.setImageSize(5, 10);
+
+    const QByteArray data = QByteArrayLiteral("abcdefghijklm\r\n"
+                                              "line 1\r\nline 2\r\n\r\n"
+                                              "a\xe4\xb8\xad" "b\r\n$ ");
+    for (int i = 0; i < 20; i++) {
+        emulation.receiveData(data.constData(), data.size());
+    }
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString fileName = dir.path() + QStringLiteral("/output.txt");
+
+    // the output saved in blocks is the same as when written at once
+    SaveHistoryThread thread(SaveHistoryThread::PlainText, fileName);
+    thread.start();
+    for (int line = 0; line < emulation.lineCount(); line += 7) {
+        LineBlock block;
+        emulation.currentScreen()->copyLines(line, line + 6, block);
+        thread.addBlock(block);
+    }
+    thread.finish();
+    QVERIFY(thread.wait());
+    QVERIFY(thread.errorString().isEmpty());
+
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    const QByteArray saved = file.readAll();
+    QCOMPARE(saved, QTextCodec::codecForLocale()->fromUnicode(outputText(emulation)));
+    QCOMPARE(thread.bytesSaved(), static_cast<qint64>(saved.size()));
+}
+
+void Vt102EmulationTest::testSaveHistoryReflow()
+{
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation.setHistory(CompactHistoryType(1000));
+    emulation.setImageSize(5, 10);
+
+    const QByteArray data = QByteArrayLiteral("abcdefghijklmnopqrstuvwxyz\r\nline\r\n");
+    for (int i = 0; i < 20; i++) {
+        emulation.receiveData(data.constData(), data.size());
+    }
+
+    // the history is rewrapped when it is looked at after the resize
+    emulation.setImageSize(5, 20);
+    const Screen *screen = emulation.currentScreen();
+    const QString expected = outputText(emulation);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString fileName = dir.path() + QStringLiteral("/output.txt");
+
+    SaveHistoryThread thread(SaveHistoryThread::PlainText, fileName);
+    thread.start();
+    SaveHistoryLines lines(screen);
+    LineBlock block;
+    QVERIFY(lines.copyBlock(5, block));
+    thread.addBlock(block);
+    QVERIFY(!lines.atEnd());
+
+    // the lines which were not copied yet are followed when they are
+    // rewrapped while saving
+    const int layoutId = screen->historyLayoutId();
+    ScreenWindow *window = emulation.createWindow();
+    window->scrollTo(0);
+    window->scrollTo(10);
+    QVERIFY(screen->historyLayoutId() != layoutId);
+
+    while (!lines.atEnd()) {
+        LineBlock nextBlock;
+        QVERIFY(lines.copyBlock(5, nextBlock));
+        thread.addBlock(nextBlock);
+    }
+    thread.finish();
+    QVERIFY(thread.wait());
+    QVERIFY(thread.errorString().isEmpty());
+
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE(file.readAll(), QTextCodec::codecForLocale()->fromUnicode(expected));
+    QCOMPARE(outputText(emulation), expected);
+
+    // while the lines cannot be followed once the terminal is resized
+    SaveHistoryLines resizedLines(screen);
+    emulation.setImageSize(5, 15);
+    LineBlock resizedBlock;
+    QVERIFY(!resizedLines.copyBlock(5, resizedBlock));
+    QCOMPARE(resizedBlock.lineCount(), 0);
+}
+
+void Vt102EmulationTest::testSearchMatchColumns()
+{
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation.setHistory(CompactHistoryType(1000));
+    emulation.setImageSize(5, 10);
+
+    // two double width characters, then a character outside of the BMP
+    const QByteArray data = QByteArrayLiteral("\xe4\xb8\xad\xe6\x96\x87 ab\r\n"
+                                              "\xf0\x9d\x90\x80" "ab\r\n");
+    emulation.receiveData(data.constData(), data.size());
+
+    SearchHistoryThread thread(QRegularExpression(QStringLiteral("ab")));
+    QSignalSpy spy(&thread, &SearchHistoryThread::blockSearched);
+    thread.start();
+    LineBlock block;
+    emulation.currentScreen()->copyLines(0, 1, block);
+    thread.addBlock(block);
+    QVERIFY(spy.wait());
+
+    // matches are placed on the columns of the cells, not of the text
+    const QVector<SearchMatch> matches = spy.at(0).at(2).value<QVector<SearchMatch> >();
+    QCOMPARE(matches.size(), 2);
+    QCOMPARE(matches.at(0).startLine, 0);
+    QCOMPARE(matches.at(0).startColumn, 5);
+    QCOMPARE(matches.at(0).endColumn, 7);
+    QCOMPARE(matches.at(1).startLine, 1);
+    QCOMPARE(matches.at(1).startColumn, 1);
+    QCOMPARE(matches.at(1).endColumn, 3);
+}
+
+void Vt102EmulationTest::testReceiveSplitUtf8()
+{
+    QFile file(QFINDTESTDATA("../../tests/UTF-8-test.txt"));
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    const QByteArray data = file.readAll();
+
+    // sequences split between calls, and malformed ones, are decoded the
+    // same with and without the ASCII fast path
+    Vt102Emulation emulation;
+    CodecEmulation reference;
+    foreach (Emulation *e, QList<Emulation *>() << &emulation << &reference) {
+        e->setCodec(QTextCodec::codecForName("UTF-8"));
+        e->setHistory(CompactHistoryType(1000));
+        e->setImageSize(40, 80);
+    }
+
+    for (int i = 0; i < data.size(); i += 7) {
+        const int length = qMin(7, data.size() - i);
+        emulation.receiveData(data.constData() + i, length);
+        reference.receiveDecodedData(data.constData() + i, length);
+    }
+
+    QCOMPARE(emulation.lineCount(), reference.lineCount());
+    QCOMPARE(outputText(emulation), outputText(reference));
+}
+
+void Vt102EmulationTest::testBufferedUpdate()
+{
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation.setImageSize(24, 80);
+    QSignalSpy spy(&emulation, &Emulation::outputChanged);
+
+    // output received in quick succession is shown at once
+    const QByteArray line = QByteArrayLiteral("y\r\n");
+    for (int i = 0; i < 100; i++) {
+        emulation.receiveData(line.constData(), line.size());
+    }
+    QCOMPARE(emulation.receivedBytes(), static_cast<qint64>(100 * line.size()));
+    QCOMPARE(spy.count(), 0);
+    QVERIFY(spy.wait());
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(emulation.updateCount(), 1);
+
+    // output received after an update waits for the update interval, however
+    // much of it arrives and however often events are processed
+    emulation.setMinimumUpdateInterval(60 * 1000);
+    spy.clear();
+    for (int i = 0; i < 100; i++) {
+        emulation.receiveData(line.constData(), line.size());
+        QCoreApplication::processEvents();
+    }
+    QCOMPARE(spy.count(), 0);
+    QCOMPARE(emulation.updateCount(), 1);
+}
+
+void Vt102EmulationTest::testZModemDetection()
+{
+    Vt102Emulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    QSignalSpy downloadSpy(&emulation, &Emulation::zmodemDownloadDetected);
+    QSignalSpy uploadSpy(&emulation, &Emulation::zmodemUploadDetected);
+
+    // headers after ASCII, right after non-ASCII text, and one too short
+    const QByteArray data = QByteArrayLiteral("rz waiting to receive.**\030B0100000023be50\r\n"
+                                              "\xc3\xa9\030B00000000000000\r\n"
+                                              "\030B00");
+    emulation.receiveData(data.constData(), data.size());
+
+    QCOMPARE(uploadSpy.count(), 1);
+    QCOMPARE(downloadSpy.count(), 1);
+}
+
+void Vt102EmulationTest::benchmarkReceiveAsciiText()
+{
+    // a log like output, for the fast path for plain text
+    QByteArray data;
+    for (int i = 0; i < 20000; i++) {
+        data += "2018-01-01 12:00:00 [info] processing request " + QByteArray::number(i) + " from client\r\n";
+    }
+
+    Vt102Emulation emulation;
+    emulation.setImageSize(40, 100);
+
+    QBENCHMARK {
+        emulation.receiveData(data.constData(), data.size());
+    }
+}
+
+void Vt102EmulationTest::benchmarkReceiveData_data()
+{
+    QTest::addColumn<QByteArray>("data");
+    QTest::addColumn<bool>("codecOnly");
+
+    QFile file(QFINDTESTDATA("../../tests/UTF-8-demo.txt"));
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    const QByteArray demo = file.readAll().repeated(20);
+
+    QByteArray ascii;
+    qsrand(42);
+    for (int i = 0; i < 1024 * 1024; i++) {
+        ascii += (qrand() % 80 == 0) ? '\n' : char(' ' + qrand() % 95);
+    }
+
+    QTest::newRow("UTF-8-demo.txt, scan") << demo << false;
+    QTest::newRow("UTF-8-demo.txt, codec") << demo << true;
+    QTest::newRow("random ASCII, scan") << ascii << false;
+    QTest::newRow("random ASCII, codec") << ascii << true;
+}
+
+void Vt102EmulationTest::benchmarkReceiveData()
+{
+    QFETCH(QByteArray, data);
+    QFETCH(bool, codecOnly);
+
+    CodecEmulation emulation;
+    emulation.setCodec(QTextCodec::codecForName("UTF-8"));
+    emulation.setImageSize(40, 100);
+
+    // in blocks of the size read from the terminal
+    static const int BLOCK_SIZE = 4096;
+
+    QBENCHMARK {
+        for (int i = 0; i < data.size(); i += BLOCK_SIZE) {
+            const int length = qMin(BLOCK_SIZE, data.size() - i);
+            if (codecOnly) {
+                emulation.receiveDecodedData(data.constData() + i, length);
+            } else {
+                emulation.receiveData(data.constData() + i, length);
+            }
+        }
+    }
+}
+
 QTEST_MAIN(Vt102EmulationTest)
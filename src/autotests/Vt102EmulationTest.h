@@ -31,6 +31,20 @@ class Vt102EmulationTest : public QObject
 
 private Q_SLOTS:
     void testTokenFunctions();
+    void testReceivePlainText();
+    void testWindowChangedLines();
+    void testWindowSelectionInHistory();
+    void testSharedWindowImage();
+    void testSaveHistory();
+    void testSaveHistoryReflow();
+    void testSearchMatchColumns();
+    void testReceiveSplitUtf8();
+    void testZModemDetection();
+    void testBufferedUpdate();
+
+    void benchmarkReceiveAsciiText();
+    void benchmarkReceiveData_data();
+    void benchmarkReceiveData();
 
 private:
 };